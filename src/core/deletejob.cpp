@@ -1,6 +1,13 @@
 #include "deletejob.h"
 #include "totalsizejob.h"
 #include "fileinfo_p.h"
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace Fm {
 
@@ -9,7 +16,7 @@ bool DeleteJob::deleteFile(const FilePath& path, GFileInfoPtr inf) {
     while(!inf) {
         GErrorPtr err;
         inf = GFileInfoPtr{
-            g_file_query_info(path.gfile().get(), "standard::*",
+            g_file_query_info(path.gfile().get(), gFileInfoQueryAttribs(GFileInfoQuery::Delete),
             G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
             cancellable().get(), &err),
             false
@@ -84,7 +91,7 @@ bool DeleteJob::deleteFile(const FilePath& path, GFileInfoPtr inf) {
 bool DeleteJob::deleteDirContent(const FilePath& path, GFileInfoPtr inf) {
     GErrorPtr err;
     GFileEnumeratorPtr enu {
-        g_file_enumerate_children(path.gfile().get(), defaultGFileInfoQueryAttribs,
+        g_file_enumerate_children(path.gfile().get(), gFileInfoQueryAttribs(GFileInfoQuery::Delete),
         G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
         cancellable().get(), &err),
         false
@@ -122,11 +129,202 @@ bool DeleteJob::deleteDirContent(const FilePath& path, GFileInfoPtr inf) {
 }
 
 
-DeleteJob::DeleteJob(const FilePathList &paths): paths_{paths} {
+Job::ErrorAction DeleteJob::emitNativeError(int errsv, const std::string& path, ErrorSeverity severity) {
+    QString msg = tr("Error removing '%1': %2").arg(QString::fromLocal8Bit(path.c_str()),
+                                                    QString::fromLocal8Bit(g_strerror(errsv)));
+    GErrorPtr err{G_IO_ERROR, static_cast<unsigned int>(g_io_error_from_errno(errsv)), msg};
+    // the workers of a parallel deletion report their errors one at a time
+    std::lock_guard<std::mutex> lock{errorMutex_};
+    if(isCancelled()) {
+        return ErrorAction::CONTINUE;
+    }
+    return emitError(err, severity);
+}
+
+void DeleteJob::addNativeProgress(unsigned int found, unsigned int deleted) {
+    std::uint64_t estimate = (nativeFound_ += found);
+    std::uint64_t readDirs = nativeReadDirs_;
+    std::uint64_t foundDirs = nativeFoundDirs_;
+    if(readDirs > 0 && foundDirs > readDirs) {
+        estimate += (foundDirs - readDirs) * (estimate / readDirs);
+    }
+    setTotalAmount(gioTotalSize_, gioFileCount_ + estimate);
+    addFinishedAmount(0, deleted);
+}
+
+// Deletes the content of a directory. "fd" is an open file descriptor of the
+// directory, which is closed by this function.
+bool DeleteJob::deleteNativeDirContent(int fd, const std::string& dirPath, bool parallel) {
+    DIR* dir = fdopendir(fd);
+    if(!dir) {
+        int errsv = errno;
+        close(fd);
+        emitNativeError(errsv, dirPath, ErrorSeverity::MODERATE);
+        return false;
+    }
+    setCurrentFile(FilePath::fromLocalPath(dirPath.c_str()));
+
+    bool hasError = false;
+    unsigned int found = 0, deleted = 0;
+    std::vector<std::string> subdirs; // to be deleted in parallel
+    struct dirent* ent;
+    while(!isCancelled() && (ent = readdir(dir)) != nullptr) {
+        const char* name = ent->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        ++found;
+        bool isDir = ent->d_type == DT_DIR;
+        if(ent->d_type == DT_UNKNOWN) { // not all file systems report the type
+            struct stat st;
+            isDir = fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+        if(isDir) {
+            ++nativeFoundDirs_;
+        }
+        if(isDir && parallel) {
+            subdirs.emplace_back(name);
+            continue;
+        }
+        if(deleteNativeEntry(dirfd(dir), dirPath, name, isDir, false)) {
+            ++deleted;
+        }
+        else {
+            hasError = true;
+        }
+        if(found >= 256) {
+            addNativeProgress(found, deleted);
+            found = deleted = 0;
+        }
+    }
+    addNativeProgress(found, deleted);
+
+    if(!subdirs.empty() && !isCancelled()) {
+        // each thread deletes whole subtrees
+        std::atomic<size_t> next{0};
+        std::atomic<bool> subdirError{false};
+        int parentFd = dirfd(dir);
+        auto worker = [&]() {
+            size_t i;
+            while(!isCancelled() && (i = next++) < subdirs.size()) {
+                if(deleteNativeEntry(parentFd, dirPath, subdirs[i].c_str(), true, false)) {
+                    addNativeProgress(0, 1);
+                }
+                else {
+                    subdirError = true;
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        size_t n_threads = std::min(static_cast<size_t>(threadCount_), subdirs.size());
+        for(size_t i = 1; i < n_threads; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        hasError = hasError || subdirError;
+    }
+    closedir(dir);
+    return !hasError;
+}
+
+// Deletes a file or a directory with its content, relative to its parent directory.
+bool DeleteJob::deleteNativeEntry(int parentFd, const std::string& parentPath, const char* name, bool isDir, bool parallel) {
+    std::string path = parentPath;
+    if(path.empty() || path.back() != '/') {
+        path += '/';
+    }
+    path += name;
+    bool ret = false;
+    bool rescanned = false;
+    while(!isCancelled()) {
+        if(isDir) {
+            // delete the content of the dir prior to deleting itself
+            int fd = openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if(fd >= 0) {
+                deleteNativeDirContent(fd, path, parallel);
+            }
+            else if(errno != ENOENT) {
+                ErrorAction act = emitNativeError(errno, path, ErrorSeverity::MODERATE);
+                if(act == ErrorAction::RETRY) {
+                    continue;
+                }
+                break;
+            }
+        }
+        if(isCancelled()) {
+            break;
+        }
+        if(unlinkat(parentFd, name, isDir ? AT_REMOVEDIR : 0) == 0 || errno == ENOENT) {
+            ret = true;
+            break;
+        }
+        if(errno == ENOTEMPTY && isDir && !rescanned) {
+            // some file systems may skip entries if the directory is changed while it is read
+            rescanned = true;
+            continue;
+        }
+        ErrorAction act = emitNativeError(errno, path, ErrorSeverity::MODERATE);
+        if(act != ErrorAction::RETRY) {
+            break;
+        }
+    }
+    if(isDir) { // the directory is no longer pending for the estimation
+        ++nativeReadDirs_;
+    }
+    return ret;
+}
+
+bool DeleteJob::deleteNativeFile(const FilePath& path) {
+    setCurrentFile(path);
+    std::string localPath = path.localPath().get();
+    struct stat st;
+    while(fstatat(AT_FDCWD, localPath.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        ErrorAction act = emitNativeError(errno, localPath, ErrorSeverity::SEVERE);
+        if(act != ErrorAction::RETRY) {
+            return false;
+        }
+    }
+
+    auto parent = path.parent();
+    std::string parentPath = parent ? parent.localPath().get() : "/";
+    int parentFd = open(parentPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(parentFd < 0) {
+        emitNativeError(errno, parentPath, ErrorSeverity::MODERATE);
+        return false;
+    }
+    auto basename = path.baseName();
+    if(S_ISDIR(st.st_mode)) {
+        ++nativeFoundDirs_;
+    }
+    bool ret = deleteNativeEntry(parentFd, parentPath, basename.get(), S_ISDIR(st.st_mode), threadCount_ > 1);
+    close(parentFd);
+    addNativeProgress(0, 1);
+    return ret;
+}
+
+
+DeleteJob::DeleteJob(const FilePathList &paths):
+    paths_{paths},
+    threadCount_{1},
+    gioTotalSize_{0},
+    gioFileCount_{0},
+    nativeFound_{0},
+    nativeFoundDirs_{0},
+    nativeReadDirs_{0} {
     setCalcProgressUsingSize(false);
 }
 
-DeleteJob::DeleteJob(FilePathList &&paths): paths_{paths} {
+DeleteJob::DeleteJob(FilePathList &&paths):
+    paths_{paths},
+    threadCount_{1},
+    gioTotalSize_{0},
+    gioFileCount_{0},
+    nativeFound_{0},
+    nativeFoundDirs_{0},
+    nativeReadDirs_{0} {
     setCalcProgressUsingSize(false);
 }
 
@@ -134,24 +332,45 @@ DeleteJob::~DeleteJob() {
 }
 
 void DeleteJob::exec() {
-    /* prepare the job, count total work needed with FmDeepCountJob */
-    TotalSizeJob totalSizeJob{paths_, TotalSizeJob::Flags::PREPARE_DELETE};
-    connect(&totalSizeJob, &TotalSizeJob::error, this, &DeleteJob::error);
-    connect(this, &DeleteJob::cancelled, &totalSizeJob, &TotalSizeJob::cancel);
-    totalSizeJob.run();
+    // Local files are deleted in a single pass, with an estimated total amount.
+    // The other files are counted with TotalSizeJob first.
+    FilePathList gioPaths;
+    for(auto& path : paths_) {
+        if(path.isNative()) {
+            ++nativeFound_;
+        }
+        else {
+            gioPaths.push_back(path);
+        }
+    }
 
-    if(isCancelled()) {
-        return;
+    if(!gioPaths.empty()) {
+        /* prepare the job, count total work needed with FmDeepCountJob */
+        TotalSizeJob totalSizeJob{std::move(gioPaths), TotalSizeJob::Flags::PREPARE_DELETE};
+        connect(&totalSizeJob, &TotalSizeJob::error, this, &DeleteJob::error);
+        connect(this, &DeleteJob::cancelled, &totalSizeJob, &TotalSizeJob::cancel);
+        totalSizeJob.run();
+
+        if(isCancelled()) {
+            return;
+        }
+        gioTotalSize_ = totalSizeJob.totalSize();
+        gioFileCount_ = totalSizeJob.fileCount();
     }
 
-    setTotalAmount(totalSizeJob.totalSize(), totalSizeJob.fileCount());
+    setTotalAmount(gioTotalSize_, gioFileCount_ + nativeFound_);
     Q_EMIT preparedToRun();
 
     for(auto& path : paths_) {
         if(isCancelled()) {
             break;
         }
-        deleteFile(path, GFileInfoPtr{nullptr});
+        if(path.isNative()) {
+            deleteNativeFile(path);
+        }
+        else {
+            deleteFile(path, GFileInfoPtr{nullptr});
+        }
     }
 }
 
@@ -5,6 +5,10 @@
 #include "fileoperationjob.h"
 #include "filepath.h"
 #include "gioptrs.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
 
 namespace Fm {
 
@@ -17,6 +21,19 @@ public:
 
     ~DeleteJob() override;
 
+    // The number of threads that delete a local directory given to the job. Only the
+    // subdirectories directly inside it are shared out, one whole subtree per thread,
+    // so this helps with many subtrees of similar size and not with one deep tree.
+    // The default is one; libfm-qt itself (e.g. FileOperation) never changes it, so
+    // only the applications that create DeleteJob themselves can enable it.
+    void setThreadCount(int count) {
+        threadCount_ = std::max(count, 1);
+    }
+
+    int threadCount() const {
+        return threadCount_;
+    }
+
 protected:
     void exec() override;
 
@@ -24,8 +41,25 @@ private:
     bool deleteFile(const FilePath& path, GFileInfoPtr inf);
     bool deleteDirContent(const FilePath& path, GFileInfoPtr inf);
 
+    // the native engine for local files, which walks the tree only once
+    bool deleteNativeFile(const FilePath& path);
+    bool deleteNativeEntry(int parentFd, const std::string& parentPath, const char* name, bool isDir, bool parallel);
+    bool deleteNativeDirContent(int fd, const std::string& dirPath, bool parallel);
+    ErrorAction emitNativeError(int errsv, const std::string& path, ErrorSeverity severity);
+    void addNativeProgress(unsigned int found, unsigned int deleted);
+
 private:
     FilePathList paths_;
+    int threadCount_;
+
+    // The total amount of a native deletion is estimated as it goes, assuming
+    // that the directories not read yet are as large as the ones read so far.
+    std::uint64_t gioTotalSize_;
+    std::uint64_t gioFileCount_;
+    std::atomic<std::uint64_t> nativeFound_;
+    std::atomic<std::uint64_t> nativeFoundDirs_;
+    std::atomic<std::uint64_t> nativeReadDirs_;
+    std::mutex errorMutex_;
 };
 
 } // namespace Fm
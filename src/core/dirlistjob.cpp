@@ -2,12 +2,501 @@
 #include <gio/gio.h>
 #include "fileinfo_p.h"
 #include "gioptrs.h"
+#include "statxstage.h"
 #include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#if defined(FM_HAVE_STATX_STAGE) && defined(SYS_getdents64)
+#define FM_NATIVE_DIR_LISTING
+#endif
 
 namespace Fm {
 
+bool DirListJob::nativeListingEnabled_ = true;
+bool DirListJob::localEmblemsEnabled_ = false;
+
+#ifdef FM_NATIVE_DIR_LISTING
+
+// the records returned by getdents64(), which older C libraries do not declare
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// the fields that FileInfo needs
+static const unsigned int nativeStatxMask = STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID
+                                            | STATX_ATIME | STATX_MTIME | STATX_CTIME | STATX_BTIME
+                                            | STATX_INO | STATX_SIZE | STATX_BLOCKS;
+
+#endif
+
+// the state shared by the entries of a directory that is listed natively
+struct DirListJob::NativeDir {
+    int fd = -1;
+    bool detailed = false;
+    bool utf8Names = true; // see g_get_filename_charsets()
+    bool writable = false; // the directory, for renaming and deleting its entries
+    bool sticky = false;
+    uid_t owner = 0;
+    uid_t euid = 0;
+    dev_t dev = 0;
+    bool isMountRoot = false; // GIO hides "lost+found" in the root of a filesystem
+    bool hasMetadata = false; // whether GIO keeps metadata (emblems, trust) for local files
+    std::unordered_set<std::string> hiddenNames; // the names in the ".hidden" file
+    std::unordered_map<std::string, std::shared_ptr<const IconInfo>> icons; // by content type
+};
+
+// GIO gives some folders of the user special icons (see get_icon() in glocalfileinfo.c)
+static GIcon* specialFolderIcon(const char* path) {
+    if(g_strcmp0(path, g_get_home_dir()) == 0) {
+        return g_themed_icon_new("user-home");
+    }
+    if(g_strcmp0(path, g_get_user_special_dir(G_USER_DIRECTORY_DESKTOP)) == 0) {
+        return g_themed_icon_new("user-desktop");
+    }
+    static const struct {
+        GUserDirectory dir;
+        const char* iconName;
+    } specialDirs[] = {
+        {G_USER_DIRECTORY_DOCUMENTS, "folder-documents"},
+        {G_USER_DIRECTORY_DOWNLOAD, "folder-download"},
+        {G_USER_DIRECTORY_MUSIC, "folder-music"},
+        {G_USER_DIRECTORY_PICTURES, "folder-pictures"},
+        {G_USER_DIRECTORY_PUBLIC_SHARE, "folder-publicshare"},
+        {G_USER_DIRECTORY_TEMPLATES, "folder-templates"},
+        {G_USER_DIRECTORY_VIDEOS, "folder-videos"}
+    };
+    for(const auto& specialDir : specialDirs) {
+        if(g_strcmp0(path, g_get_user_special_dir(specialDir.dir)) == 0) {
+            return g_themed_icon_new_with_default_fallbacks(specialDir.iconName);
+        }
+    }
+    return nullptr;
+}
+
+// reads the beginning of a file to find its content type, like GIO does when the
+// type cannot be known from the file name
+static CStrPtr sniffContentType(int dirFd, const char* name) {
+    int fd = openat(dirFd, name, O_RDONLY | O_NOATIME | O_CLOEXEC);
+    if(fd < 0 && errno == EPERM) { // O_NOATIME is only allowed for the owner
+        fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC);
+    }
+    if(fd < 0) {
+        return CStrPtr{};
+    }
+    guchar buffer[4096];
+    ssize_t n;
+    do {
+        n = read(fd, buffer, sizeof(buffer));
+    } while(n < 0 && errno == EINTR);
+    close(fd);
+    if(n < 0) {
+        return CStrPtr{};
+    }
+    return CStrPtr{g_content_type_guess(name, buffer, n, nullptr)};
+}
+
 DirListJob::DirListJob(const FilePath& path, Flags _flags):
-    dir_path{path}, flags{_flags} {
+    dir_path{path},
+    flags{_flags},
+    emit_files_found{false},
+    detailed_{false},
+    hasErrors_{false},
+    batchMaxFiles_{1000},
+    batchMaxInterval_{50} {
+}
+
+Job::ErrorAction DirListJob::emitListingError(const GErrorPtr& err, ErrorSeverity severity) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        hasErrors_ = true;
+    }
+    return emitError(err, severity);
+}
+
+void DirListJob::setIncremental(bool set) {
+    emit_files_found = set;
+}
+
+void DirListJob::setIncrementalBatch(size_t maxFiles, int maxIntervalMs) {
+    batchMaxFiles_ = std::max(maxFiles, size_t{1});
+    batchMaxInterval_ = std::max(maxIntervalMs, 0);
+}
+
+// static
+bool DirListJob::nativeListingEnabled() {
+    return nativeListingEnabled_;
+}
+
+// static
+void DirListJob::setNativeListingEnabled(bool enabled) {
+    nativeListingEnabled_ = enabled;
+}
+
+// static
+bool DirListJob::localEmblemsEnabled() {
+    return localEmblemsEnabled_;
+}
+
+// static
+void DirListJob::setLocalEmblemsEnabled(bool enabled) {
+    localEmblemsEnabled_ = enabled;
+}
+
+// static
+bool DirListJob::parallelStatEnabled() {
+#ifdef FM_HAVE_STATX_STAGE
+    return StatxStage::defaultBackend() != StatxStage::Synchronous;
+#else
+    return false;
+#endif
+}
+
+// static
+void DirListJob::setParallelStatEnabled(bool enabled) {
+#ifdef FM_HAVE_STATX_STAGE
+    StatxStage::setDefaultBackend(enabled ? StatxStage::Auto : StatxStage::Synchronous);
+#else
+    Q_UNUSED(enabled);
+#endif
+}
+
+void DirListJob::emitFoundFiles(FileInfoList& foundFiles) {
+    if(foundFiles.empty() || isCancelled()) {
+        return;
+    }
+    // the receiver is in the main thread and the signal is connected with
+    // Qt::BlockingQueuedConnection, so the list can be passed by reference.
+    Q_EMIT filesFound(foundFiles);
+    foundFiles.clear();
+}
+
+void DirListJob::addFoundFile(FileInfoList& foundFiles, std::shared_ptr<const FileInfo> file, QElapsedTimer& batchTimer) {
+    foundFiles.push_back(std::move(file));
+    if(emit_files_found
+       && (foundFiles.size() >= batchMaxFiles_ || batchTimer.hasExpired(batchMaxInterval_))) {
+        emitFoundFiles(foundFiles);
+        batchTimer.restart();
+    }
+}
+
+// Lists a local directory with the same results as g_file_enumerate_children() but without
+// making a GFileInfo for every file. Returns false if the directory cannot be listed this
+// way, in which case GIO should be used, which also reports the errors.
+bool DirListJob::listNative(FileInfoList& foundFiles, QElapsedTimer& batchTimer) {
+#ifdef FM_NATIVE_DIR_LISTING
+    auto localPath = dir_path.localPath();
+    NativeDir dir;
+    dir.fd = open(localPath.get(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dir.fd < 0) {
+        return false;
+    }
+    dir.detailed = isDetailed();
+    dir.utf8Names = g_get_filename_charsets(nullptr);
+    struct stat dirStat;
+    if(fstat(dir.fd, &dirStat) == 0) {
+        dir.sticky = (dirStat.st_mode & S_ISVTX) != 0;
+        dir.owner = dirStat.st_uid;
+        dir.dev = dirStat.st_dev;
+        // the parent of a mount point is on another device, and "/" is its own parent
+        struct stat parentStat;
+        if(fstatat(dir.fd, "..", &parentStat, 0) == 0) {
+            dir.isMountRoot = parentStat.st_dev != dirStat.st_dev || parentStat.st_ino == dirStat.st_ino;
+        }
+    }
+    dir.writable = access(localPath.get(), W_OK) == 0;
+    dir.euid = geteuid();
+    if(auto namespaces = g_file_query_writable_namespaces(dir_path.gfile().get(), cancellable().get(), nullptr)) {
+        dir.hasMetadata = g_file_attribute_info_list_lookup(namespaces, "metadata") != nullptr;
+        g_file_attribute_info_list_unref(namespaces);
+    }
+    // the emblems would need a GIO query for each file; see setLocalEmblemsEnabled()
+    if(dir.hasMetadata && localEmblemsEnabled_) {
+        close(dir.fd);
+        return false;
+    }
+
+    // the names of the hidden files may be listed in ".hidden", one per line
+    int hiddenFd = openat(dir.fd, ".hidden", O_RDONLY | O_CLOEXEC);
+    if(hiddenFd >= 0) {
+        std::string data;
+        char buffer[4096];
+        ssize_t n;
+        while((n = read(hiddenFd, buffer, sizeof(buffer))) > 0) {
+            data.append(buffer, n);
+        }
+        close(hiddenFd);
+        size_t start = 0;
+        while(start < data.size()) {
+            size_t end = data.find('\n', start);
+            if(end == std::string::npos) {
+                end = data.size();
+            }
+            if(end > start) {
+                dir.hiddenNames.emplace(data, start, end - start);
+            }
+            start = end + 1;
+        }
+    }
+
+    // the files of each chunk of entries are queried together, in parallel if the stage allows
+    auto stage = StatxStage::create();
+    std::vector<StatxStage::Request> requests;
+    alignas(LinuxDirent64) char buffer[32 * 1024];
+    while(!isCancelled()) {
+        long n = syscall(SYS_getdents64, dir.fd, buffer, sizeof(buffer));
+        if(n <= 0) {
+            if(n < 0 && errno != EINTR) {
+                int errsv = errno;
+                GErrorPtr err{G_IO_ERROR, static_cast<unsigned int>(g_io_error_from_errno(errsv)),
+                              tr("Error reading '%1': %2").arg(QString::fromLocal8Bit(localPath.get()),
+                                                              QString::fromLocal8Bit(g_strerror(errsv)))};
+                if(emitListingError(err, ErrorSeverity::MILD) == ErrorAction::ABORT) {
+                    cancel();
+                }
+            }
+            else if(n < 0) {
+                continue;
+            }
+            break;
+        }
+        requests.clear();
+        for(long pos = 0; pos < n;) {
+            auto ent = reinterpret_cast<LinuxDirent64*>(buffer + pos);
+            pos += ent->d_reclen;
+            const char* name = ent->d_name;
+            if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            requests.push_back(StatxStage::Request{name, 0, {}});
+        }
+        stage->run(dir.fd, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, nativeStatxMask, requests.data(), requests.size());
+
+        bool failed = false;
+        for(auto& request : requests) {
+            if(isCancelled()) {
+                break;
+            }
+            if(request.error == 0) {
+                addFoundFile(foundFiles, nativeFileInfo(dir, request.name, request.result), batchTimer);
+            }
+            else if(request.error != ENOENT) { // a file removed during the listing is skipped like GIO does
+                int errsv = request.error;
+                GErrorPtr err{G_IO_ERROR, static_cast<unsigned int>(g_io_error_from_errno(errsv)),
+                              tr("Error reading '%1': %2").arg(QString::fromLocal8Bit(localPath.get()),
+                                                              QString::fromLocal8Bit(g_strerror(errsv)))};
+                if(emitListingError(err, ErrorSeverity::MILD) == ErrorAction::ABORT) {
+                    cancel();
+                }
+                failed = true;
+                break;
+            }
+        }
+        if(failed) {
+            break;
+        }
+    }
+    close(dir.fd);
+    return true;
+#else
+    Q_UNUSED(foundFiles);
+    Q_UNUSED(batchTimer);
+    return false;
+#endif
+}
+
+// Makes the FileInfo of a file in a natively listed directory from its statx() result,
+// following symlinks like the GIO enumerator.
+std::shared_ptr<FileInfo> DirListJob::nativeFileInfo(NativeDir& dir, const char* name, struct statx& stx) {
+#ifdef FM_NATIVE_DIR_LISTING
+    auto info = std::make_shared<FileInfo>();
+    info->name_ = name;
+    info->dirPath_ = dir_path;
+
+    const bool isSymlink = S_ISLNK(stx.stx_mode);
+    bool isBrokenSymlink = false;
+    if(isSymlink) {
+        std::string target(stx.stx_size > 0 ? stx.stx_size : 256, '\0');
+        for(;;) {
+            ssize_t len = readlinkat(dir.fd, name, &target[0], target.size());
+            if(len < 0) {
+                target.clear();
+                break;
+            }
+            if(static_cast<size_t>(len) < target.size()) {
+                target.resize(len);
+                break;
+            }
+            target.resize(target.size() * 2);
+        }
+        info->target_ = std::move(target);
+        struct statx targetStx;
+        if(statx(dir.fd, name, AT_STATX_DONT_SYNC, nativeStatxMask, &targetStx) == 0) {
+            stx = targetStx;
+        }
+        else {
+            isBrokenSymlink = true;
+        }
+    }
+
+    // the display name is only different if the name is not valid UTF-8
+    std::string displayName;
+    if(!dir.utf8Names || !g_utf8_validate(name, -1, nullptr)) {
+        CStrPtr dispName{g_filename_display_name(name)};
+        displayName = dispName.get();
+        if(displayName.find("\357\277\275") != std::string::npos) {
+            displayName += g_dgettext("glib20", " (invalid encoding)");
+        }
+        if(info->name_ != displayName) {
+            info->dispName_ = QString::fromStdString(displayName);
+        }
+    }
+    else {
+        displayName = info->name_;
+    }
+
+    const dev_t dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    info->filesystemId_ = FileId::fromDevice(dev);
+    info->fileId_ = FileId::fromInode(dev, stx.stx_ino);
+    info->size_ = stx.stx_size;
+    info->allocatedSize_ = stx.stx_blocks * 512;
+    info->mode_ = stx.stx_mode;
+    if(isSymlink) {
+        info->mode_ = (info->mode_ & ~S_IFMT) | S_IFLNK;
+    }
+    info->uid_ = stx.stx_uid;
+    info->gid_ = stx.stx_gid;
+    info->mtime_ = stx.stx_mtime.tv_sec;
+    info->atime_ = stx.stx_atime.tv_sec;
+    info->ctime_ = stx.stx_ctime.tv_sec;
+    info->crtime_ = (stx.stx_mask & STATX_BTIME) ? stx.stx_btime.tv_sec : 0;
+
+    // the content type, as found by get_content_type() in glocalfileinfo.c
+    const bool isDir = S_ISDIR(stx.stx_mode);
+    const bool isEmptyFile = S_ISREG(stx.stx_mode) && stx.stx_size == 0;
+    std::shared_ptr<const MimeType> guessedMimeType;
+    CStrPtr sniffedType;
+    const char* contentType;
+    if(isBrokenSymlink) {
+        contentType = "inode/symlink";
+    }
+    else if(isDir) {
+        contentType = "inode/directory";
+    }
+    else if(S_ISCHR(stx.stx_mode)) {
+        contentType = "inode/chardevice";
+    }
+    else if(S_ISBLK(stx.stx_mode)) {
+        contentType = "inode/blockdevice";
+    }
+    else if(S_ISFIFO(stx.stx_mode)) {
+        contentType = "inode/fifo";
+    }
+    else if(isEmptyFile) {
+        contentType = "application/x-zerosize";
+    }
+    else if(S_ISSOCK(stx.stx_mode)) {
+        contentType = "inode/socket";
+    }
+    else {
+        bool uncertain = false;
+        guessedMimeType = MimeType::guessFromFileName(name, uncertain);
+        contentType = guessedMimeType->name();
+        if(uncertain && dir.detailed) {
+            if((sniffedType = sniffContentType(dir.fd, name))) {
+                contentType = sniffedType.get();
+            }
+        }
+    }
+    info->isMimeTypeGuessed_ = !dir.detailed;
+    if(isEmptyFile) {
+        /* Treat zero-sized files based on their extensions,
+           and only if not possible, use GLib's type. */
+        info->mimeType_ = MimeType::guessFromFileName(name);
+        if(info->mimeType_->isUnknownType()) {
+            info->mimeType_ = MimeType::fromName(contentType);
+        }
+        info->icon_ = info->mimeType_->icon();
+    }
+    else {
+        info->mimeType_ = MimeType::fromName(contentType);
+    }
+
+    // the access rights, as found by get_access_rights() in glocalfileinfo.c
+    info->isAccessible_ = faccessat(dir.fd, name, R_OK, 0) == 0;
+    info->isWritable_ = faccessat(dir.fd, name, W_OK, 0) == 0;
+    const bool canDelete = dir.writable
+                           && (!dir.sticky || dir.euid == stx.stx_uid || dir.euid == dir.owner || dir.euid == 0);
+    info->isDeletable_ = canDelete;
+    info->isNameChangeable_ = canDelete;
+    if(isDir && !isSymlink && !info->isWritable_) {
+        /* directories should be writable to be deleted by user */
+        info->isDeletable_ = false;
+    }
+
+    info->isHidden_ = name[0] == '.'
+                      || (dir.isMountRoot && dev == dir.dev && strcmp(name, "lost+found") == 0)
+                      || dir.hiddenNames.count(info->name_) > 0;
+    // GIO only takes regular files ending with "~" for backups, and
+    // g_file_info_get_is_backup() does not cover ".bak" and ".old".
+    info->isBackup_ = (S_ISREG(stx.stx_mode) && g_str_has_suffix(name, "~"))
+                      || g_str_has_suffix(displayName.c_str(), ".bak")
+                      || g_str_has_suffix(displayName.c_str(), ".old");
+
+    // the trust of the few executable files is read when it is needed; see FileInfo::isTrustable()
+    info->isTrustUnknown_ = dir.hasMetadata;
+
+    /* if there is a custom folder icon, use it */
+    if(isDir) {
+        info->loadCustomFolderIcon();
+    }
+    if(!info->icon_ && dir.detailed) {
+        GIconPtr specialIcon;
+        if(isDir) {
+            specialIcon = GIconPtr{specialFolderIcon(info->path().localPath().get()), false};
+        }
+        if(specialIcon) {
+            info->icon_ = IconInfo::fromGIcon(specialIcon);
+        }
+        else {
+            auto& icon = dir.icons[contentType];
+            if(!icon) {
+                icon = IconInfo::fromGIcon(GIconPtr{g_content_type_get_icon(contentType), false});
+            }
+            info->icon_ = icon;
+        }
+    }
+
+    // special handling for desktop entry files (show the name and icon defined in the desktop entry instead)
+    if(G_UNLIKELY(info->isDesktopEntry())) {
+        info->loadDesktopEntry();
+    }
+
+    if(!info->icon_) {
+        info->icon_ = info->mimeType_->icon();
+    }
+    return info;
+#else
+    Q_UNUSED(dir);
+    Q_UNUSED(name);
+    Q_UNUSED(stx);
+    return nullptr;
+#endif
 }
 
 void DirListJob::exec() {
@@ -30,7 +519,7 @@ _retry:
         false
     };
     if(!dir_inf) {
-        ErrorAction act = emitError(err, err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_CANCELLED
+        ErrorAction act = emitListingError(err, err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_CANCELLED
                                          ? ErrorSeverity::MILD // may happen with MTP
                                          : ErrorSeverity::MODERATE);
         if(act == ErrorAction::RETRY) {
@@ -47,10 +536,11 @@ _retry:
                 G_IO_ERROR_NOT_DIRECTORY,
                 tr("The specified directory '%1' is not valid").arg(QString::fromUtf8(path_str.get()))
         };
-        emitError(err, ErrorSeverity::CRITICAL);
+        emitListingError(err, ErrorSeverity::CRITICAL);
         return;
     }
     else {
+        bool remote = false;
         // First set the attributes "filesystem::readonly" and "filesystem::remote",
         // which will be queried by FileInfo and are useful only for the parent dir.
         if(GFileInfoPtr fs_info{
@@ -67,23 +557,33 @@ _retry:
                                                                                     G_FILE_ATTRIBUTE_FILESYSTEM_READONLY));
             }
             if(g_file_info_has_attribute(fs_info.get(), G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE)) {
-                g_file_info_set_attribute_boolean(dir_inf.get(),
-                                                  G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE,
-                                                  g_file_info_get_attribute_boolean(fs_info.get(),
-                                                                                    G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE));
+                remote = g_file_info_get_attribute_boolean(fs_info.get(), G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE);
+                g_file_info_set_attribute_boolean(dir_inf.get(), G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE, remote);
             }
         }
 
         std::lock_guard<std::mutex> lock{mutex_};
         dir_fi = std::make_shared<FileInfo>(dir_inf, dir_path);
+        detailed_ = (flags & DETAILED) && !(remote && (flags & FAST_IF_REMOTE));
     }
 
     FileInfoList foundFiles;
+    QElapsedTimer batchTimer;
+    if(emit_files_found) {
+        foundFiles.reserve(batchMaxFiles_);
+        batchTimer.start();
+    }
+    if(nativeListingEnabled_ && dir_path.isNative() && listNative(foundFiles, batchTimer)) {
+        finishListing(foundFiles);
+        return;
+    }
+
     /* check if FS is R/O and set attr. into inf */
     // FIXME:  _fm_file_info_job_update_fs_readonly(gf, inf, nullptr, nullptr);
     err.reset();
     GFileEnumeratorPtr enu = GFileEnumeratorPtr{
-            g_file_enumerate_children(dir_gfile.get(), defaultGFileInfoQueryAttribs,
+            g_file_enumerate_children(dir_gfile.get(),
+                                      gFileInfoQueryAttribs(isDetailed() ? GFileInfoQuery::Listing : GFileInfoQuery::FastListing),
                                       G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
             false
     };
@@ -124,16 +624,11 @@ _retry:
                 }
                 fi = fm_file_info_new_from_g_file_data(child, inf, sub);
 #endif
-                auto fileInfo = std::make_shared<FileInfo>(inf, FilePath(), realParentPath);
-                if(emit_files_found) {
-                    // Q_EMIT filesFound();
-                }
-
-                foundFiles.push_back(std::move(fileInfo));
+                addFoundFile(foundFiles, std::make_shared<FileInfo>(inf, FilePath(), realParentPath), batchTimer);
             }
             else {
                 if(err) {
-                    ErrorAction act = emitError(err, ErrorSeverity::MILD);
+                    ErrorAction act = emitListingError(err, ErrorSeverity::MILD);
                     /* ErrorAction::RETRY is not supported. */
                     if(act == ErrorAction::ABORT) {
                         cancel();
@@ -147,54 +642,24 @@ _retry:
         g_file_enumerator_close(enu.get(), cancellable().get(), &err);
     }
     else {
-        emitError(err, err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_CANCELLED
+        emitListingError(err, err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_CANCELLED
                        ? ErrorSeverity::MILD // may happen at Folder::reload()
                        : ErrorSeverity::CRITICAL);
     }
 
     // qDebug() << "END LISTING:" << dir_path.toString().get();
+    finishListing(foundFiles);
+}
+
+void DirListJob::finishListing(FileInfoList& foundFiles) {
+    if(emit_files_found) {
+        // flush the last batch
+        emitFoundFiles(foundFiles);
+    }
     if(!foundFiles.empty()) {
         std::lock_guard<std::mutex> lock{mutex_};
         files_.swap(foundFiles);
     }
 }
 
-#if 0
-//FIXME: incremental..
-
-static gboolean emit_found_files(gpointer user_data) {
-    /* this callback is called from the main thread */
-    FmDirListJob* job = FM_DIR_LIST_JOB(user_data);
-    /* g_print("emit_found_files: %d\n", g_slist_length(job->files_to_add)); */
-
-    if(g_source_is_destroyed(g_main_current_source())) {
-        return FALSE;
-    }
-    g_signal_emit(job, signals[FILES_FOUND], 0, job->files_to_add);
-    g_slist_free_full(job->files_to_add, (GDestroyNotify)fm_file_info_unref);
-    job->files_to_add = nullptr;
-    job->delay_add_files_handler = 0;
-    return FALSE;
-}
-
-static gpointer queue_add_file(FmJob* fmjob, gpointer user_data) {
-    FmDirListJob* job = FM_DIR_LIST_JOB(fmjob);
-    FmFileInfo* file = FM_FILE_INFO(user_data);
-    /* this callback is called from the main thread */
-    /* g_print("queue_add_file: %s\n", fm_file_info_get_disp_name(file)); */
-    job->files_to_add = g_slist_prepend(job->files_to_add, fm_file_info_ref(file));
-    if(job->delay_add_files_handler == 0)
-        job->delay_add_files_handler = g_timeout_add_seconds_full(G_PRIORITY_LOW,
-                                       1, emit_found_files, g_object_ref(job), g_object_unref);
-    return nullptr;
-}
-
-void fm_dir_list_job_add_found_file(FmDirListJob* job, FmFileInfo* file) {
-    fm_file_info_list_push_tail(job->files, file);
-    if(G_UNLIKELY(job->emit_files_found)) {
-        fm_job_call_main_thread(FM_JOB(job), queue_add_file, file);
-    }
-}
-#endif
-
 } // namespace Fm
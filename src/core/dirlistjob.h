@@ -3,6 +3,8 @@
 
 #include "../libfmqtglobals.h"
 #include <mutex>
+#include <sys/stat.h>
+#include <QElapsedTimer>
 #include "job.h"
 #include "filepath.h"
 #include "gobjectptr.h"
@@ -13,10 +15,14 @@ namespace Fm {
 class LIBFM_QT_API DirListJob : public Job {
     Q_OBJECT
 public:
+    // FAST skips sniffing the file contents for their MIME types, which are guessed
+    // from the file names instead; see FileInfo::isMimeTypeGuessed().
+    // With FAST_IF_REMOTE, a DETAILED job lists remote filesystems in the FAST mode.
     enum Flags {
         FAST = 0,
         DIR_ONLY = 1 << 0,
-        DETAILED = 1 << 1
+        DETAILED = 1 << 1,
+        FAST_IF_REMOTE = 1 << 2
     };
 
     explicit DirListJob(const FilePath& path, Flags flags);
@@ -25,12 +31,19 @@ public:
         return files_;
     }
 
+    // In incremental mode, found files are handed out in batches through filesFound()
+    // while the directory is being read, and files() only holds the files that are
+    // not emitted yet (normally none after the job is finished).
     void setIncremental(bool set);
 
     bool incremental() const {
         return emit_files_found;
     }
 
+    // A batch is emitted when it has maxFiles files or maxIntervalMs milliseconds
+    // have passed since the previous batch, whichever comes first.
+    void setIncrementalBatch(size_t maxFiles, int maxIntervalMs);
+
     FilePath dirPath() const {
         std::lock_guard<std::mutex> lock{mutex_};
         return dir_path;
@@ -41,13 +54,64 @@ public:
         return dir_fi;
     }
 
+    // Whether the content types were really queried; valid after the job is finished.
+    bool isDetailed() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return detailed_;
+    }
+
+    // Whether an error was reported, so that files() may be incomplete; valid after the job is finished.
+    bool hasErrors() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return hasErrors_;
+    }
+
+    // Local directories are read with getdents64() and statx() where they are available,
+    // and their FileInfo objects are made without querying GIO; the results are the same.
+    static bool nativeListingEnabled();
+
+    // Takes effect from the next job.
+    static void setNativeListingEnabled(bool enabled);
+
+    // Whether the emblems kept by GIO in the metadata of local files are listed. They need
+    // a GIO query for each file, so the local folders that can have metadata are then
+    // listed with GIO instead of natively. Disabled by default; takes effect from the next job.
+    static bool localEmblemsEnabled();
+
+    static void setLocalEmblemsEnabled(bool enabled);
+
+    // Whether the metadata of the files of local folders is queried in parallel, with
+    // io_uring or a few threads, by the native listing and by TotalSizeJob. This pays off
+    // with cold caches and slow disks, but not with warm caches. Disabled by default;
+    // takes effect from the next job.
+    static bool parallelStatEnabled();
+
+    static void setParallelStatEnabled(bool enabled);
+
 Q_SIGNALS:
+    // this signal should be connected with Qt::BlockingQueuedConnection
     void filesFound(FileInfoList& foundFiles);
 
 protected:
 
     void exec() override;
 
+private:
+    struct NativeDir;
+
+    // emitError() that also sets hasErrors()
+    ErrorAction emitListingError(const GErrorPtr& err, ErrorSeverity severity);
+
+    void emitFoundFiles(FileInfoList& foundFiles);
+
+    void addFoundFile(FileInfoList& foundFiles, std::shared_ptr<const FileInfo> file, QElapsedTimer& batchTimer);
+
+    void finishListing(FileInfoList& foundFiles);
+
+    bool listNative(FileInfoList& foundFiles, QElapsedTimer& batchTimer);
+
+    std::shared_ptr<FileInfo> nativeFileInfo(NativeDir& dir, const char* name, struct statx& stx);
+
 private:
     mutable std::mutex mutex_;
     FilePath dir_path;
@@ -55,8 +119,13 @@ private:
     std::shared_ptr<const FileInfo> dir_fi;
     FileInfoList files_;
     bool emit_files_found;
-    // guint delay_add_files_handler;
-    // GSList* files_to_add;
+    bool detailed_;
+    bool hasErrors_;
+    size_t batchMaxFiles_;
+    int batchMaxInterval_; // in ms
+
+    static bool nativeListingEnabled_;
+    static bool localEmblemsEnabled_;
 };
 
 } // namespace Fm
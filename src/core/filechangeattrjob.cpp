@@ -1,17 +1,11 @@
 #include "filechangeattrjob.h"
 #include "totalsizejob.h"
+#include "fileinfo_p.h"
 
 #include <sys/stat.h>
 
 namespace Fm {
 
-static const char query[] =  G_FILE_ATTRIBUTE_STANDARD_TYPE","
-                             G_FILE_ATTRIBUTE_STANDARD_NAME","
-                             G_FILE_ATTRIBUTE_UNIX_GID","
-                             G_FILE_ATTRIBUTE_UNIX_UID","
-                             G_FILE_ATTRIBUTE_UNIX_MODE","
-                             G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME;
-
 FileChangeAttrJob::FileChangeAttrJob(FilePathList paths):
     paths_{std::move(paths)},
     recursive_{false},
@@ -63,7 +57,7 @@ void FileChangeAttrJob::exec() {
         }
         GErrorPtr err;
         GFileInfoPtr info{
-            g_file_query_info(path.gfile().get(), query,
+            g_file_query_info(path.gfile().get(), gFileInfoQueryAttribs(GFileInfoQuery::ChangeAttr),
                               G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                               cancellable().get(), &err),
             false
@@ -115,7 +109,7 @@ bool FileChangeAttrJob::processFile(const FilePath& path, const GFileInfoPtr& in
             retry = false;
             GErrorPtr err;
             GFileEnumeratorPtr enu{
-                g_file_enumerate_children(path.gfile().get(), query,
+                g_file_enumerate_children(path.gfile().get(), gFileInfoQueryAttribs(GFileInfoQuery::ChangeAttr),
                                             G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                                             cancellable().get(), &err),
                 false
@@ -0,0 +1,55 @@
+#include "filechangequeue.h"
+
+namespace Fm {
+
+/* NOTE: When queuing files for addition/update/deletion in the following functions,
+   the currently detected files of the folder should not be taken into account
+   because they might be changed soon due to a previous update. */
+
+bool FileChangeQueue::fileAdded(const FilePath& path) {
+    if(toDelete_.remove(path)) {
+        // if the file was going to be deleted, its addition means an update,
+        // so remove it from the deletion queue and add it to the update queue
+        toUpdate_.push_back(path);
+        return true;
+    }
+    // if the file is already queued for adding, don't duplicate
+    return toAdd_.push_back(path);
+}
+
+bool FileChangeQueue::fileChanged(const FilePath& path) {
+    if(toAdd_.contains(path)) {
+        return false;
+    }
+    return toUpdate_.push_back(path);
+}
+
+bool FileChangeQueue::fileDeleted(const FilePath& path) {
+    /* WARNING: If the file is in the addition queue, we should not remove it from that queue
+       and ignore its deletion because it may have been added by the directory list job, in
+       which case, ignoring an addition-deletion sequence would result in a nonexistent file. */
+    if(!toDelete_.push_back(path)) {
+        return false;
+    }
+    // the update queue can be cancelled for a file that is going to be deleted
+    toUpdate_.remove(path);
+    return true;
+}
+
+FilePathList FileChangeQueue::takeInfoPaths() {
+    FilePathList paths;
+    paths.reserve(toAdd_.size() + toUpdate_.size());
+    paths.insert(paths.end(), toAdd_.begin(), toAdd_.end());
+    paths.insert(paths.end(), toUpdate_.begin(), toUpdate_.end());
+    toAdd_.clear();
+    toUpdate_.clear();
+    return paths;
+}
+
+void FileChangeQueue::clear() {
+    toAdd_.clear();
+    toUpdate_.clear();
+    toDelete_.clear();
+}
+
+} // namespace Fm
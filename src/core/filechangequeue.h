@@ -0,0 +1,129 @@
+#ifndef FM2_FILECHANGEQUEUE_H
+#define FM2_FILECHANGEQUEUE_H
+
+#include "../libfmqtglobals.h"
+#include <list>
+#include <unordered_map>
+#include "filepath.h"
+
+namespace Fm {
+
+// A FIFO of unique paths with O(1) lookup, insertion and removal.
+class FilePathQueue {
+public:
+    typedef std::list<FilePath>::const_iterator const_iterator;
+
+    bool contains(const FilePath& path) const {
+        return index_.find(path) != index_.end();
+    }
+
+    // returns false if the path is already queued
+    bool push_back(const FilePath& path) {
+        if(contains(path)) {
+            return false;
+        }
+        auto it = order_.insert(order_.end(), path);
+        index_.emplace(path, it);
+        return true;
+    }
+
+    // returns false if the path is not queued
+    bool remove(const FilePath& path) {
+        auto it = index_.find(path);
+        if(it == index_.end()) {
+            return false;
+        }
+        order_.erase(it->second);
+        index_.erase(it);
+        return true;
+    }
+
+    const_iterator erase(const_iterator it) {
+        index_.erase(*it);
+        return order_.erase(it);
+    }
+
+    const_iterator begin() const {
+        return order_.cbegin();
+    }
+
+    const_iterator end() const {
+        return order_.cend();
+    }
+
+    bool empty() const {
+        return order_.empty();
+    }
+
+    size_t size() const {
+        return order_.size();
+    }
+
+    void clear() {
+        index_.clear();
+        order_.clear();
+    }
+
+private:
+    std::list<FilePath> order_;
+    std::unordered_map<FilePath, std::list<FilePath>::iterator, FilePathHash> index_;
+};
+
+
+// Pending additions, updates and deletions reported by a file monitor.
+// The paths are kept in the order reported by GIO, and the state transitions
+// between the queues (e.g., a deleted file that is created again becomes an update)
+// take constant time, so that a storm of events does not cost quadratic time.
+class FileChangeQueue {
+public:
+
+    // All of the following return true if the event resulted in a new queued change.
+
+    bool fileAdded(const FilePath& path);
+
+    bool fileChanged(const FilePath& path);
+
+    bool fileDeleted(const FilePath& path);
+
+    bool hasInfoChanges() const {
+        return !toAdd_.empty() || !toUpdate_.empty();
+    }
+
+    bool hasDeletions() const {
+        return !toDelete_.empty();
+    }
+
+    bool empty() const {
+        return !hasInfoChanges() && !hasDeletions();
+    }
+
+    // Returns the paths whose info should be (re)queried, the added ones first,
+    // and removes them from the queue.
+    FilePathList takeInfoPaths();
+
+    // Calls func() on each path queued for deletion in order and dequeues the
+    // paths for which it returns true.
+    template <typename Func>
+    void processDeletions(Func func) {
+        auto it = toDelete_.begin();
+        while(it != toDelete_.end()) {
+            if(func(*it)) {
+                it = toDelete_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    void clear();
+
+private:
+    FilePathQueue toAdd_;
+    FilePathQueue toUpdate_;
+    FilePathQueue toDelete_;
+};
+
+} // namespace Fm
+
+#endif // FM2_FILECHANGEQUEUE_H
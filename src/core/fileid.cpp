@@ -0,0 +1,47 @@
+#include "fileid.h"
+
+namespace Fm {
+
+// parses an unsigned decimal number and moves the pointer past it
+static bool parseNumber(const char*& str, uint64_t& value) {
+    if(*str < '0' || *str > '9') {
+        return false;
+    }
+    value = 0;
+    while(*str >= '0' && *str <= '9') {
+        value = value * 10 + static_cast<uint64_t>(*str - '0');
+        ++str;
+    }
+    return true;
+}
+
+FileId::FileId(const char* id): FileId{} {
+    if(!id) {
+        return;
+    }
+    // GIO uses "l<device>:<inode>" for native files and "l<device>" for their filesystems
+    if(id[0] == 'l') {
+        const char* p = id + 1;
+        uint64_t dev, ino = 0;
+        if(parseNumber(p, dev) && (*p == '\0' || (*p == ':' && parseNumber(++p, ino) && *p == '\0'))) {
+            kind_ = Native;
+            first_ = dev;
+            second_ = ino;
+            return;
+        }
+    }
+    // other backends use arbitrary strings, which are hashed with FNV-1a
+    // using two different offset bases so that collisions are practically impossible
+    uint64_t h1 = 14695981039346656037ULL;
+    uint64_t h2 = 0x6c62272e07bb0142ULL;
+    for(const unsigned char* p = reinterpret_cast<const unsigned char*>(id); *p; ++p) {
+        h1 = (h1 ^ *p) * 1099511628211ULL;
+        h2 = (h2 ^ *p) * 0x100000001b3ULL;
+        h2 ^= h2 >> 29;
+    }
+    kind_ = Hashed;
+    first_ = h1;
+    second_ = h2;
+}
+
+} // namespace Fm
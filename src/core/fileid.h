@@ -0,0 +1,79 @@
+#ifndef FM2_FILEID_H
+#define FM2_FILEID_H
+
+#include "../libfmqtglobals.h"
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace Fm {
+
+// A compact identity of a file or a filesystem, built from the id::file and id::filesystem
+// attributes of GIO. Native files are identified by their device and inode numbers, other
+// files by a 128-bit hash of the id string, so no string needs to be kept or interned.
+// A default-constructed FileId is invalid.
+class LIBFM_QT_API FileId {
+    friend class ListingCache;
+public:
+    explicit FileId(): kind_{Invalid}, first_{0}, second_{0} {
+    }
+
+    // Parses a GIO id string. A null string gives an invalid id.
+    explicit FileId(const char* id);
+
+    static FileId fromInode(dev_t dev, ino_t ino) {
+        return FileId{Native, static_cast<uint64_t>(dev), static_cast<uint64_t>(ino)};
+    }
+
+    static FileId fromDevice(dev_t dev) {
+        return FileId{Native, static_cast<uint64_t>(dev), 0};
+    }
+
+    bool isValid() const {
+        return kind_ != Invalid;
+    }
+
+    bool isNative() const {
+        return kind_ == Native;
+    }
+
+    std::size_t hash() const {
+        return static_cast<std::size_t>(first_ * 31 + second_);
+    }
+
+    bool operator==(const FileId& other) const {
+        return kind_ == other.kind_ && first_ == other.first_ && second_ == other.second_;
+    }
+
+    bool operator!=(const FileId& other) const {
+        return !operator==(other);
+    }
+
+    explicit operator bool() const {
+        return isValid();
+    }
+
+private:
+    enum Kind: uint8_t {
+        Invalid,
+        Native, // first_ is the device and second_ the inode (0 for a filesystem)
+        Hashed  // first_ and second_ are two hashes of the id string
+    };
+
+    explicit FileId(Kind kind, uint64_t first, uint64_t second): kind_{kind}, first_{first}, second_{second} {
+    }
+
+    Kind kind_;
+    uint64_t first_;
+    uint64_t second_;
+};
+
+struct FileIdHash {
+    std::size_t operator() (const FileId& id) const {
+        return id.hash();
+    }
+};
+
+} // namespace Fm
+
+#endif // FM2_FILEID_H
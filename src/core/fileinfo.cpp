@@ -1,6 +1,7 @@
 #include "fileinfo.h"
 #include "fileinfo_p.h"
 #include <gio/gio.h>
+#include <mutex>
 
 #define METADATA_TRUST "metadata::trust"
 
@@ -19,8 +20,106 @@ const char defaultGFileInfoQueryAttribs[] = "standard::*,"
                                             "mountable::can-eject,"
                                             METADATA_TRUST;
 
-FileInfo::FileInfo() {
-    // FIXME: initialize numeric data members
+static const char deleteGFileInfoQueryAttribs[] = G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                                  G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                                  G_FILE_ATTRIBUTE_STANDARD_SIZE;
+
+// NOTE: "standard::icon" is left out, so the icon of a copied file shown by the rename
+// dialog comes from its guessed MIME type; see FileInfo::setFromGFileInfo().
+static const char copyGFileInfoQueryAttribs[] = G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                                G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                                G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME","
+                                                G_FILE_ATTRIBUTE_STANDARD_SIZE","
+                                                G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE","
+                                                G_FILE_ATTRIBUTE_UNIX_MODE","
+                                                G_FILE_ATTRIBUTE_TIME_MODIFIED;
+
+static const char countGFileInfoQueryAttribs[] = G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                                 G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                                 G_FILE_ATTRIBUTE_STANDARD_IS_VIRTUAL","
+                                                 G_FILE_ATTRIBUTE_STANDARD_SIZE","
+                                                 G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE","
+                                                 G_FILE_ATTRIBUTE_ID_FILESYSTEM;
+
+static const char changeAttrGFileInfoQueryAttribs[] = G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                                      G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                                      G_FILE_ATTRIBUTE_UNIX_GID","
+                                                      G_FILE_ATTRIBUTE_UNIX_UID","
+                                                      G_FILE_ATTRIBUTE_UNIX_MODE","
+                                                      G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME;
+
+const char* gFileInfoQueryAttribs(GFileInfoQuery query) {
+    switch(query) {
+    case GFileInfoQuery::Listing:
+        return defaultGFileInfoQueryAttribs;
+    case GFileInfoQuery::FastListing:
+        return fastGFileInfoQueryAttribs;
+    case GFileInfoQuery::Delete:
+        return deleteGFileInfoQueryAttribs;
+    case GFileInfoQuery::Copy:
+        return copyGFileInfoQueryAttribs;
+    case GFileInfoQuery::Count:
+        return countGFileInfoQueryAttribs;
+    case GFileInfoQuery::ChangeAttr:
+        return changeAttrGFileInfoQueryAttribs;
+    }
+    return defaultGFileInfoQueryAttribs;
+}
+
+// NOTE: "standard::icon" is left out too because GIO sniffs the content to get it.
+const char fastGFileInfoQueryAttribs[] = "standard::type,"
+                                         "standard::name,"
+                                         "standard::display-name,"
+                                         "standard::edit-name,"
+                                         "standard::size,"
+                                         "standard::allocated-size,"
+                                         "standard::is-hidden,"
+                                         "standard::is-backup,"
+                                         "standard::is-symlink,"
+                                         "standard::symlink-target,"
+                                         "standard::target-uri,"
+                                         "standard::fast-content-type,"
+                                         "unix::*,"
+                                         "time::*,"
+                                         "access::*,"
+                                         "trash::deletion-date,"
+                                         "id::filesystem,"
+                                         "id::file,"
+                                         "metadata::emblems,"
+                                         "mountable::can-mount,"
+                                         "mountable::can-unmount,"
+                                         "mountable::can-eject,"
+                                         METADATA_TRUST;
+
+FileInfo::FileInfo():
+    size_{0},
+    allocatedSize_{0},
+    mtime_{0},
+    atime_{0},
+    ctime_{0},
+    crtime_{0},
+    dtime_{0},
+    mode_{0},
+    uid_(-1),
+    gid_(-1),
+    isShortcut_{false},
+    isMountable_{false},
+    isAccessible_{false},
+    isWritable_{false},
+    isDeletable_{false},
+    isHidden_{false},
+    isBackup_{false},
+    isNameChangeable_{false},
+    isIconChangeable_{false},
+    isHiddenChangeable_{false},
+    isReadOnly_{false},
+    isRemote_{false},
+    canMount_{false},
+    canUnmount_{false},
+    canEject_{false},
+    isTrusted_{false},
+    isTrustUnknown_{false},
+    isMimeTypeGuessed_{false} {
 }
 
 FileInfo::FileInfo(const GFileInfoPtr& inf, const FilePath& filePath, const FilePath& parentDirPath) {
@@ -31,7 +130,7 @@ FileInfo::~FileInfo() {
 }
 
 void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath& filePath, const FilePath& parentDirPath) {
-    inf_ = inf;
+    inf_.reset();
     filePath_ = filePath;
     if (filePath_ && filePath_.hasParent()) {
         dirPath_ = filePath_.parent();
@@ -46,14 +145,36 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath
     if(const char* name = g_file_info_get_name(inf.get())) {
         name_ = name;
     }
+    else {
+        name_.clear();
+    }
+
+    // don't store the full path of a native file when it can be built from its parent dir
+    if(filePath_ && dirPath_ && filePath_.isNative() && !name_.empty()) {
+        auto baseName = filePath_.baseName();
+        if(baseName && name_ == baseName.get()) {
+            filePath_ = FilePath();
+        }
+    }
 
-    dispName_ = QString::fromUtf8(g_file_info_get_display_name(inf.get()));
+    // only store the display name if it is different from the name
+    const char* dispName = g_file_info_get_display_name(inf.get());
+    dispName_ = QString();
+    if(dispName && name_ != dispName) {
+        dispName_ = QString::fromUtf8(dispName);
+    }
 
     size_ = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_STANDARD_SIZE);
+    allocatedSize_ = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE);
 
     type = g_file_info_get_file_type(inf.get());
 
     tmp = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
+    // without the real content type (see fastGFileInfoQueryAttribs), the MIME type is guessed
+    isMimeTypeGuessed_ = (tmp == nullptr);
+    if(!tmp) {
+        tmp = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+    }
     if(tmp) {
         if(size_ == 0 && type == G_FILE_TYPE_REGULAR) {
             /* Treat zero-sized files based on their extensions,
@@ -99,6 +220,9 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath
                 break;
             }
             /* if it's a special file but it doesn't have UNIX mode, compose a fake one. */
+            if(!tmp) {
+                break;
+            }
             if(strcmp(tmp, "inode/chardevice") == 0) {
                 mode_ |= S_IFCHR;
             }
@@ -249,31 +373,25 @@ _file_is_symlink:
 
     /* if there is a custom folder icon, use it */
     if(isNative() && type == G_FILE_TYPE_DIRECTORY) {
-        auto local_path = path().localPath();
-        auto dot_dir = CStrPtr{g_build_filename(local_path.get(), ".directory", nullptr)};
-        if(g_file_test(dot_dir.get(), G_FILE_TEST_IS_REGULAR)) {
-            GKeyFile* kf = g_key_file_new();
-            if(g_key_file_load_from_file(kf, dot_dir.get(), G_KEY_FILE_NONE, nullptr)) {
-                CStrPtr icon_name{g_key_file_get_string(kf, "Desktop Entry", "Icon", nullptr)};
-                if(icon_name) {
-                    // also allow relative icon paths
-                    auto dot_icon = IconInfo::fromName(g_strstr_len(icon_name.get(), -1, G_DIR_SEPARATOR_S)
-                                    ? path().relativePath(icon_name.get()).toString().get()
-                                    : icon_name.get());
-                    if(dot_icon && dot_icon->isValid()) {
-                        icon_ = dot_icon;
-                    }
-                }
-            }
-            g_key_file_free(kf);
-        }
-     }
+        loadCustomFolderIcon();
+    }
 
     if(!icon_) {
         /* try file-specific icon first */
-        gicon = g_file_info_get_icon(inf.get());
+        // NOTE: Some query profiles leave out "standard::icon" (see fastGFileInfoQueryAttribs),
+        // and GLib >= 2.76 warns about getting an attribute that was not queried.
+        gicon = g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_STANDARD_ICON)
+                ? g_file_info_get_icon(inf.get()) : nullptr;
         if(gicon) {
-            icon_ = IconInfo::fromGIcon(gicon);
+            // most files have the icon of their mime type, which is shared without
+            // going through the icon cache
+            const auto& mimeIcon = mimeType_->icon();
+            if(mimeIcon && g_icon_equal(gicon, mimeIcon->gicon().get())) {
+                icon_ = mimeIcon;
+            }
+            else {
+                icon_ = IconInfo::fromGIcon(gicon);
+            }
         }
     }
 
@@ -287,20 +405,10 @@ _file_is_symlink:
     }
 #endif
 
-    /* if the file has emblems, add them to the icon */
-    auto emblem_names = g_file_info_get_attribute_stringv(inf.get(), "metadata::emblems");
-    if(emblem_names) {
-        auto n_emblems = g_strv_length(emblem_names);
-        for(int i = n_emblems - 1; i >= 0; --i) {
-            emblems_.emplace_front(Fm::IconInfo::fromName(emblem_names[i]));
-        }
-    }
-
-    tmp = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM);
-    filesystemId_ = g_intern_string(tmp);
+    setMetadata(inf.get());
 
-    tmp = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILE);
-    fileId_ = g_intern_string(tmp);
+    filesystemId_ = FileId{g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM)};
+    fileId_ = FileId{g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILE)};
 
     mtime_ = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED);
     atime_ = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_ACCESS);
@@ -314,10 +422,9 @@ _file_is_symlink:
     }
     isHidden_ = g_file_info_get_attribute_boolean(inf.get(), G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN);
     // g_file_info_get_is_backup() does not cover ".bak" and ".old".
-    // NOTE: Here, dispName_ is not modified for desktop entries yet.
+    // NOTE: Here, the display name is not modified for desktop entries yet.
     isBackup_ = g_file_info_get_attribute_boolean (inf.get(), G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP)
-                || dispName_.endsWith(QLatin1StringView(".bak"))
-                || dispName_.endsWith(QLatin1StringView(".old"));
+                || (dispName && (g_str_has_suffix(dispName, ".bak") || g_str_has_suffix(dispName, ".old")));
     isNameChangeable_ = true; /* GVFS tends to ignore this attribute */
     isIconChangeable_ = isHiddenChangeable_ = false;
     if(g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME)) {
@@ -326,36 +433,7 @@ _file_is_symlink:
 
     // special handling for desktop entry files (show the name and icon defined in the desktop entry instead)
     if(isNative() && G_UNLIKELY(isDesktopEntry())) {
-        auto local_path = path().localPath();
-        GKeyFile* kf = g_key_file_new();
-        if(g_key_file_load_from_file(kf, local_path.get(), G_KEY_FILE_NONE, nullptr)) {
-            /* check if type is correct and supported */
-            CStrPtr type{g_key_file_get_string(kf, "Desktop Entry", "Type", nullptr)};
-            if(type) {
-                // Type == "Link"
-                if(strcmp(type.get(), G_KEY_FILE_DESKTOP_TYPE_LINK) == 0) {
-                    CStrPtr uri{g_key_file_get_string(kf, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_URL, nullptr)};
-                    if(uri) {
-                        isShortcut_ = true;
-                        target_ = uri.get();
-                    }
-                }
-            }
-            CStrPtr icon_name{g_key_file_get_string(kf, "Desktop Entry", "Icon", nullptr)};
-            if(icon_name) {
-                icon_ = IconInfo::fromName(icon_name.get());
-            }
-            /* Use title of the desktop entry for display */
-            CStrPtr displayName{g_key_file_get_locale_string(kf, "Desktop Entry", "Name", nullptr, nullptr)};
-            if(displayName) {
-                dispName_ = QString::fromUtf8(displayName.get());
-            }
-            /* handle 'Hidden' key to set hidden attribute */
-            if(!isHidden_) {
-                isHidden_ = g_key_file_get_boolean(kf, "Desktop Entry", "Hidden", nullptr);
-            }
-        }
-        g_key_file_free(kf);
+        loadDesktopEntry();
     }
 
     if(!icon_ && mimeType_)
@@ -380,6 +458,82 @@ _file_is_symlink:
 #endif
 }
 
+// sets the emblems and the trust from the metadata of the file
+void FileInfo::setMetadata(GFileInfo* inf) {
+    /* if the file has emblems, add them to the icon */
+    auto emblem_names = g_file_info_get_attribute_stringv(inf, "metadata::emblems");
+    if(emblem_names) {
+        auto n_emblems = g_strv_length(emblem_names);
+        for(int i = n_emblems - 1; i >= 0; --i) {
+            emblems_.emplace_front(Fm::IconInfo::fromName(emblem_names[i]));
+        }
+    }
+    /* to avoid GIO assertion warning: */
+    isTrusted_ = false;
+    isTrustUnknown_ = false;
+    if(g_file_info_get_attribute_type(inf, METADATA_TRUST) == G_FILE_ATTRIBUTE_TYPE_STRING) {
+        if(const auto data = g_file_info_get_attribute_string(inf, METADATA_TRUST)) {
+            isTrusted_ = (strcmp(data, "true") == 0);
+        }
+    }
+}
+
+// uses the icon of the ".directory" file in a local folder if there is one
+void FileInfo::loadCustomFolderIcon() {
+    auto local_path = path().localPath();
+    auto dot_dir = CStrPtr{g_build_filename(local_path.get(), ".directory", nullptr)};
+    if(g_file_test(dot_dir.get(), G_FILE_TEST_IS_REGULAR)) {
+        GKeyFile* kf = g_key_file_new();
+        if(g_key_file_load_from_file(kf, dot_dir.get(), G_KEY_FILE_NONE, nullptr)) {
+            CStrPtr icon_name{g_key_file_get_string(kf, "Desktop Entry", "Icon", nullptr)};
+            if(icon_name) {
+                // also allow relative icon paths
+                auto dot_icon = IconInfo::fromName(g_strstr_len(icon_name.get(), -1, G_DIR_SEPARATOR_S)
+                                ? path().relativePath(icon_name.get()).toString().get()
+                                : icon_name.get());
+                if(dot_icon && dot_icon->isValid()) {
+                    icon_ = dot_icon;
+                }
+            }
+        }
+        g_key_file_free(kf);
+    }
+}
+
+// shows the name and icon defined in a local desktop entry instead of its own
+void FileInfo::loadDesktopEntry() {
+    auto local_path = path().localPath();
+    GKeyFile* kf = g_key_file_new();
+    if(g_key_file_load_from_file(kf, local_path.get(), G_KEY_FILE_NONE, nullptr)) {
+        /* check if type is correct and supported */
+        CStrPtr type{g_key_file_get_string(kf, "Desktop Entry", "Type", nullptr)};
+        if(type) {
+            // Type == "Link"
+            if(strcmp(type.get(), G_KEY_FILE_DESKTOP_TYPE_LINK) == 0) {
+                CStrPtr uri{g_key_file_get_string(kf, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_URL, nullptr)};
+                if(uri) {
+                    isShortcut_ = true;
+                    target_ = uri.get();
+                }
+            }
+        }
+        CStrPtr icon_name{g_key_file_get_string(kf, "Desktop Entry", "Icon", nullptr)};
+        if(icon_name) {
+            icon_ = IconInfo::fromName(icon_name.get());
+        }
+        /* Use title of the desktop entry for display */
+        CStrPtr displayName{g_key_file_get_locale_string(kf, "Desktop Entry", "Name", nullptr, nullptr)};
+        if(displayName && name_ != displayName.get()) {
+            dispName_ = QString::fromUtf8(displayName.get());
+        }
+        /* handle 'Hidden' key to set hidden attribute */
+        if(!isHidden_) {
+            isHidden_ = g_key_file_get_boolean(kf, "Desktop Entry", "Hidden", nullptr);
+        }
+    }
+    g_key_file_free(kf);
+}
+
 bool FileInfo::canThumbnail() const {
     /* We cannot use S_ISREG here as this exclude all symlinks */
     if(size_ == 0 ||  /* don't generate thumbnails for empty files */
@@ -436,15 +590,29 @@ bool FileInfo::isExecutableType() const {
     return mimeType_->canBeExecutable();
 }
 
+GObjectPtr<GFileInfo> FileInfo::gFileInfo() const {
+    // FileInfo objects are shared between threads
+    std::call_once(infOnce_, [this]() {
+        // symlinks are followed like by the listing that made this object
+        inf_ = GFileInfoPtr{g_file_query_info(path().gfile().get(), defaultGFileInfoQueryAttribs,
+                                              G_FILE_QUERY_INFO_NONE, nullptr, nullptr), false};
+    });
+    return inf_;
+}
+
 bool FileInfo::isTrustable() const {
     if(isExecutableType()) {
-        /* to avoid GIO assertion warning: */
-        if(g_file_info_get_attribute_type(inf_.get(), METADATA_TRUST) == G_FILE_ATTRIBUTE_TYPE_STRING) {
-            if(const auto data = g_file_info_get_attribute_string(inf_.get(), METADATA_TRUST)) {
-                return (strcmp(data, "true") == 0);
+        if(isTrustUnknown_) {
+            GFileInfoPtr inf{g_file_query_info(path().gfile().get(), METADATA_TRUST,
+                                               G_FILE_QUERY_INFO_NONE, nullptr, nullptr), false};
+            isTrusted_ = false;
+            if(inf && g_file_info_get_attribute_type(inf.get(), METADATA_TRUST) == G_FILE_ATTRIBUTE_TYPE_STRING) {
+                const auto data = g_file_info_get_attribute_string(inf.get(), METADATA_TRUST);
+                isTrusted_ = data && strcmp(data, "true") == 0;
             }
+            isTrustUnknown_ = false;
         }
-        return false;
+        return isTrusted_;
     }
     return true;
 }
@@ -453,14 +621,14 @@ void FileInfo::setTrustable(bool trust) const {
     if(!isExecutableType()) {
         return; // METADATA_TRUST is only for executables
     }
+    isTrusted_ = trust;
+    isTrustUnknown_ = false;
     GFileInfoPtr info{g_file_info_new(), false}; // used to set only this attribute
     if(trust) {
         g_file_info_set_attribute_string(info.get(), METADATA_TRUST, "true");
-        g_file_info_set_attribute_string(inf_.get(), METADATA_TRUST, "true");
     }
     else {
         g_file_info_set_attribute(info.get(), METADATA_TRUST, G_FILE_ATTRIBUTE_TYPE_INVALID, nullptr);
-        g_file_info_set_attribute(inf_.get(), METADATA_TRUST, G_FILE_ATTRIBUTE_TYPE_INVALID, nullptr);
     }
     g_file_set_attributes_from_info(path().gfile().get(),
                                     info.get(),
@@ -472,22 +640,11 @@ void FileInfo::setEmblem(const QString& emblmeName, bool setGFileEmblem) const {
     QByteArray str;
     if(!emblmeName.isEmpty()) {
         str = emblmeName.toLocal8Bit();
-        char* stringv[] = {str.data(), nullptr};
-        g_file_info_set_attribute_stringv(inf_.get(), "metadata::emblems", stringv);
-    }
-    else {
-        g_file_info_set_attribute(inf_.get(), "metadata::emblems", G_FILE_ATTRIBUTE_TYPE_INVALID, nullptr);
     }
     // update current emblems
     emblems_.clear();
-    if(g_file_info_get_attribute_type(inf_.get(), "metadata::emblems") == G_FILE_ATTRIBUTE_TYPE_STRINGV) {
-        auto emblem_names = g_file_info_get_attribute_stringv(inf_.get(), "metadata::emblems");
-        if(emblem_names) {
-            auto n_emblems = g_strv_length(emblem_names);
-            for(int i = n_emblems - 1; i >= 0; --i) {
-                emblems_.emplace_front(Fm::IconInfo::fromName(emblem_names[i]));
-            }
-        }
+    if(!str.isEmpty()) {
+        emblems_.emplace_front(Fm::IconInfo::fromName(str.constData()));
     }
 
     if(setGFileEmblem) { // really give the emblem to GFile
@@ -34,9 +34,11 @@
 #include <utility>
 #include <string>
 #include <forward_list>
+#include <mutex>
 
 #include "gioptrs.h"
 #include "filepath.h"
+#include "fileid.h"
 #include "iconinfo.h"
 #include "mimetype.h"
 
@@ -47,6 +49,8 @@ class FileInfoList;
 typedef std::set<unsigned int> HashSet;
 
 class LIBFM_QT_API FileInfo {
+    friend class ListingCache;
+    friend class DirListJob;
 public:
 
     explicit FileInfo();
@@ -77,11 +81,11 @@ public:
         return uid_;
     }
 
-    const char* filesystemId() const {
+    const FileId& filesystemId() const {
         return filesystemId_;
     }
 
-    const char* fileId() const {
+    const FileId& fileId() const {
         return fileId_;
     }
 
@@ -147,6 +151,12 @@ public:
         return isHidden_;
     }
 
+    // Whether the MIME type is only guessed from the file name because the
+    // content type was not queried; see DirListJob::FAST.
+    bool isMimeTypeGuessed() const {
+        return isMimeTypeGuessed_;
+    }
+
     bool isUnknownType() const {
         return mimeType_->isUnknownType();
     }
@@ -201,7 +211,7 @@ public:
     }
 
     uint64_t realSize() const {
-        return blksize_ *blocks_;
+        return allocatedSize_;
     }
 
     uint64_t size() const {
@@ -212,22 +222,46 @@ public:
         return name_;
     }
 
-    const QString& displayName() const {
-        return dispName_;
+    // The display name is only stored when it differs from the name. Otherwise the
+    // name is converted on the first call and kept from then on.
+    QString displayName() const {
+        if(!dispName_.isNull()) {
+            return dispName_;
+        }
+        std::call_once(nameStringOnce_, [this]() {
+            nameString_ = QString::fromUtf8(name_.c_str(), name_.length());
+        });
+        return nameString_;
     }
 
     QString description() const {
         return QString::fromUtf8(mimeType_ ? mimeType_->desc() : "");
     }
 
+    // The full path is only stored when it cannot be derived from dirPath() and name().
     FilePath path() const {
         return filePath_ ? filePath_ : dirPath_ ? dirPath_.child(name_.c_str()) : FilePath::fromPathStr(name_.c_str());
     }
 
+    // The base name of path(). Unlike path().baseName(), it does not build a new path
+    // when the path is derived from name(), which is then returned.
+    std::string pathBaseName() const {
+        if(isPathDerived()) {
+            return name_;
+        }
+        auto baseName = path().baseName();
+        return baseName ? baseName.get() : std::string{};
+    }
+
     const FilePath& dirPath() const {
         return dirPath_;
     }
 
+    // Whether path() is dirPath().child(name()), so that it can be compared without being built.
+    bool isPathDerived() const {
+        return !filePath_ && dirPath_;
+    }
+
     void setFromGFileInfo(const GFileInfoPtr& inf, const FilePath& filePath, const FilePath& parentDirPath);
 
     const std::forward_list<std::shared_ptr<const IconInfo>>& emblems() const {
@@ -240,38 +274,52 @@ public:
 
     void setTrustable(bool trust) const;
 
-    GObjectPtr<GFileInfo> gFileInfo() const {
-        return inf_;
-    }
+    // The GFileInfo used to create this object is not kept after construction.
+    // When it is really needed, it is queried again on the first call and kept from then on.
+    // NOTE: The first call does blocking I/O, so it should not be made for many files or
+    // from the GUI thread in a loop. It is only used to get the edit name of a single file
+    // being renamed (see Fm::renameFile() and FolderView).
+    // The returned object may be null if the file cannot be queried anymore.
+    GObjectPtr<GFileInfo> gFileInfo() const;
 
 private:
-    GObjectPtr<GFileInfo> inf_;
+    void setMetadata(GFileInfo* inf);
+
+    void loadCustomFolderIcon();
+
+    void loadDesktopEntry();
+
+    // NOTE: The members are ordered by size to avoid padding.
+    mutable GObjectPtr<GFileInfo> inf_; /* only set by gFileInfo() */
     std::string name_;
-    QString dispName_;
+    QString dispName_; /* null if it is the same as name_ */
+    mutable QString nameString_; /* name_ as a QString, only set by displayName() */
 
-    FilePath filePath_;
+    FilePath filePath_; /* null if it is dirPath_.child(name_) */
     FilePath dirPath_;
 
-    mode_t mode_;
-    const char* filesystemId_;
-    const char* fileId_;
-    uid_t uid_;
-    gid_t gid_;
+    std::shared_ptr<const MimeType> mimeType_;
+    std::shared_ptr<const IconInfo> icon_;
+    mutable std::forward_list<std::shared_ptr<const IconInfo>> emblems_;
+
+    std::string target_; /* target of shortcut or mountable. */
+
+    FileId filesystemId_;
+    FileId fileId_;
     uint64_t size_;
+    uint64_t allocatedSize_;
     quint64 mtime_;
     quint64 atime_;
     quint64 ctime_;
     quint64 crtime_;
     quint64 dtime_;
 
-    uint64_t blksize_;
-    uint64_t blocks_;
-
-    std::shared_ptr<const MimeType> mimeType_;
-    std::shared_ptr<const IconInfo> icon_;
-    mutable std::forward_list<std::shared_ptr<const IconInfo>> emblems_;
+    mode_t mode_;
+    uid_t uid_;
+    gid_t gid_;
 
-    std::string target_; /* target of shortcut or mountable. */
+    mutable std::once_flag infOnce_;
+    mutable std::once_flag nameStringOnce_;
 
     bool isShortcut_ : 1; /* TRUE if file is shortcut type */
     bool isMountable_ : 1; /* TRUE if file is mountable type */
@@ -288,6 +336,9 @@ private:
     bool canMount_ : 1;  /* TRUE if can be mounted */
     bool canUnmount_ : 1; /* TRUE if can be unmounted */
     bool canEject_ : 1; /* TRUE if can be ejected */
+    mutable bool isTrusted_ : 1; /* TRUE if metadata::trust is set */
+    mutable bool isTrustUnknown_ : 1; /* TRUE if metadata::trust is not read yet */
+    bool isMimeTypeGuessed_ : 1; /* TRUE if the content type is not known */
 };
 
 
@@ -5,6 +5,27 @@ namespace Fm {
 
     extern const char defaultGFileInfoQueryAttribs[];
 
+    // Like defaultGFileInfoQueryAttribs but without the attributes that need the file
+    // content to be sniffed; the MIME type is guessed from the file name instead.
+    extern const char fastGFileInfoQueryAttribs[];
+
+    // The GIO attributes queried by the different kinds of operations. Only the listing
+    // profiles have everything that FileInfo shows; the others are for the jobs that
+    // walk whole trees and only need a few attributes of each file.
+    enum class GFileInfoQuery {
+        Listing,     // defaultGFileInfoQueryAttribs
+        FastListing, // fastGFileInfoQueryAttribs
+        Delete,      // the type and size of each file
+        // What the copy needs and the rename dialog shows. A FileInfo made from it has
+        // its name, display name, type, size, mode and modification time, and the MIME
+        // type and icon guessed from the fast content type; everything else is unset.
+        Copy,
+        Count,       // what TotalSizeJob counts
+        ChangeAttr   // the type and the attributes FileChangeAttrJob changes
+    };
+
+    const char* gFileInfoQueryAttribs(GFileInfoQuery query);
+
 } // namespace Fm
 
 #endif // FILEINFO_P_H
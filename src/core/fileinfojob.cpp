@@ -1,14 +1,29 @@
 #include "fileinfojob.h"
 #include "fileinfo_p.h"
+#include <memory>
 
 namespace Fm {
 
+// the state of the asynchronous query of a path
+struct FileInfoJob::AsyncQuery {
+    FileInfoJob* job;
+    bool done;
+    GFileInfoPtr info;
+    GErrorPtr err;
+};
+
 FileInfoJob::FileInfoJob(FilePathList paths):
     Job(),
+    maxInFlight_{1},
+    inFlight_{0},
     paths_{std::move(paths)} {
 }
 
 void FileInfoJob::exec() {
+    if(maxInFlight_ > 1 && paths_.size() > 1) {
+        execConcurrently();
+        return;
+    }
     for(const auto& path: paths_) {
         if(isCancelled()) {
             break;
@@ -20,7 +35,7 @@ void FileInfoJob::exec() {
             retry = false;
             GErrorPtr err;
             GFileInfoPtr inf{
-                g_file_query_info(path.gfile().get(), defaultGFileInfoQueryAttribs,
+                g_file_query_info(path.gfile().get(), gFileInfoQueryAttribs(GFileInfoQuery::Listing),
                                   G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
                 false
             };
@@ -39,4 +54,68 @@ void FileInfoJob::exec() {
     }
 }
 
+void FileInfoJob::queryInfoAsync(AsyncQuery* queries, size_t index) {
+    ++inFlight_;
+    g_file_query_info_async(paths_[index].gfile().get(), gFileInfoQueryAttribs(GFileInfoQuery::Listing),
+                            G_FILE_QUERY_INFO_NONE, G_PRIORITY_DEFAULT, cancellable().get(),
+                            &FileInfoJob::onQueryInfoReady, queries + index);
+}
+
+void FileInfoJob::onQueryInfoReady(GObject* source, GAsyncResult* res, gpointer user_data) {
+    auto query = static_cast<AsyncQuery*>(user_data);
+    GErrorPtr err;
+    query->info = GFileInfoPtr{g_file_query_info_finish(G_FILE(source), res, &err), false};
+    query->err = std::move(err);
+    query->done = true;
+    --query->job->inFlight_;
+}
+
+void FileInfoJob::execConcurrently() {
+    // The callbacks of the async calls are dispatched by a main context of this thread.
+    GMainContext* context = g_main_context_new();
+    g_main_context_push_thread_default(context);
+
+    const size_t n_paths = paths_.size();
+    std::unique_ptr<AsyncQuery[]> queries{new AsyncQuery[n_paths]};
+    for(size_t i = 0; i < n_paths; ++i) {
+        queries[i].job = this;
+        queries[i].done = false;
+    }
+
+    size_t next = 0; // the next path to query
+    size_t reported = 0; // the infos before this one are reported in order
+    while(reported < n_paths && !isCancelled()) {
+        while(inFlight_ < maxInFlight_ && next < n_paths) {
+            queryInfoAsync(queries.get(), next++);
+        }
+        g_main_context_iteration(context, TRUE);
+
+        // report the finished queries in the order of the paths
+        while(reported < next && queries[reported].done && !isCancelled()) {
+            auto& query = queries[reported];
+            currentPath_ = paths_[reported];
+            if(query.info) {
+                auto fileInfoPtr = std::make_shared<FileInfo>(query.info, currentPath_);
+                query.info.reset();
+                results_.push_back(fileInfoPtr);
+                Q_EMIT gotInfo(currentPath_, results_.back());
+            }
+            else if(emitError(query.err) == Job::ErrorAction::RETRY) {
+                query.done = false;
+                query.err.reset();
+                queryInfoAsync(queries.get(), reported);
+                break;
+            }
+            ++reported;
+        }
+    }
+
+    // wait for the cancelled queries to return before freeing their states
+    while(inFlight_ > 0) {
+        g_main_context_iteration(context, TRUE);
+    }
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+}
+
 } // namespace Fm
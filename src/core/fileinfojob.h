@@ -5,6 +5,7 @@
 #include "job.h"
 #include "filepath.h"
 #include "fileinfo.h"
+#include <algorithm>
 
 namespace Fm {
 
@@ -15,6 +16,17 @@ public:
 
     explicit FileInfoJob(FilePathList paths);
 
+    // Sets the maximum number of queries in flight. With more than one, the infos are
+    // queried asynchronously, which avoids paying a round trip per file on remote file
+    // systems. The infos are still reported in the order of the paths.
+    void setConcurrency(int maxInFlight) {
+        maxInFlight_ = std::max(maxInFlight, 1);
+    }
+
+    int concurrency() const {
+        return maxInFlight_;
+    }
+
     const FilePathList& paths() const {
         return paths_;
     }
@@ -34,6 +46,17 @@ protected:
     void exec() override;
 
 private:
+    struct AsyncQuery;
+
+    void execConcurrently();
+
+    void queryInfoAsync(AsyncQuery* queries, size_t index);
+
+    static void onQueryInfoReady(GObject* source, GAsyncResult* res, gpointer user_data);
+
+private:
+    int maxInFlight_;
+    int inFlight_;
     FilePathList paths_;
     FileInfoList results_;
     FilePath currentPath_;
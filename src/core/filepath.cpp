@@ -1,5 +1,9 @@
 #include "filepath.h"
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include <glib.h>
 
@@ -7,6 +11,319 @@ namespace Fm {
 
 FilePath FilePath::homeDir_;
 
+static std::atomic<bool> internPaths{false};
+
+// A node of the tree of interned paths. The nodes are looked up by their parent and name
+// in a table split into shards, each with its own lock, and removed from it by the last
+// FilePath that releases them.
+struct FilePath::Node: public Data {
+    struct Key {
+        const Node* parent;
+        std::string_view name;
+        unsigned int hash;
+
+        bool operator==(const Key& other) const {
+            return parent == other.parent && name == other.name;
+        }
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            return key.hash;
+        }
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<Key, Node*, KeyHash> nodes;
+    };
+
+    Node(Node* parent_, std::string_view name_, unsigned int hash_):
+        Data{hash_},
+        parent{parent_},
+        name{name_} {
+    }
+
+    Key key() const {
+        return Key{parent, name, static_cast<unsigned int>(hash.load(std::memory_order_relaxed))};
+    }
+
+    static Shard& shard(unsigned int hash) {
+        // NOTE: The shards are never freed since static FilePaths, like homeDir_, may
+        // release their nodes after function-local statics are destroyed.
+        static Shard* shards = new Shard[16];
+        return shards[hash % 16];
+    }
+
+    // Interned paths hash like GLocalFile, which uses g_str_hash() on the path, so the
+    // hash of a child is computed from the one of its parent.
+    static unsigned int hashString(unsigned int hash, std::string_view str) {
+        for(char c : str) {
+            hash = (hash << 5) + hash + static_cast<unsigned int>(static_cast<signed char>(c));
+        }
+        return hash;
+    }
+
+    static unsigned int childHash(const Node* parent, std::string_view name) {
+        if(!parent) {
+            return hashString(5381, name);
+        }
+        unsigned int hash = static_cast<unsigned int>(parent->hash.load(std::memory_order_relaxed));
+        if(parent->parent) {
+            hash = hashString(hash, "/");
+        }
+        return hashString(hash, name);
+    }
+
+    // Returns a new reference to the child of parent with the given name; parent is null for "/".
+    static Node* intern(Node* parent, std::string_view name) {
+        const Key key{parent, name, childHash(parent, name)};
+        auto& sh = shard(key.hash);
+        std::lock_guard<std::mutex> lock{sh.mutex};
+        auto it = sh.nodes.find(key);
+        if(it != sh.nodes.end()) {
+            // the node cannot be used if its last reference is being released
+            Node* node = it->second;
+            int count = node->refCount.load(std::memory_order_relaxed);
+            while(count > 0) {
+                if(node->refCount.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) {
+                    return node;
+                }
+            }
+            sh.nodes.erase(it);
+        }
+        if(parent) {
+            parent->ref();
+            parent->isFolder.store(true, std::memory_order_relaxed);
+        }
+        Node* node = new Node{parent, name, key.hash};
+        sh.nodes.emplace(node->key(), node);
+        return node;
+    }
+
+    // Resolves relPath against base like g_file_resolve_relative_path() does for local
+    // files, and returns a new reference. Takes the reference of base.
+    static Node* resolve(Node* base, const char* relPath) {
+        if(relPath[0] == '/') {
+            base->unref();
+            base = intern(nullptr, "/");
+        }
+        Node* node = base;
+        for(const char* p = relPath; *p;) {
+            const char* end = strchr(p, '/');
+            if(!end) {
+                end = p + strlen(p);
+            }
+            const std::string_view component{p, static_cast<std::size_t>(end - p)};
+            p = *end ? end + 1 : end;
+            if(component.empty() || component == ".") {
+                continue;
+            }
+            Node* next;
+            if(component == "..") {
+                // the parent of "/" is itself
+                next = node->parent ? node->parent : node;
+                next->ref();
+            }
+            else {
+                next = intern(node, component);
+            }
+            node->unref();
+            node = next;
+        }
+        return node;
+    }
+
+    Node* parent;  // holds a reference; null for "/"
+    std::string name;
+    // Set once another interned path is under this one. Only folders keep their
+    // local path and GFile, which all their files reuse to build theirs.
+    std::atomic<bool> isFolder{false};
+};
+
+// static
+void FilePath::releaseNode(Data* data) {
+    auto node = static_cast<Node*>(data);
+    auto key = node->key();
+    {
+        auto& sh = Node::shard(key.hash);
+        std::lock_guard<std::mutex> lock{sh.mutex};
+        auto it = sh.nodes.find(key);
+        // a new node may have replaced this one already
+        if(it != sh.nodes.end() && it->second == node) {
+            sh.nodes.erase(it);
+        }
+    }
+    Node* parent = node->parent;
+    delete node;
+    if(parent) {
+        parent->unref();
+    }
+}
+
+// static
+FilePath FilePath::fromLocalPath(const char* path) {
+    if(internPaths.load(std::memory_order_relaxed)) {
+        return fromLocalPathInterned(path);
+    }
+    return FilePath{g_file_new_for_path(path), false};
+}
+
+// static
+FilePath FilePath::fromLocalPathInterned(const char* path) {
+    // POSIX leaves the meaning of a leading "//" to the system, and GLib keeps it
+    if(!path || (path[0] == '/' && path[1] == '/' && path[2] != '/')) {
+        return FilePath{g_file_new_for_path(path), false};
+    }
+    Node* node = Node::intern(nullptr, "/");
+    if(path[0] != '/') {
+        CStrPtr cwd{g_get_current_dir()};
+        node = Node::resolve(node, cwd.get());
+    }
+    return FilePath{Node::resolve(node, path)};
+}
+
+// static
+bool FilePath::internedPathsEnabled() {
+    return internPaths.load(std::memory_order_relaxed);
+}
+
+// static
+void FilePath::setInternedPathsEnabled(bool enabled) {
+    internPaths.store(enabled, std::memory_order_relaxed);
+}
+
+FilePath FilePath::internedParent() const {
+    Node* parent = static_cast<Node*>(d_)->parent;
+    if(!parent) {
+        return FilePath{};
+    }
+    parent->ref();
+    return FilePath{static_cast<Data*>(parent)};
+}
+
+FilePath FilePath::internedRelativePath(const char* relPath) const {
+    d_->ref();
+    return FilePath{static_cast<Data*>(Node::resolve(static_cast<Node*>(d_), relPath))};
+}
+
+bool FilePath::isInternedPrefixOf(const FilePath& other) const {
+    for(const Node* node = static_cast<Node*>(other.d_)->parent; node; node = node->parent) {
+        if(node == d_) {
+            return true;
+        }
+    }
+    return false;
+}
+
+GObjectPtr<GFile> FilePath::createGFile() const {
+    const Node* node = static_cast<Node*>(d_);
+    if(node->parent && !node->isFolder.load(std::memory_order_relaxed)) {
+        return GObjectPtr<GFile>{g_file_new_for_path(internedPath().c_str()), false};
+    }
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock{mutex};
+    if(!d_->hasGFile.load(std::memory_order_relaxed)) {
+        d_->gfile = GObjectPtr<GFile>{g_file_new_for_path(localPathView().data()), false};
+        d_->hasGFile.store(true, std::memory_order_release);
+    }
+    return d_->gfile;
+}
+
+std::string FilePath::internedPath() const {
+    const Node* node = static_cast<Node*>(d_);
+    if(!node->parent) {
+        return std::string{"/"};
+    }
+    // the parent is a folder, which keeps its path
+    std::string path{internedParent().localPathView()};
+    if(node->parent->parent) {
+        path += '/';
+    }
+    path += node->name;
+    return path;
+}
+
+unsigned int FilePath::computeHash() const {
+    const unsigned int hash = g_file_hash(d_->gfile.get());
+    d_->hash.store(hash | Data::hashComputed, std::memory_order_relaxed);
+    return hash;
+}
+
+std::string_view FilePath::localPathView() const {
+    if(!d_) {
+        return std::string_view{};
+    }
+    char* path = d_->localPath.load(std::memory_order_acquire);
+    if(!path) {
+        char* newPath;
+        if(d_->interned) {
+            const Node* node = static_cast<Node*>(d_);
+            if(node->parent && !node->isFolder.load(std::memory_order_relaxed)) {
+                return std::string_view{};
+            }
+            auto str = internedPath();
+            newPath = g_strndup(str.data(), str.size());
+        }
+        else if(!g_file_is_native(d_->gfile.get())) {
+            return std::string_view{};
+        }
+        else {
+            // another thread may do the same, then one of the copies is dropped
+            newPath = g_file_get_path(d_->gfile.get());
+            if(!newPath) {
+                return std::string_view{};
+            }
+        }
+        if(d_->localPath.compare_exchange_strong(path, newPath, std::memory_order_acq_rel)) {
+            path = newPath;
+        }
+        else {
+            g_free(newPath);
+        }
+    }
+    return std::string_view{path};
+}
+
+std::string_view FilePath::baseNameView() const {
+    if(isInterned()) {
+        return static_cast<Node*>(d_)->name;
+    }
+    auto path = localPathView();
+    if(path.empty()) {
+        return path;
+    }
+    int offset = d_->baseNameOffset.load(std::memory_order_relaxed);
+    if(offset < 0) {
+        // like g_path_get_basename(), "/" is its own base name
+        auto slash = path.find_last_of('/');
+        offset = slash == std::string_view::npos || path.size() == 1 ? 0 : static_cast<int>(slash + 1);
+        d_->baseNameOffset.store(offset, std::memory_order_relaxed);
+    }
+    return path.substr(offset);
+}
+
+CStrPtr FilePath::baseName() const {
+    auto name = baseNameView();
+    if(!name.empty()) {
+        return CStrPtr{g_strndup(name.data(), name.size())};
+    }
+    return CStrPtr{g_file_get_basename(gfile().get())};
+}
+
+CStrPtr FilePath::localPath() const {
+    auto path = localPathView();
+    if(!path.empty()) {
+        return CStrPtr{g_strndup(path.data(), path.size())};
+    }
+    if(isInterned()) {
+        auto str = internedPath();
+        return CStrPtr{g_strndup(str.data(), str.size())};
+    }
+    // non-native files may have a local path too, like those of the GVfs FUSE mount
+    return CStrPtr{g_file_get_path(gfile().get())};
+}
+
 const FilePath &FilePath::homeDir() {
     if(!homeDir_) {
         const char* home = getenv("HOME");
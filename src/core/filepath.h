@@ -5,34 +5,64 @@
 #include "gobjectptr.h"
 #include "cstrptr.h"
 #include <gio/gio.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <QMetaType>
 
 namespace Fm {
 
+// A FilePath is a reference to a GFile shared by all its copies, along with the hash and,
+// for native files, the local path, which are computed once when first needed.
+// Local paths may also be interned: they are then nodes of a process-wide tree in which
+// each node only holds its base name and a reference to its parent, so that the files of
+// a folder share its path instead of each having a copy. Their GFile is only created when
+// it is needed. Interned paths are compared by identity, and parent() and child() do not
+// go through GIO. They hash like the GFile-backed paths, so both kinds can be mixed.
 class LIBFM_QT_API FilePath {
 public:
 
-    explicit FilePath() {
+    explicit FilePath(): d_{nullptr} {
     }
 
-    explicit FilePath(GFile* gfile, bool add_ref): gfile_{gfile, add_ref} {
+    explicit FilePath(GFile* gfile, bool add_ref): d_{gfile ? new Data{gfile, add_ref} : nullptr} {
     }
 
-    FilePath(const FilePath& other): FilePath{} {
-        *this = other;
+    FilePath(const FilePath& other) noexcept: d_{other.d_} {
+        if(d_) {
+            d_->ref();
+        }
+    }
+
+    FilePath(FilePath&& other) noexcept: d_{other.d_} {
+        other.d_ = nullptr;
     }
 
-    FilePath(FilePath&& other) noexcept: FilePath{} {
-        *this = other;
+    ~FilePath() {
+        if(d_) {
+            d_->unref();
+        }
     }
 
     static FilePath fromUri(const char* uri) {
         return FilePath{g_file_new_for_uri(uri), false};
     }
 
-    static FilePath fromLocalPath(const char* path) {
-        return FilePath{g_file_new_for_path(path), false};
+    // Returns an interned path if internedPathsEnabled().
+    static FilePath fromLocalPath(const char* path);
+
+    static FilePath fromLocalPathInterned(const char* path);
+
+    // Whether fromLocalPath() interns the paths; false by default.
+    static bool internedPathsEnabled();
+
+    static void setInternedPathsEnabled(bool enabled);
+
+    bool isInterned() const {
+        return d_ && d_->interned;
     }
 
     static FilePath fromDisplayName(const char* path) {
@@ -44,23 +74,32 @@ public:
     }
 
     bool isValid() const {
-        return gfile_ != nullptr;
+        return d_ != nullptr;
     }
 
     unsigned int hash() const {
-        return g_file_hash(gfile_.get());
+        if(Q_LIKELY(d_)) {
+            const std::uint64_t hash = d_->hash.load(std::memory_order_relaxed);
+            return (hash & Data::hashComputed) ? static_cast<unsigned int>(hash) : computeHash();
+        }
+        return 0;
     }
 
-    CStrPtr baseName() const {
-        return CStrPtr{g_file_get_basename(gfile_.get())};
-    }
+    CStrPtr baseName() const;
 
-    CStrPtr localPath() const {
-        return CStrPtr{g_file_get_path(gfile_.get())};
-    }
+    CStrPtr localPath() const;
+
+    // The local path of a native file, borrowed from the FilePath and valid as long as it or
+    // one of its copies exists; empty for other files. The view is null-terminated.
+    // NOTE: Interned paths only keep the paths of folders, so this is empty for the other
+    // interned files, whose paths are built by localPath() on each call.
+    std::string_view localPathView() const;
+
+    // The base name of a native file, also null-terminated; empty for non-native files.
+    std::string_view baseNameView() const;
 
     CStrPtr uri() const {
-        return CStrPtr{g_file_get_uri(gfile_.get())};
+        return CStrPtr{g_file_get_uri(gfile().get())};
     }
 
     CStrPtr toString() const {
@@ -72,73 +111,120 @@ public:
 
     // a human readable UTF-8 display name for the path
     CStrPtr displayName() const {
-        return CStrPtr{g_file_get_parse_name(gfile_.get())};
+        return CStrPtr{g_file_get_parse_name(gfile().get())};
     }
 
     FilePath parent() const {
-        return FilePath{g_file_get_parent(gfile_.get()), false};
+        if(isInterned()) {
+            return internedParent();
+        }
+        return FilePath{g_file_get_parent(gfile().get()), false};
     }
 
     bool hasParent() const {
-        return g_file_has_parent(gfile_.get(), nullptr);
+        if(isInterned()) {
+            return internedParent().isValid();
+        }
+        return g_file_has_parent(gfile().get(), nullptr);
     }
 
     bool isParentOf(const FilePath& other) const {
-        return g_file_has_parent(other.gfile_.get(), gfile_.get());
+        if(isInterned() && other.isInterned()) {
+            return other.internedParent().d_ == d_;
+        }
+        return g_file_has_parent(other.gfile().get(), gfile().get());
     }
 
     bool isPrefixOf(const FilePath& other) const {
-        return g_file_has_prefix(other.gfile_.get(), gfile_.get());
+        if(isInterned() && other.isInterned()) {
+            return isInternedPrefixOf(other);
+        }
+        return g_file_has_prefix(other.gfile().get(), gfile().get());
     }
 
     FilePath child(const char* name) const {
-        return FilePath{g_file_get_child(gfile_.get(), name), false};
+        if(isInterned()) {
+            return internedRelativePath(name);
+        }
+        return FilePath{g_file_get_child(gfile().get(), name), false};
     }
 
     CStrPtr relativePathStr(const FilePath& descendant) const {
-        return CStrPtr{g_file_get_relative_path(gfile_.get(), descendant.gfile_.get())};
+        return CStrPtr{g_file_get_relative_path(gfile().get(), descendant.gfile().get())};
     }
 
     FilePath relativePath(const char* relPath) const {
-        return FilePath{g_file_resolve_relative_path(gfile_.get(), relPath), false};
+        if(isInterned()) {
+            return internedRelativePath(relPath);
+        }
+        return FilePath{g_file_resolve_relative_path(gfile().get(), relPath), false};
     }
 
     bool isNative() const {
-        return g_file_is_native(gfile_.get());
+        return isInterned() || g_file_is_native(gfile().get());
     }
 
     bool hasUriScheme(const char* scheme) const {
-        return g_file_has_uri_scheme(gfile_.get(), scheme);
+        return g_file_has_uri_scheme(gfile().get(), scheme);
     }
 
     CStrPtr uriScheme() const {
-        return CStrPtr{g_file_get_uri_scheme(gfile_.get())};
+        return CStrPtr{g_file_get_uri_scheme(gfile().get())};
     }
 
-    const GObjectPtr<GFile>& gfile() const {
-        return gfile_;
+    // NOTE: Like their local paths, the GFiles of interned files other than folders are
+    // not kept but made anew on each call.
+    GObjectPtr<GFile> gfile() const {
+        if(Q_LIKELY(d_)) {
+            return d_->hasGFile.load(std::memory_order_acquire) ? d_->gfile : createGFile();
+        }
+        return GObjectPtr<GFile>{};
     }
 
     FilePath& operator = (const FilePath& other) {
-        gfile_ = other.gfile_;
+        FilePath copy{other};
+        std::swap(d_, copy.d_);
         return *this;
     }
 
-    FilePath& operator = (const FilePath&& other) noexcept {
-        gfile_ = std::move(other.gfile_);
+    FilePath& operator = (FilePath&& other) noexcept {
+        if(this != &other) {
+            if(d_) {
+                d_->unref();
+            }
+            d_ = other.d_;
+            other.d_ = nullptr;
+        }
         return *this;
     }
 
     bool operator == (const FilePath& other) const {
-        return operator==(other.gfile_.get());
+        if(d_ == other.d_) {
+            return true;
+        }
+        if(d_ && other.d_) {
+            // different hashes, once known, spare g_file_equal()
+            const std::uint64_t hash = d_->hash.load(std::memory_order_relaxed);
+            const std::uint64_t otherHash = other.d_->hash.load(std::memory_order_relaxed);
+            if((hash & otherHash & Data::hashComputed) && hash != otherHash) {
+                return false;
+            }
+            // each interned path has only one node
+            if(d_->interned && other.d_->interned) {
+                return false;
+            }
+        }
+        return operator==(other.gfile().get());
     }
 
     bool operator == (GFile* other_gfile) const {
-        if(gfile_ == other_gfile) {
+        const auto self = gfile();
+        GFile* self_gfile = self.get();
+        if(self_gfile == other_gfile) {
             return true;
         }
-        if(gfile_ && other_gfile) {
-            return g_file_equal(gfile_.get(), other_gfile);
+        if(self_gfile && other_gfile) {
+            return g_file_equal(self_gfile, other_gfile);
         }
         return false;
     }
@@ -148,17 +234,78 @@ public:
     }
 
     bool operator != (std::nullptr_t) const {
-        return gfile_ != nullptr;
+        return d_ != nullptr;
     }
 
     operator bool() const {
-        return gfile_ != nullptr;
+        return d_ != nullptr;
     }
 
     static const FilePath& homeDir();
 
 private:
-    GObjectPtr<GFile> gfile_;
+    struct Data {
+        static constexpr std::uint64_t hashComputed = std::uint64_t{1} << 32;
+
+        Data(GFile* file, bool add_ref): gfile{file, add_ref}, hasGFile{true}, interned{false} {
+        }
+
+        // the base of the interned nodes
+        explicit Data(unsigned int hash_): gfile{}, hasGFile{false}, interned{true} {
+            hash.store(hash_ | hashComputed, std::memory_order_relaxed);
+        }
+
+        ~Data() {
+            g_free(localPath.load(std::memory_order_relaxed));
+        }
+
+        void ref() {
+            refCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void unref() {
+            if(refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                if(interned) {
+                    releaseNode(this);
+                }
+                else {
+                    delete this;
+                }
+            }
+        }
+
+        std::atomic<int> refCount{1};
+        GObjectPtr<GFile> gfile;                // created on demand for interned folders
+        std::atomic<bool> hasGFile;
+        const bool interned;
+        std::atomic<std::uint64_t> hash{0};     // g_file_hash() | hashComputed
+        std::atomic<char*> localPath{nullptr};  // for native files only
+        std::atomic<int> baseNameOffset{-1};
+    };
+
+    // an interned path
+    struct Node;
+
+    // takes the reference of d
+    explicit FilePath(Data* d): d_{d} {
+    }
+
+    unsigned int computeHash() const;
+
+    GObjectPtr<GFile> createGFile() const;
+
+    // builds the local path of an interned path from the one of its parent
+    std::string internedPath() const;
+
+    FilePath internedParent() const;
+
+    FilePath internedRelativePath(const char* relPath) const;
+
+    bool isInternedPrefixOf(const FilePath& other) const;
+
+    static void releaseNode(Data* data);
+
+    Data* d_;
     static FilePath homeDir_;
 };
 
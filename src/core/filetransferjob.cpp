@@ -171,7 +171,7 @@ bool FileTransferJob::copyDirContent(const FilePath& srcPath, GFileInfoPtr /*src
     GErrorPtr err;
     auto enu = GFileEnumeratorPtr{
             g_file_enumerate_children(srcPath.gfile().get(),
-                                      defaultGFileInfoQueryAttribs,
+                                      gFileInfoQueryAttribs(GFileInfoQuery::Copy),
                                       G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                                       cancellable().get(), &err),
             false};
@@ -24,20 +24,35 @@
 #include "folder.h"
 #include <cstring>
 #include <cassert>
+#include <algorithm>
+#include <QCoreApplication>
+#include <QThreadPool>
 #include <QTimer>
 #include <QDebug>
 
 #include "dirlistjob.h"
 #include "filesysteminfojob.h"
 #include "fileinfojob.h"
+#include "listingcache.h"
 
 namespace Fm {
 
-std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> Folder::cache_;
-std::mutex Folder::mutex_;
+Folder::CacheShard Folder::cacheShards_[Folder::cacheShardCount_];
+Folder::ContentTypePolicy Folder::contentTypePolicy_ = Folder::TwoPhaseIfRemote;
+
+std::mutex Folder::retentionMutex_;
+std::list<std::shared_ptr<Folder>> Folder::parkedFolders_;
+size_t Folder::retentionLimit_ = 8;
+size_t Folder::retentionFileBudget_ = 100000;
+size_t Folder::parkedFiles_ = 0;
+Folder::RetentionPolicy Folder::retentionPolicy_ = Folder::LeastRecentlyUsed;
+quint64 Folder::retentionHits_ = 0;
+quint64 Folder::retentionMisses_ = 0;
+quint64 Folder::retentionEvictions_ = 0;
 
 Folder::Folder():
     dirlist_job{nullptr},
+    contentTypeJob_{nullptr},
     fsInfoJob_{nullptr},
     volumeManager_{VolumeManager::globalInstance()},
     /* for file monitor */
@@ -45,13 +60,19 @@ Folder::Folder():
     has_idle_update_handler{false},
     pending_change_notify{false},
     filesystem_info_pending{false},
-    wants_incremental{false},
+    wants_incremental{true},
     stop_emission{false}, /* don't set it 1 bit to not lock other bits */
+    reconciling_{false},
+    stale_{false},
     /* filesystem info - set in query thread, read in main */
     fs_total_size{0},
     fs_free_size{0},
     has_fs_info{false},
-    defer_content_test{false} {
+    parked_{false},
+    parkedDirty_{false},
+    parkedFileCount_{0},
+    parkedMtime_{0},
+    parkedTime_{0} {
 
     connect(volumeManager_.get(), &VolumeManager::mountAdded, this, &Folder::onMountAdded);
     connect(volumeManager_.get(), &VolumeManager::mountRemoved, this, &Folder::onMountRemoved);
@@ -62,7 +83,7 @@ Folder::Folder(const FilePath& path): Folder() {
 }
 
 Folder::~Folder() {
-    const char* folderId = nullptr;
+    FileId folderId;
     if(dirMonitor_) {
         g_signal_handlers_disconnect_by_data(dirMonitor_.get(), this);
         dirMonitor_.reset();
@@ -80,6 +101,10 @@ Folder::~Folder() {
         job->cancel();
     }
 
+    if(contentTypeJob_) {
+        contentTypeJob_->cancel();
+    }
+
     if(fsInfoJob_) {
         fsInfoJob_->cancel();
     }
@@ -87,58 +112,336 @@ Folder::~Folder() {
     // We store a weak_ptr instead of shared_ptr in the hash table, so the hash table
     // does not own a reference to the folder. When the last reference to Folder is
     // freed, we need to remove its hash table entry.
-    std::lock_guard<std::mutex> lock{mutex_};
-    auto it = cache_.find(dirPath_);
-    if(it != cache_.end()) {
-        cache_.erase(it);
-    }
-
-   // Fully recreate file monitors of folders that have the same target
-   // by reloading them. See reload() for why this workaround is needed.
-    if(folderId != nullptr) {
-        it = cache_.begin();
-        while(it != cache_.end()) {
-            auto folder = it->second.lock();
-            if(folder && folder->hasFileMonitor() && folder->isValid()
-               && folder->info()->fileId() == folderId) {
-                QTimer::singleShot(0, folder.get(), &Folder::reallyReload);
+    {
+        auto& shard = cacheShard(dirPath_);
+        std::lock_guard<std::mutex> lock{shard.mutex};
+        auto it = shard.folders.find(dirPath_);
+        // the entry may already belong to a new folder with the same path
+        if(it != shard.folders.end() && it->second.expired()) {
+            shard.folders.erase(it);
+        }
+    }
+
+    if(folderId.isValid()) {
+        reloadSameTargets(folderId);
+    }
+}
+
+// static
+// Fully recreates file monitors of folders that have the same target by reloading them.
+// See reload() for why this workaround is needed.
+void Folder::reloadSameTargets(const FileId& folderId) {
+    // NOTE: The folders are collected first because releasing the last
+    // reference to one of them while a shard is locked would deadlock.
+    std::vector<std::shared_ptr<Folder>> sameTargets;
+    for(auto& shard : cacheShards_) {
+        std::lock_guard<std::mutex> lock{shard.mutex};
+        for(const auto& item : shard.folders) {
+            if(auto folder = item.second.lock()) {
+                sameTargets.push_back(std::move(folder));
             }
-            ++it;
         }
     }
+    for(const auto& folder : sameTargets) {
+        if(folder->hasFileMonitor() && folder->isValid()
+           && folder->info()->fileId() == folderId) {
+            QTimer::singleShot(0, folder.get(), &Folder::reallyReload);
+        }
+    }
+}
+
+// static
+Folder::CacheShard& Folder::cacheShard(const FilePath& path) {
+    return cacheShards_[path.hash() % cacheShardCount_];
 }
 
 // static
 std::shared_ptr<Folder> Folder::fromPath(const FilePath& path) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    auto it = cache_.find(path);
-    if(it != cache_.end()) {
-        auto folder = it->second.lock();
-        if(folder) {
-            return folder;
+    std::shared_ptr<Folder> folder;
+    bool created = false;
+    {
+        auto& shard = cacheShard(path);
+        std::lock_guard<std::mutex> lock{shard.mutex};
+        auto it = shard.folders.find(path);
+        if(it != shard.folders.end()) {
+            folder = it->second.lock();
+            if(!folder) { // the folder is being destroyed in another thread
+                shard.folders.erase(it);
+            }
         }
-        else { // FIXME: is this possible?
-            cache_.erase(it);
+        if(!folder) {
+            // The deleter may park the folder instead of freeing it; see release().
+            folder = std::shared_ptr<Folder>{new Folder(path), &Folder::release};
+            shard.folders.emplace(path, folder);
+            created = true;
         }
     }
-    auto folder = std::make_shared<Folder>(path);
-    folder->reload();
-    cache_.emplace(path, folder);
+    if(created) {
+        // NOTE: The folder is reloaded without the shard lock because reloading
+        // locks retentionMutex_, which should never be locked after a shard.
+        folder->reload();
+        std::lock_guard<std::mutex> lock{retentionMutex_};
+        ++retentionMisses_;
+        return folder;
+    }
+
+    // take the folder out of the retention cache if it is parked
+    bool unparked = false;
+    {
+        std::lock_guard<std::mutex> lock{retentionMutex_};
+        if(folder->parked_) {
+            auto it = std::find(parkedFolders_.begin(), parkedFolders_.end(), folder);
+            if(it != parkedFolders_.end()) {
+                parkedFolders_.erase(it);
+                parkedFiles_ -= folder->parkedFileCount_;
+            }
+            folder->parked_ = false;
+            ++retentionHits_;
+            unparked = true;
+        }
+    }
+    if(unparked) {
+        folder->revalidate();
+    }
     return folder;
 }
 
 // static
 // Checks if this is the path of a folder in use.
 std::shared_ptr<Folder> Folder::findByPath(const FilePath& path) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    auto it = cache_.find(path);
-    if(it != cache_.end()) {
-        auto folder = it->second.lock();
-        if(folder) {
-            return folder;
+    std::shared_ptr<Folder> folder;
+    {
+        auto& shard = cacheShard(path);
+        std::lock_guard<std::mutex> lock{shard.mutex};
+        auto it = shard.folders.find(path);
+        if(it != shard.folders.end()) {
+            folder = it->second.lock();
         }
     }
-    return nullptr;
+    if(folder && folder->isParked()) {
+        return nullptr;
+    }
+    return folder;
+}
+
+// static
+// The deleter of the folders created by fromPath(). When the last user of a folder goes
+// away, the folder is parked in the retention cache if possible, and freed otherwise.
+void Folder::release(Folder* folder) {
+    // NOTE: The evicted folders should be released after parking this one and
+    // without any lock; this folder itself may also be evicted at once.
+    std::vector<std::shared_ptr<Folder>> evicted;
+    bool parked = false;
+    {
+        std::lock_guard<std::mutex> lock{retentionMutex_};
+        // a parked folder is only released when it is evicted
+        if(!folder->parked_ && retentionLimit_ > 0 && folder->canPark()) {
+            auto& shard = cacheShard(folder->dirPath_);
+            std::lock_guard<std::mutex> shardLock{shard.mutex};
+            auto it = shard.folders.find(folder->dirPath_);
+            // don't park the folder if a new one is already created for the same path
+            if(it != shard.folders.end() && it->second.expired()) {
+                std::shared_ptr<Folder> parkedFolder{folder, &Folder::release};
+                it->second = parkedFolder;
+                parkedFolders_.push_front(std::move(parkedFolder));
+                folder->parked_ = true;
+                folder->parkedDirty_ = false;
+                folder->parkedTime_ = g_get_monotonic_time();
+                folder->parkedFileCount_ = folder->files_.size();
+                parkedFiles_ += folder->parkedFileCount_;
+                parked = true;
+            }
+        }
+        if(parked) {
+            static bool cleanupConnected = false;
+            if(!cleanupConnected && QCoreApplication::instance()) {
+                // parked folders should not outlive the application object
+                QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, &Folder::clearRetentionCache);
+                cleanupConnected = true;
+            }
+            evictParked(evicted);
+        }
+    }
+    if(parked) {
+        folder->park();
+    }
+    else {
+        delete folder;
+    }
+}
+
+// static
+// Should be called with retentionMutex_ locked.
+void Folder::evictParked(std::vector<std::shared_ptr<Folder>>& evicted) {
+    while(!parkedFolders_.empty()
+          && (parkedFolders_.size() > retentionLimit_ || parkedFiles_ > retentionFileBudget_)) {
+        auto it = std::prev(parkedFolders_.end());
+        if(retentionPolicy_ == LargestFirst) {
+            it = std::max_element(parkedFolders_.begin(), parkedFolders_.end(),
+                                  [](const std::shared_ptr<Folder>& a, const std::shared_ptr<Folder>& b) {
+                return a->parkedFileCount_ < b->parkedFileCount_;
+            });
+        }
+        parkedFiles_ -= (*it)->parkedFileCount_;
+        evicted.push_back(std::move(*it));
+        parkedFolders_.erase(it);
+        ++retentionEvictions_;
+    }
+}
+
+bool Folder::isParked() const {
+    std::lock_guard<std::mutex> lock{retentionMutex_};
+    return parked_;
+}
+
+// Should be called with retentionMutex_ locked.
+bool Folder::canPark() const {
+    // search results cannot be revalidated without running the search again
+    return isValid() && isLoaded() && !dirPath_.hasUriScheme("search");
+}
+
+// Frees the resources that a parked folder does not need, but keeps its files.
+void Folder::park() {
+    if(dirPath_.isNative()) {
+        // If the folder was modified very recently, the file monitor may not have
+        // reported the change yet, so its modification time cannot be trusted.
+        quint64 mtime = queryModificationTime();
+        if(mtime + 2 * G_USEC_PER_SEC > static_cast<quint64>(g_get_real_time())) {
+            mtime = 0;
+        }
+        std::lock_guard<std::mutex> lock{retentionMutex_};
+        parkedMtime_ = mtime;
+    }
+    // free the inotify watch
+    if(dirMonitor_) {
+        g_signal_handlers_disconnect_by_data(dirMonitor_.get(), this);
+        dirMonitor_.reset();
+        if(dirInfo_) {
+            reloadSameTargets(dirInfo_->fileId());
+        }
+    }
+}
+
+// Called when a parked folder is reopened. Its files are shown at once either way.
+void Folder::revalidate() {
+    // NOTE: The modification time of a folder does not change when one of its files is
+    // rewritten in place, so only a folder parked very briefly is trusted without listing
+    // it again. Otherwise, the reload reconciles the kept files with a new listing.
+    const gint64 trustedParkingTime = 2 * G_USEC_PER_SEC;
+    bool upToDate = false;
+    if(dirPath_.isNative()) {
+        quint64 mtime = queryModificationTime();
+        std::lock_guard<std::mutex> lock{retentionMutex_};
+        upToDate = !parkedDirty_ && parkedMtime_ != 0 && mtime == parkedMtime_
+                   && g_get_monotonic_time() - parkedTime_ < trustedParkingTime;
+    }
+    if(upToDate) {
+        createDirMonitor();
+    }
+    else {
+        reload(); // creates a new monitor and reconciles the files
+    }
+}
+
+quint64 Folder::queryModificationTime() const {
+    GFileInfoPtr inf{g_file_query_info(dirPath_.gfile().get(),
+                                       G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                       G_FILE_QUERY_INFO_NONE, nullptr, nullptr), false};
+    if(!inf) {
+        return 0;
+    }
+    return g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+           + g_file_info_get_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+// static
+size_t Folder::retentionLimit() {
+    std::lock_guard<std::mutex> lock{retentionMutex_};
+    return retentionLimit_;
+}
+
+// static
+void Folder::setRetentionLimit(size_t folders) {
+    std::vector<std::shared_ptr<Folder>> evicted;
+    std::lock_guard<std::mutex> lock{retentionMutex_};
+    retentionLimit_ = folders;
+    evictParked(evicted);
+}
+
+// static
+size_t Folder::retentionFileBudget() {
+    std::lock_guard<std::mutex> lock{retentionMutex_};
+    return retentionFileBudget_;
+}
+
+// static
+void Folder::setRetentionFileBudget(size_t files) {
+    std::vector<std::shared_ptr<Folder>> evicted;
+    std::lock_guard<std::mutex> lock{retentionMutex_};
+    retentionFileBudget_ = files;
+    evictParked(evicted);
+}
+
+// static
+Folder::RetentionPolicy Folder::retentionPolicy() {
+    std::lock_guard<std::mutex> lock{retentionMutex_};
+    return retentionPolicy_;
+}
+
+// static
+void Folder::setRetentionPolicy(RetentionPolicy policy) {
+    std::lock_guard<std::mutex> lock{retentionMutex_};
+    retentionPolicy_ = policy;
+}
+
+// static
+Folder::RetentionStats Folder::retentionStats() {
+    std::lock_guard<std::mutex> lock{retentionMutex_};
+    return RetentionStats{retentionHits_, retentionMisses_, retentionEvictions_, parkedFolders_.size(), parkedFiles_};
+}
+
+// static
+void Folder::clearRetentionCache() {
+    std::list<std::shared_ptr<Folder>> evicted;
+    std::lock_guard<std::mutex> lock{retentionMutex_};
+    evicted.swap(parkedFolders_);
+    retentionEvictions_ += evicted.size();
+    parkedFiles_ = 0;
+}
+
+// static
+bool Folder::listingCacheEnabled() {
+    return ListingCache::isEnabled();
+}
+
+// static
+void Folder::setListingCacheEnabled(bool enabled) {
+    ListingCache::setEnabled(enabled);
+}
+
+// static
+bool Folder::listingCacheIncludesNativeFolders() {
+    return ListingCache::includesNativeFolders();
+}
+
+// static
+void Folder::setListingCacheIncludesNativeFolders(bool include) {
+    ListingCache::setIncludeNativeFolders(include);
+}
+
+// static
+quint64 Folder::listingCacheMaxSize() {
+    return ListingCache::maxSize();
+}
+
+// static
+void Folder::setListingCacheMaxSize(quint64 bytes) {
+    ListingCache::setMaxSize(bytes);
+}
+
+// static
+void Folder::clearListingCache() {
+    ListingCache::clear();
 }
 
 bool Folder::makeDirectory(const char* /*name*/, GError** /*error*/) {
@@ -151,6 +454,10 @@ bool Folder::isIncremental() const {
     return wants_incremental;
 }
 
+void Folder::setIncremental(bool incremental) {
+    wants_incremental = incremental;
+}
+
 bool Folder::isValid() const {
     return dirInfo_ != nullptr;
 }
@@ -159,7 +466,13 @@ bool Folder::isLoaded() const {
     return (dirlist_job == nullptr);
 }
 
+bool Folder::isStale() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return stale_;
+}
+
 std::shared_ptr<const FileInfo> Folder::fileByName(const char* name) const {
+    std::lock_guard<std::mutex> lock{mutex_};
     auto it = files_.find(name);
     if(it != files_.end()) {
         return it->second;
@@ -168,6 +481,7 @@ std::shared_ptr<const FileInfo> Folder::fileByName(const char* name) const {
 }
 
 bool Folder::isEmpty() const {
+    std::lock_guard<std::mutex> lock{mutex_};
     return files_.empty();
 }
 
@@ -176,6 +490,7 @@ bool Folder::hasFileMonitor() const {
 }
 
 FileInfoList Folder::files() const {
+    std::lock_guard<std::mutex> lock{mutex_};
     FileInfoList ret;
     ret.reserve(files_.size());
     for(const auto& item : files_) {
@@ -196,6 +511,90 @@ const std::shared_ptr<const FileInfo>& Folder::info() const {
     return dirInfo_;
 }
 
+void Folder::setPriorityFiles(const FileInfoList& files) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    priorityFiles_.clear();
+    for(const auto& file : files) {
+        priorityFiles_.insert(file->pathBaseName());
+    }
+}
+
+// static
+Folder::ContentTypePolicy Folder::contentTypePolicy() {
+    return contentTypePolicy_;
+}
+
+// static
+void Folder::setContentTypePolicy(ContentTypePolicy policy) {
+    contentTypePolicy_ = policy;
+}
+
+// The second phase of two-phase loading: queries the real content types of a batch of
+// files whose MIME types are guessed, the priority ones first.
+void Folder::refineContentTypes() {
+    if(contentTypeJob_) {
+        return;
+    }
+    const size_t batchSize = 64;
+    FilePathList paths;
+    std::unique_lock<std::mutex> lock{mutex_};
+    for(const auto& name : priorityFiles_) {
+        if(paths.size() >= batchSize) {
+            break;
+        }
+        auto it = guessedFiles_.find(name);
+        if(it != guessedFiles_.end()) {
+            paths.push_back(dirPath_.child(name.c_str()));
+            guessedFiles_.erase(it);
+        }
+    }
+    for(auto it = guessedFiles_.begin(); it != guessedFiles_.end() && paths.size() < batchSize;) {
+        paths.push_back(dirPath_.child(it->c_str()));
+        it = guessedFiles_.erase(it);
+    }
+    lock.unlock();
+    if(paths.empty()) {
+        return;
+    }
+
+    contentTypeJob_ = new FileInfoJob{std::move(paths)};
+    contentTypeJob_->setConcurrency(16);
+    contentTypeJob_->setAutoDelete(true);
+    connect(contentTypeJob_, &FileInfoJob::finished, this, &Folder::onContentTypesRefined, Qt::BlockingQueuedConnection);
+    contentTypeJob_->runAsync(QThread::LowPriority);
+}
+
+void Folder::onContentTypesRefined() {
+    FileInfoJob* job = static_cast<FileInfoJob*>(sender());
+    if(job != contentTypeJob_) { // cancelled by a reload
+        return;
+    }
+    contentTypeJob_ = nullptr;
+    if(job->isCancelled()) {
+        return;
+    }
+
+    std::vector<FileInfoPair> files_to_update;
+    std::unique_lock<std::mutex> lock{mutex_};
+    for(const auto& info : job->files()) {
+        auto it = files_.find(info->pathBaseName());
+        // the file may have been changed by the file monitor in the meantime
+        if(it == files_.end() || !it->second->isMimeTypeGuessed() || info->isMimeTypeGuessed()) {
+            continue;
+        }
+        if(it->second->mimeType() == info->mimeType() && it->second->icon() == info->icon()) {
+            continue; // the guess was right
+        }
+        files_to_update.push_back(std::make_pair(it->second, info));
+        it->second = info;
+    }
+    lock.unlock();
+    if(!files_to_update.empty()) {
+        Q_EMIT filesChanged(files_to_update);
+    }
+    refineContentTypes();
+}
+
 #if 0
 void Folder::init(FmFolder* folder) {
     files = fm_file_info_list_new();
@@ -222,6 +621,11 @@ void Folder::onIdleReload() {
 }
 
 void Folder::queueReload() {
+    if(isParked()) {
+        std::lock_guard<std::mutex> lock{retentionMutex_};
+        parkedDirty_ = true;
+        return;
+    }
     // G_LOCK(query);
     if(!has_idle_reload_handler) {
         has_idle_reload_handler = true;
@@ -239,6 +643,7 @@ void Folder::onFileInfoFinished() {
        pending changes are processed only after the current info job is finished. */
 
     if(job->isCancelled()) {
+        std::lock_guard<std::mutex> lock{mutex_};
         has_idle_update_handler = false; // allow future updates
         return;
     }
@@ -251,6 +656,7 @@ void Folder::onFileInfoFinished() {
     const auto& infos = job->files();
     auto path_it = paths.cbegin();
     auto info_it = infos.cbegin();
+    std::unique_lock<std::mutex> lock{mutex_};
     for(; path_it != paths.cend() && info_it != infos.cend(); ++path_it, ++info_it) {
         const auto& path = *path_it;
         const auto& info = *info_it;
@@ -259,16 +665,17 @@ void Folder::onFileInfoFinished() {
             dirInfo_ = info;
         }
         else {
-            auto it = files_.find(info->path().baseName().get());
+            auto it = files_.find(info->pathBaseName());
             if(it != files_.end()) { // the file already exists, update
                 files_to_update.push_back(std::make_pair(it->second, info));
             }
             else { // newly added
                 files_to_add.push_back(info);
             }
-            files_[info->path().baseName().get()] = info;
+            files_[info->pathBaseName()] = info;
         }
     }
+    lock.unlock();
     if(!files_to_add.empty()) {
         Q_EMIT filesAdded(files_to_add);
     }
@@ -278,8 +685,9 @@ void Folder::onFileInfoFinished() {
     Q_EMIT contentChanged();
 
     // process the changes accumulated during this info job
+    lock.lock();
     if(filesystem_info_pending // means a pending change; see "onFileSystemInfoFinished()"
-       || !paths_to_update.empty() || !paths_to_add.empty() || !paths_to_del.empty()) {
+       || !pendingChanges_.empty()) {
         QTimer::singleShot(0, this, &Folder::processPendingChanges);
     }
     // there's no pending change at the moment; let the next one be processed
@@ -290,7 +698,7 @@ void Folder::onFileInfoFinished() {
 
 void Folder::processPendingChanges() {
     // FmFileInfoJob* job = nullptr;
-    std::lock_guard<std::mutex> lock{mutex_};
+    std::unique_lock<std::mutex> lock{mutex_};
 
     // idle_handler = 0;
     /* if we were asked to block updates let delay it for now */
@@ -300,13 +708,10 @@ void Folder::processPendingChanges() {
     }
 
     FileInfoJob* info_job = nullptr;
-    if(!paths_to_update.empty() || !paths_to_add.empty()) {
-        FilePathList paths;
-        paths.insert(paths.end(), paths_to_add.cbegin(), paths_to_add.cend());
-        paths.insert(paths.end(), paths_to_update.cbegin(), paths_to_update.cend());
-        info_job = new FileInfoJob{paths};
-        paths_to_update.clear();
-        paths_to_add.clear();
+    if(pendingChanges_.hasInfoChanges()) {
+        info_job = new FileInfoJob{pendingChanges_.takeInfoPaths()};
+        // don't wait for a round trip per file on slow (remote) file systems
+        info_job->setConcurrency(16);
     }
     else {
         // let the next pending changes be processed; see "onFileInfoFinished()"
@@ -330,41 +735,41 @@ void Folder::processPendingChanges() {
 
     // process deletion
     FileInfoList deleted_files;
-    auto path_it = paths_to_del.begin();
-    while(path_it != paths_to_del.end()) {
-        const auto& path = *path_it;
+    pendingChanges_.processDeletions([&](const FilePath& path) {
         auto name = path.baseName();
         auto it = files_.find(name.get());
         if(it != files_.end()) {
             deleted_files.push_back(it->second);
             files_.erase(it);
-            path_it = paths_to_del.erase(path_it);
+            return true;
         }
-        else {
-            ++path_it;
-        }
-    }
+        return false;
+    });
+    bool change_notify = pending_change_notify;
+    pending_change_notify = false;
+    bool filesystem_changed = filesystem_info_pending;
+    filesystem_info_pending = false;
+    lock.unlock();
+
     if(!deleted_files.empty()) {
         Q_EMIT filesRemoved(deleted_files);
         Q_EMIT contentChanged();
     }
 
-    if(pending_change_notify) {
+    if(change_notify) {
         Q_EMIT changed();
         /* update volume info */
         queryFilesystemInfo();
-        pending_change_notify = false;
     }
 
-    if(filesystem_info_pending) {
+    if(filesystem_changed) {
         Q_EMIT fileSystemChanged();
-        filesystem_info_pending = false;
     }
 }
 
-/* should be called only with G_LOCK(lists) on! */
+// should be called with the lock held
 void Folder::queueUpdate() {
-    // qDebug() << "queue_update:" << !has_idle_handler << paths_to_add.size() << paths_to_update.size() << paths_to_del.size();
+    // qDebug() << "queue_update:" << !has_idle_update_handler << pendingChanges_.empty();
     if(!has_idle_update_handler) {
         QTimer::singleShot(0, this, &Folder::processPendingChanges);
         has_idle_update_handler = true;
@@ -372,75 +777,6 @@ void Folder::queueUpdate() {
 }
 
 
-/* NOTE: When queuing files for addition/update/deletion in the following functions,
-   the currently detected files (namely, "files_") should not be taken into account
-   because they might be changed soon due to a previous call to queueUpdate(). */
-
-/* returns true if reference was taken from path */
-bool Folder::eventFileAdded(const FilePath &path) {
-    bool added = true;
-    // G_LOCK(lists);
-    if(std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) != paths_to_del.cend()) {
-        // if the file was going to be deleted, its addition means an update,
-        // so remove it from the deletion queue and add it to the update queue
-        paths_to_del.erase(std::remove(paths_to_del.begin(), paths_to_del.end(), path), paths_to_del.cend());
-        if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()) {
-            paths_to_update.push_back(path);
-        }
-    }
-    else if(std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
-        paths_to_add.push_back(path);
-    }
-    else { // file already queued for adding, don't duplicate
-        added = false;
-    }
-
-    if(added) {
-        queueUpdate();
-    }
-    // G_UNLOCK(lists);
-    return added;
-}
-
-bool Folder::eventFileChanged(const FilePath &path) {
-    bool added;
-    // G_LOCK(lists);
-    if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()
-       && std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
-        paths_to_update.push_back(path);
-        added = true;
-        queueUpdate();
-    }
-    else {
-        added = false;
-    }
-    // G_UNLOCK(lists);
-    return added;
-}
-
-void Folder::eventFileDeleted(const FilePath& path) {
-    bool deleted = true;
-    // qDebug() << "delete " << path.baseName().get();
-    // G_LOCK(lists);
-    /* WARNING: If the file is in the addition queue, we should not remove it from that queue
-       and ignore its deletion because it may have been added by the directory list job, in
-       which case, ignoring an addition-deletion sequence would result in a nonexistent file. */
-    if(std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) == paths_to_del.cend()) {
-        paths_to_del.push_back(path);
-        // the update queue can be cancelled for a file that is going to be deleted
-        paths_to_update.erase(std::remove(paths_to_update.begin(), paths_to_update.end(), path), paths_to_update.cend());
-    }
-    else {
-        deleted = false;
-    }
-
-    if(deleted) {
-        queueUpdate();
-    }
-    // G_UNLOCK(lists);
-}
-
-
 void Folder::onDirChanged(GFileMonitorEvent evt) {
     switch(evt) {
     case G_FILE_MONITOR_EVENT_PRE_UNMOUNT:
@@ -462,8 +798,7 @@ void Folder::onDirChanged(GFileMonitorEvent evt) {
     case G_FILE_MONITOR_EVENT_CHANGED: {
         std::lock_guard<std::mutex> lock{mutex_};
         pending_change_notify = true;
-        if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), dirPath_) != paths_to_update.cend()) {
-            paths_to_update.push_back(dirPath_);
+        if(pendingChanges_.fileChanged(dirPath_)) {
             queueUpdate();
         }
         /* g_debug("folder is changed"); */
@@ -499,59 +834,88 @@ void Folder::onFileChangeEvents(GFileMonitor* /*monitor*/, GFile* gf, GFile* /*o
         /* NOTE: sometimes, for unknown reasons, GFileMonitor gives us the
          * same event of the same file for multiple times. So we need to
          * check for duplications ourselves here. */
+        bool queued = false;
         switch(evt) {
         case G_FILE_MONITOR_EVENT_CREATED:
-            eventFileAdded(path);
+            queued = pendingChanges_.fileAdded(path);
             break;
         case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
         case G_FILE_MONITOR_EVENT_CHANGED:
-            eventFileChanged(path);
+            queued = pendingChanges_.fileChanged(path);
             break;
         case G_FILE_MONITOR_EVENT_DELETED:
-            eventFileDeleted(path);
+            queued = pendingChanges_.fileDeleted(path);
             break;
         default:
             break;
         }
+        if(queued) {
+            queueUpdate();
+        }
     }
 }
 
-void Folder::onDirListFinished() {
-    DirListJob* job = static_cast<DirListJob*>(sender());
-    if(job->isCancelled()) { // this is a cancelled job, ignore!
-        if(job == dirlist_job) {
-            dirlist_job = nullptr;
-            Q_EMIT finishLoading(); // this was the last job until now
-        }
-        return;
-    }
-    dirInfo_ = job->dirInfo();
+// Checks whether a listed file differs from the known one in anything shown to the user.
+// A guessed MIME type of an unchanged file is not a difference because the known type may
+// have been found by sniffing its content.
+static bool isSameFileInfo(const FileInfo& a, const FileInfo& b) {
+    const bool sameType = (b.isMimeTypeGuessed() && !a.isMimeTypeGuessed())
+                          || (a.mimeType() == b.mimeType() && a.icon() == b.icon());
+    return a.fileId() == b.fileId()
+           && a.mtime() == b.mtime()
+           && a.ctime() == b.ctime()
+           && a.size() == b.size()
+           && a.mode() == b.mode()
+           && a.uid() == b.uid()
+           && a.gid() == b.gid()
+           && sameType
+           && a.emblems() == b.emblems()
+           && a.target() == b.target()
+           && a.isHidden() == b.isHidden()
+           && a.isAccessible() == b.isAccessible()
+           && a.isWritable() == b.isWritable()
+           && a.isDeletable() == b.isDeletable()
+           && a.name() == b.name()
+           && a.displayName() == b.displayName();
+}
 
+// Adds the files found by the dir list job to files_, or updates them if they already
+// exist (e.g., added by the file monitor during listing or by a reconciling reload).
+void Folder::mergeListedFiles(const FileInfoList& infos) {
     FileInfoList files_to_add;
     std::vector<FileInfoPair> files_to_update;
-    const auto& infos = job->files();
 
+    std::unique_lock<std::mutex> lock{mutex_};
     // with "search://", there is no update for infos and all of them should be added
     if(dirPath_.hasUriScheme("search")) {
         files_to_add = infos;
         for(auto& file: files_to_add) {
-            files_[file->path().baseName().get()] = file;
+            files_[file->pathBaseName()] = file;
         }
     }
     else {
         auto info_it = infos.cbegin();
         for(; info_it != infos.cend(); ++info_it) {
             const auto& info = *info_it;
-            auto it = files_.find(info->path().baseName().get());
+            std::string name = info->pathBaseName();
+            auto it = files_.find(name);
             if(it != files_.end()) {
+                if(reconciling_) {
+                    unlistedFiles_.erase(name);
+                }
+                if(isSameFileInfo(*it->second, *info)) {
+                    continue; // keep the old info and the state attached to it
+                }
                 files_to_update.push_back(std::make_pair(it->second, info));
+                it->second = info;
             }
             else {
                 files_to_add.push_back(info);
+                files_.emplace(std::move(name), info);
             }
-            files_[info->path().baseName().get()] = info;
         }
     }
+    lock.unlock();
 
     if(!files_to_add.empty()) {
         Q_EMIT filesAdded(files_to_add);
@@ -559,6 +923,87 @@ void Folder::onDirListFinished() {
     if(!files_to_update.empty()) {
         Q_EMIT filesChanged(files_to_update);
     }
+}
+
+void Folder::onDirListFilesFound(FileInfoList& files) {
+    DirListJob* job = static_cast<DirListJob*>(sender());
+    if(job != dirlist_job || job->isCancelled()) { // an old or cancelled job, ignore!
+        return;
+    }
+    /* we may want info while folder is still loading */
+    if(!dirInfo_) {
+        dirInfo_ = job->dirInfo();
+    }
+    mergeListedFiles(files);
+}
+
+void Folder::onDirListFinished() {
+    DirListJob* job = static_cast<DirListJob*>(sender());
+    if(job->isCancelled()) { // this is a cancelled job, ignore!
+        if(job == dirlist_job) {
+            dirlist_job = nullptr;
+            // keep the files of an unfinished reconciling reload as they are
+            std::unique_lock<std::mutex> lock{mutex_};
+            reconciling_ = false;
+            unlistedFiles_.clear();
+            lock.unlock();
+            Q_EMIT finishLoading(); // this was the last job until now
+        }
+        return;
+    }
+    dirInfo_ = job->dirInfo();
+
+    // in the incremental mode, the files are already merged in onDirListFilesFound()
+    mergeListedFiles(job->files());
+
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stale_ = false;
+        // the MIME types of regular files are only guessed with two-phase loading
+        if(!job->isDetailed()) {
+            for(const auto& item : files_) {
+                const auto& info = item.second;
+                if(info->isMimeTypeGuessed() && S_ISREG(info->mode()) && info->size() > 0) {
+                    guessedFiles_.insert(item.first);
+                }
+            }
+        }
+    }
+
+    // the files that are not listed anymore are removed after a reconciling reload
+    FileInfoList removed_files;
+    std::unique_lock<std::mutex> lock{mutex_};
+    if(reconciling_) {
+        for(const auto& name : unlistedFiles_) {
+            auto it = files_.find(name);
+            if(it != files_.end()) {
+                removed_files.push_back(it->second);
+                files_.erase(it);
+            }
+        }
+        unlistedFiles_.clear();
+        reconciling_ = false;
+    }
+    lock.unlock();
+    if(!removed_files.empty()) {
+        Q_EMIT filesRemoved(removed_files);
+        Q_EMIT contentChanged();
+    }
+
+    refineContentTypes();
+
+    // NOTE: A listing with errors may be incomplete, so it is not saved and the old one is kept.
+    if(!job->hasErrors() && ListingCache::isCacheable(dirPath_)) {
+        auto snapshot = files();
+        QThreadPool::globalInstance()->start([path = dirPath_, snapshot = std::move(snapshot)]() {
+            if(snapshot.empty()) { // an emptied folder should not show its old files
+                ListingCache::remove(path);
+            }
+            else {
+                ListingCache::save(path, snapshot);
+            }
+        });
+    }
 
 #if 0
     if(dirlist_job->isCancelled() && !wants_incremental) {
@@ -622,21 +1067,6 @@ void Folder::onDirListFinished() {
 #if 0
 
 
-void on_dirlist_job_files_found(FmDirListJob* job, GSList* files, gpointer user_data) {
-    FmFolder* folder = FM_FOLDER(user_data);
-    GSList* l;
-    for(l = files; l; l = l->next) {
-        FmFileInfo* file = FM_FILE_INFO(l->data);
-        fm_file_info_list_push_tail(files, file);
-    }
-    if(G_UNLIKELY(!dir_fi && job->dir_fi))
-        /* we may want info while folder is still loading */
-    {
-        dir_fi = fm_file_info_ref(job->dir_fi);
-    }
-    g_signal_emit(folder, signals[FILES_ADDED], 0, files);
-}
-
 ErrorAction on_dirlist_job_error(FmDirListJob* job, GError* err, FmJobErrorSeverity severity, FmFolder* folder) {
     guint ret;
     /* it's possible that some signal handlers tries to free the folder
@@ -682,24 +1112,32 @@ void Folder::reload() {
 }
 
 void Folder::reallyReload() {
+    // a parked folder is reloaded when it is reopened
+    if(isParked()) {
+        std::lock_guard<std::mutex> lock{retentionMutex_};
+        parkedDirty_ = true;
+        return;
+    }
     // cancel in-progress jobs if there are any
     if(dirlist_job) {
         dirlist_job->cancel();
     }
-    GError* err = nullptr;
+    if(contentTypeJob_) {
+        contentTypeJob_->cancel();
+        contentTypeJob_ = nullptr;
+    }
     // cancel directory monitoring
     if(dirMonitor_) {
         g_signal_handlers_disconnect_by_data(dirMonitor_.get(), this);
         dirMonitor_.reset();
     }
 
+    std::unique_lock<std::mutex> lock{mutex_};
     /* clear all update-lists now, see SF bug #919 - if update comes before
        listing job is finished, a duplicate may be created in the folder */
     if(has_idle_update_handler) {
         // FIXME: cancel the idle handler
-        paths_to_add.clear();
-        paths_to_update.clear();
-        paths_to_del.clear();
+        pendingChanges_.clear();
 
         // cancel any file info job in progress.
         for(auto job: fileinfoJobs_) {
@@ -712,63 +1150,113 @@ void Folder::reallyReload() {
         has_idle_update_handler = false;
     }
 
-    /* remove all existing files */
-    if(!files_.empty()) {
-        // FIXME: this is not very efficient :(
-        auto tmp = files();
-        files_.clear();
-        Q_EMIT filesRemoved(tmp);
+    // If there are files, reconcile them with the new listing instead of removing
+    // them all; see mergeListedFiles() and onDirListFinished().
+    // NOTE: "search://" results have no identity to reconcile.
+    reconciling_ = !files_.empty() && !dirPath_.hasUriScheme("search");
+    unlistedFiles_.clear();
+    guessedFiles_.clear();
+    if(reconciling_) {
+        unlistedFiles_.reserve(files_.size());
+        for(const auto& item : files_) {
+            unlistedFiles_.insert(item.first);
+        }
+        lock.unlock();
     }
+    else {
+        lock.unlock();
 
-    /* Tell the world that we're about to reload the folder.
-     * It might be a good idea for users of the folder to disconnect
-     * from the folder temporarily and reconnect to it again after
-     * the folder complete the loading. This might reduce some
-     * unnecessary signal handling and UI updates. */
-    Q_EMIT startLoading();
+        /* Tell the world that we're about to reload the folder.
+         * It might be a good idea for users of the folder to disconnect
+         * from the folder temporarily and reconnect to it again after
+         * the folder complete the loading. This might reduce some
+         * unnecessary signal handling and UI updates. */
+        Q_EMIT startLoading();
 
-    dirInfo_.reset(); // clear dir info
+        dirInfo_.reset(); // clear dir info
+    }
 
     /* also re-create a new file monitor */
-    // mon = GFileMonitorPtr{fm_monitor_directory(dir_path.gfile().get(), &err), false};
-    // FIXME: should we make this cancellable?
-    dirMonitor_ = GFileMonitorPtr{
-            g_file_monitor_directory(dirPath_.gfile().get(), G_FILE_MONITOR_WATCH_MOUNTS, nullptr, &err),
-            false
-    };
-
-    if(dirMonitor_) {
-        g_signal_connect(dirMonitor_.get(), "changed", G_CALLBACK(_onFileChangeEvents), this);
-    }
-    else {
-        qDebug("file monitor cannot be created: %s", err->message);
-        g_error_free(err);
-    }
+    createDirMonitor();
 
     Q_EMIT contentChanged();
 
     /* run a new dir listing job */
-    // FIXME:
-    // defer_content_test = fm_config->defer_content_test;
-    dirlist_job = new DirListJob(dirPath_, defer_content_test ? DirListJob::FAST : DirListJob::DETAILED);
+    int flags = DirListJob::DETAILED;
+    if(contentTypePolicy_ == TwoPhaseAlways) {
+        flags = DirListJob::FAST;
+    }
+    else if(contentTypePolicy_ == TwoPhaseIfRemote) {
+        flags |= DirListJob::FAST_IF_REMOTE;
+    }
+    dirlist_job = new DirListJob(dirPath_, static_cast<DirListJob::Flags>(flags));
     dirlist_job->setAutoDelete(true);
     connect(dirlist_job, &DirListJob::error, this, &Folder::error, Qt::BlockingQueuedConnection);
     connect(dirlist_job, &DirListJob::finished, this, &Folder::onDirListFinished, Qt::BlockingQueuedConnection);
-
-#if 0
     if(wants_incremental) {
-        g_signal_connect(dirlist_job, "files-found", G_CALLBACK(on_dirlist_job_files_found), folder);
+        dirlist_job->setIncremental(true);
+        connect(dirlist_job, &DirListJob::filesFound, this, &Folder::onDirListFilesFound, Qt::BlockingQueuedConnection);
     }
-    fm_dir_list_job_set_incremental(dirlist_job, wants_incremental);
-#endif
 
     dirlist_job->runAsync();
 
+    // show the cached listing, if any, while the folder is being listed
+    if(!reconciling_ && ListingCache::isCacheable(dirPath_)) {
+        QTimer::singleShot(0, this, &Folder::loadCachedListing);
+    }
+
     /* also reload filesystem info.
      * FIXME: is this needed? */
     queryFilesystemInfo();
 }
 
+// Shows a stale snapshot of the folder from the persistent listing cache. The running dir
+// list job then revalidates it like a reconciling reload; see mergeListedFiles().
+void Folder::loadCachedListing() {
+    if(!dirlist_job) { // already listed
+        return;
+    }
+    auto cached = ListingCache::load(dirPath_);
+    if(cached.empty()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock{mutex_};
+    if(!files_.empty()) { // the listing has already found some files
+        return;
+    }
+    files_.reserve(cached.size());
+    unlistedFiles_.reserve(cached.size());
+    for(const auto& info : cached) {
+        std::string name = info->pathBaseName();
+        unlistedFiles_.insert(name);
+        files_.emplace(std::move(name), info);
+    }
+    reconciling_ = true;
+    stale_ = true;
+    lock.unlock();
+
+    Q_EMIT filesAdded(cached);
+    Q_EMIT contentChanged();
+}
+
+void Folder::createDirMonitor() {
+    GError* err = nullptr;
+    // mon = GFileMonitorPtr{fm_monitor_directory(dir_path.gfile().get(), &err), false};
+    // FIXME: should we make this cancellable?
+    dirMonitor_ = GFileMonitorPtr{
+            g_file_monitor_directory(dirPath_.gfile().get(), G_FILE_MONITOR_WATCH_MOUNTS, nullptr, &err),
+            false
+    };
+
+    if(dirMonitor_) {
+        g_signal_connect(dirMonitor_.get(), "changed", G_CALLBACK(_onFileChangeEvents), this);
+    }
+    else {
+        qDebug("file monitor cannot be created: %s", err->message);
+        g_error_free(err);
+    }
+}
+
 #if 0
 
 /**
@@ -822,8 +1310,9 @@ void Folder::onFileSystemInfoFinished() {
     has_fs_info = job->isAvailable();
     fs_total_size = job->size();
     fs_free_size = job->freeSize();
-    filesystem_info_pending = true;
     fsInfoJob_ = nullptr;
+    std::lock_guard<std::mutex> lock{mutex_};
+    filesystem_info_pending = true;
     queueUpdate();
 }
 
@@ -24,7 +24,9 @@
 #include <cstdint>
 #include <memory>
 #include <vector>
+#include <list>
 #include <unordered_map>
+#include <unordered_set>
 #include <mutex>
 #include <functional>
 
@@ -36,6 +38,7 @@
 #include "fileinfo.h"
 #include "job.h"
 #include "volumemanager.h"
+#include "filechangequeue.h"
 
 namespace Fm {
 
@@ -48,6 +51,30 @@ class LIBFM_QT_API Folder: public QObject {
     Q_OBJECT
 public:
 
+    // How parked folders are evicted from the retention cache when it is full.
+    enum RetentionPolicy {
+        LeastRecentlyUsed, // the folder that was parked first
+        LargestFirst       // the folder with the most files
+    };
+
+    // How the content types of the files are found when a folder is listed. With two-phase
+    // loading, the MIME types are first guessed from the file names, and the real content
+    // types are queried in the background afterwards, the files set by setPriorityFiles()
+    // first. The files whose types change are reported through filesChanged().
+    enum ContentTypePolicy {
+        SniffContentTypes, // query the real content types while listing
+        TwoPhaseIfRemote,  // two-phase loading on remote filesystems (sftp, smb, NFS, ...)
+        TwoPhaseAlways     // two-phase loading on all filesystems
+    };
+
+    struct RetentionStats {
+        quint64 hits;      // reopened parked folders
+        quint64 misses;    // newly created folders
+        quint64 evictions;
+        size_t folders;
+        size_t files;
+    };
+
     explicit Folder();
 
     explicit Folder(const FilePath& path);
@@ -56,22 +83,79 @@ public:
 
     static std::shared_ptr<Folder> fromPath(const FilePath& path);
 
+    // Returns nullptr if the folder is not in use or is parked in the retention cache.
     static std::shared_ptr<Folder> findByPath(const FilePath& path);
 
+    // When the last user of a loaded folder goes away, it can be parked in a retention
+    // cache instead of being freed, so that reopening it does not need a full reload.
+    // Its file monitor is dropped while it is parked. On reopening, the parked content is
+    // shown at once and reconciled with a new listing in the background, unless the folder
+    // is native, was parked only a moment ago and its modification time has not changed.
+    // The cache is limited by the number of folders and by their total number of files.
+    // A zero limit disables it.
+    static size_t retentionLimit();
+
+    static void setRetentionLimit(size_t folders);
+
+    static size_t retentionFileBudget();
+
+    static void setRetentionFileBudget(size_t files);
+
+    static RetentionPolicy retentionPolicy();
+
+    static void setRetentionPolicy(RetentionPolicy policy);
+
+    static RetentionStats retentionStats();
+
+    // Frees all parked folders.
+    static void clearRetentionCache();
+
+    // The persistent cache of folder listings on disk (see ListingCache). A cached folder
+    // shows its last listing at once and is revalidated in the background. Disabled by
+    // default; only the folders that are not native are cached unless native ones are
+    // included, e.g. for NFS mounts. The size limit is the total size of the cache files.
+    static bool listingCacheEnabled();
+
+    static void setListingCacheEnabled(bool enabled);
+
+    static bool listingCacheIncludesNativeFolders();
+
+    static void setListingCacheIncludesNativeFolders(bool include);
+
+    static quint64 listingCacheMaxSize();
+
+    static void setListingCacheMaxSize(quint64 bytes);
+
+    // Removes all cached listings.
+    static void clearListingCache();
+
     bool makeDirectory(const char* name, GError** error);
 
     void queryFilesystemInfo();
 
     bool getFilesystemInfo(uint64_t* total_size, uint64_t* free_size) const;
 
+    // If the folder already has files, the new listing is reconciled with them: unchanged
+    // files are kept, only the real changes are reported, and startLoading() is not emitted.
     void reload();
 
     bool isIncremental() const;
 
+    // If incremental, the folder content is added in batches while the directory
+    // is being listed, instead of all at once when the listing is finished.
+    // This takes effect from the next reload.
+    void setIncremental(bool incremental);
+
     bool isValid() const;
 
     bool isLoaded() const;
 
+    // Whether the files are a snapshot from the persistent listing cache that is still
+    // being revalidated; see ListingCache. The differences found by the revalidation are
+    // reported through the usual signals, and the folder is not stale anymore when
+    // finishLoading() is emitted.
+    bool isStale() const;
+
     std::shared_ptr<const FileInfo> fileByName(const char* name) const;
 
     bool isEmpty() const;
@@ -84,10 +168,20 @@ public:
 
     const std::shared_ptr<const FileInfo> &info() const;
 
+    // The files whose content types should be queried first with two-phase loading,
+    // normally the visible ones. Each call replaces the previous files.
+    void setPriorityFiles(const FileInfoList& files);
+
+    static ContentTypePolicy contentTypePolicy();
+
+    // Takes effect from the next reload.
+    static void setContentTypePolicy(ContentTypePolicy policy);
+
+    // NOTE: The function is called with a snapshot of the files, so it may access the folder.
     void forEachFile(std::function<void (const std::shared_ptr<const FileInfo>&)> func) const {
-        std::lock_guard<std::mutex> lock{mutex_};
-        for(auto it = files_.begin(); it != files_.end(); ++it) {
-            func(it->second);
+        const auto snapshot = files();
+        for(const auto& file: snapshot) {
+            func(file);
         }
     }
 
@@ -128,9 +222,19 @@ private:
     void queueUpdate();
     void queueReload();
 
-    bool eventFileAdded(const FilePath &path);
-    bool eventFileChanged(const FilePath &path);
-    void eventFileDeleted(const FilePath &path);
+    void createDirMonitor();
+
+    bool isParked() const;
+    bool canPark() const;
+    void park();
+    void revalidate();
+    quint64 queryModificationTime() const;
+
+    static void release(Folder* folder);
+    static void evictParked(std::vector<std::shared_ptr<Folder>>& evicted);
+    static void reloadSameTargets(const FileId& folderId);
+
+    void mergeListedFiles(const FileInfoList& infos);
 
 private Q_SLOTS:
 
@@ -138,6 +242,8 @@ private Q_SLOTS:
 
     void processPendingChanges();
 
+    void onDirListFilesFound(FileInfoList& files);
+
     void onDirListFinished();
 
     void onFileSystemInfoFinished();
@@ -146,6 +252,12 @@ private Q_SLOTS:
 
     void onIdleReload();
 
+    void loadCachedListing();
+
+    void refineContentTypes();
+
+    void onContentTypesRefined();
+
     void onMountAdded(const Mount& mnt);
 
     void onMountRemoved(const Mount& mnt);
@@ -157,6 +269,7 @@ private:
     std::shared_ptr<const FileInfo> dirInfo_;
     DirListJob* dirlist_job;
     std::vector<FileInfoJob*> fileinfoJobs_;
+    FileInfoJob* contentTypeJob_;
     FileSystemInfoJob* fsInfoJob_;
 
     std::shared_ptr<VolumeManager> volumeManager_;
@@ -164,9 +277,7 @@ private:
     /* for file monitor */
     bool has_idle_reload_handler;
     bool has_idle_update_handler;
-    FilePathList paths_to_add;
-    FilePathList paths_to_update;
-    FilePathList paths_to_del;
+    FileChangeQueue pendingChanges_;
     // GSList* pending_jobs;
     bool pending_change_notify;
     bool filesystem_info_pending;
@@ -174,20 +285,63 @@ private:
     bool wants_incremental;
     bool stop_emission; /* don't set it 1 bit to not lock other bits */
 
-    // NOTE: Here, FileInfo::path().baseName().get() should be used as the key value, not FileInfo::name(),
+    // NOTE: Here, FileInfo::pathBaseName() should be used as the key value, not FileInfo::name(),
     // because the latter is not always the same as the former and the former will be used for comparison.
     std::unordered_map<std::string, std::shared_ptr<const FileInfo>> files_;
 
+    // the files whose MIME types are guessed, waiting for their content types
+    std::unordered_set<std::string> guessedFiles_;
+    std::unordered_set<std::string> priorityFiles_;
+
+    // the files not found yet by the dir list job of a reconciling reload
+    bool reconciling_;
+    bool stale_;
+    std::unordered_set<std::string> unlistedFiles_;
+
+    // guards files_, unlistedFiles_, pendingChanges_ and the update flags of this folder only
+    // NOTE: No signal should be emitted while it is locked.
+    mutable std::mutex mutex_;
+
     /* filesystem info - set in query thread, read in main */
     uint64_t fs_total_size;
     uint64_t fs_free_size;
     GCancellablePtr fs_size_cancellable;
 
     bool has_fs_info : 1;
-    bool defer_content_test : 1;
 
-    static std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> cache_;
-    static std::mutex mutex_;
+    // retention cache state, guarded by retentionMutex_
+    bool parked_;
+    bool parkedDirty_; // a reload was requested while parked
+    size_t parkedFileCount_;
+    quint64 parkedMtime_; // in microseconds, or 0 if unknown
+    gint64 parkedTime_; // when the folder was parked, in microseconds of the monotonic clock
+
+    // The cache of folders in use is split into shards by the path hash,
+    // so that looking up unrelated folders does not serialize on one lock.
+    struct CacheShard {
+        std::mutex mutex;
+        std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> folders;
+    };
+
+    static CacheShard& cacheShard(const FilePath& path);
+
+    static ContentTypePolicy contentTypePolicy_;
+
+    static constexpr std::size_t cacheShardCount_ = 16;
+    static CacheShard cacheShards_[cacheShardCount_];
+
+    // NOTE: If both are needed, retentionMutex_ should be locked before a cache shard,
+    // so nothing that may lock retentionMutex_ (like reload() or isParked()) should be
+    // called while a shard is locked.
+    static std::mutex retentionMutex_;
+    static std::list<std::shared_ptr<Folder>> parkedFolders_; // the most recently parked first
+    static size_t retentionLimit_;
+    static size_t retentionFileBudget_;
+    static size_t parkedFiles_;
+    static RetentionPolicy retentionPolicy_;
+    static quint64 retentionHits_;
+    static quint64 retentionMisses_;
+    static quint64 retentionEvictions_;
 };
 
 }
@@ -4,10 +4,19 @@
 
 namespace Fm {
 
-std::unordered_map<GIcon*, std::shared_ptr<IconInfo>, IconInfo::GIconHash, IconInfo::GIconEqual> IconInfo::cache_;
+std::list<IconInfo::CacheEntry> IconInfo::lru_;
+std::unordered_map<GIcon*, IconInfo::CacheIterator, IconInfo::GIconHash, IconInfo::GIconEqual> IconInfo::cache_;
+std::unordered_map<std::string, IconInfo::CacheIterator> IconInfo::nameCache_;
+size_t IconInfo::maxCacheSize_ = 1024;
+quint64 IconInfo::hits_ = 0;
+quint64 IconInfo::misses_ = 0;
+quint64 IconInfo::evictions_ = 0;
 std::mutex IconInfo::mutex_;
 QList<QIcon> IconInfo::fallbackQicons_;
 
+// the number of cached icons checked for eviction when one is added
+static const size_t evictionScanLimit = 32;
+
 static const char* fallbackIconNames[] = {
     "unknown",
     "application-octet-stream",
@@ -38,34 +47,106 @@ IconInfo::~IconInfo() {
 
 // static
 std::shared_ptr<const IconInfo> IconInfo::fromName(const char* name) {
-    GObjectPtr<GIcon> gicon{g_themed_icon_new(name), false};
-    return fromGIcon(gicon);
+    if(Q_UNLIKELY(!name)) {
+        return std::shared_ptr<const IconInfo>{};
+    }
+    {
+        // the name index spares creating a GThemedIcon only to find it in the cache
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = nameCache_.find(name);
+        if(it != nameCache_.end()) {
+            ++hits_;
+            return useEntry(it->second);
+        }
+    }
+    return insertEntry(GIconPtr{g_themed_icon_new(name), false}, name);
 }
 
 // static
 std::shared_ptr<const IconInfo> IconInfo::fromGIcon(GIconPtr gicon) {
     if(Q_LIKELY(gicon)) {
-        std::lock_guard<std::mutex> lock{mutex_};
-        auto it = cache_.find(gicon.get());
-        if(it != cache_.end()) {
-            return it->second;
-        }
-        // not found in the cache, create a new entry for it.
-        auto icon = std::make_shared<IconInfo>(std::move(gicon));
-        cache_.insert(std::make_pair(icon->gicon_.get(), icon));
-        return icon;
+        return insertEntry(std::move(gicon), nullptr);
     }
     return std::shared_ptr<const IconInfo>{};
 }
 
+// static
+std::shared_ptr<const IconInfo> IconInfo::useEntry(CacheIterator it) {
+    lru_.splice(lru_.begin(), lru_, it);
+    return it->info;
+}
+
+// static
+std::shared_ptr<const IconInfo> IconInfo::insertEntry(GIconPtr gicon, const char* name) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = cache_.find(gicon.get());
+    if(it != cache_.end()) {
+        ++hits_;
+        auto entry = it->second;
+        if(name && entry->name.empty()) {
+            entry->name = name;
+            nameCache_.emplace(entry->name, entry);
+        }
+        return useEntry(entry);
+    }
+    // not found in the cache, create a new entry for it.
+    ++misses_;
+    auto icon = std::make_shared<IconInfo>(std::move(gicon));
+    lru_.push_front(CacheEntry{icon, name ? name : std::string{}});
+    cache_.emplace(icon->gicon_.get(), lru_.begin());
+    if(name) {
+        nameCache_.emplace(lru_.front().name, lru_.begin());
+    }
+    evict(maxCacheSize_, evictionScanLimit);
+    return icon;
+}
+
+// should be called with the lock held
+// static
+void IconInfo::evict(size_t maxSize, size_t scanLimit) {
+    for(size_t scanned = 0; lru_.size() > maxSize && scanned < scanLimit; ++scanned) {
+        auto it = std::prev(lru_.end());
+        if(it->info.use_count() > 1) {
+            // still used by a file, a mime type or a widget, so dropping it would not free
+            // anything and a later lookup would create a duplicate
+            lru_.splice(lru_.begin(), lru_, it);
+            continue;
+        }
+        cache_.erase(it->info->gicon_.get());
+        if(!it->name.empty()) {
+            nameCache_.erase(it->name);
+        }
+        lru_.erase(it);
+        ++evictions_;
+    }
+}
+
 void IconInfo::updateQIcons() {
     std::lock_guard<std::mutex> lock{mutex_};
-    for(auto& elem: cache_) {
-        auto& info = elem.second;
-        info->internalQicons_.clear();
+    for(auto& entry: lru_) {
+        entry.info->internalQicons_.clear();
     }
 }
 
+// static
+size_t IconInfo::maxCacheSize() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return maxCacheSize_;
+}
+
+// static
+void IconInfo::setMaxCacheSize(size_t size) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    maxCacheSize_ = size;
+    evict(maxCacheSize_, lru_.size());
+}
+
+// static
+IconInfo::CacheStats IconInfo::cacheStats() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return CacheStats{hits_, misses_, evictions_, lru_.size()};
+}
+
 QIcon IconInfo::qicon() const {
     if(Q_UNLIKELY(qicon_.isNull() && gicon_)) {
         if(!G_IS_FILE_ICON(gicon_.get())) {
@@ -30,6 +30,8 @@
 #include "gioptrs.h"
 #include <memory>
 #include <mutex>
+#include <list>
+#include <string>
 #include <unordered_map>
 #include <forward_list>
 #include <QIcon>
@@ -37,10 +39,21 @@
 
 namespace Fm {
 
+// IconInfo objects are shared through a process-wide cache keyed by the content of the
+// icons (g_icon_hash() and g_icon_equal()) and, for fromName(), by the icon name. The
+// cache is bounded: beyond maxCacheSize(), the least recently used icons that are not
+// referenced anywhere else are dropped.
 class LIBFM_QT_API IconInfo: public std::enable_shared_from_this<IconInfo> {
 public:
     friend class IconEngine;
 
+    struct CacheStats {
+        quint64 hits;
+        quint64 misses;
+        quint64 evictions;
+        size_t entries;
+    };
+
     explicit IconInfo() {}
 
     explicit IconInfo(const char* name);
@@ -59,6 +72,13 @@ public:
 
     static void updateQIcons();
 
+    // The number of cached icons above which unused ones are evicted (1024 by default).
+    static size_t maxCacheSize();
+
+    static void setMaxCacheSize(size_t size);
+
+    static CacheStats cacheStats();
+
     GIconPtr gicon() const {
         return gicon_;
     }
@@ -94,12 +114,32 @@ private:
         }
     };
 
+    struct CacheEntry {
+        std::shared_ptr<IconInfo> info;
+        std::string name; // the name given to fromName(), if any
+    };
+
+    typedef std::list<CacheEntry>::iterator CacheIterator;
+
+    // should be called with the lock held
+    static std::shared_ptr<const IconInfo> useEntry(CacheIterator it);
+
+    static std::shared_ptr<const IconInfo> insertEntry(GIconPtr gicon, const char* name);
+
+    static void evict(size_t maxSize, size_t scanLimit);
+
 private:
     GIconPtr gicon_;
     mutable QIcon qicon_;
     mutable QList<QIcon> internalQicons_;
 
-    static std::unordered_map<GIcon*, std::shared_ptr<IconInfo>, GIconHash, GIconEqual> cache_;
+    static std::list<CacheEntry> lru_; // the most recently used first
+    static std::unordered_map<GIcon*, CacheIterator, GIconHash, GIconEqual> cache_;
+    static std::unordered_map<std::string, CacheIterator> nameCache_;
+    static size_t maxCacheSize_;
+    static quint64 hits_;
+    static quint64 misses_;
+    static quint64 evictions_;
     static std::mutex mutex_;
     static QList<QIcon> fallbackQicons_;
 };
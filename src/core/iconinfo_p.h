@@ -58,22 +58,38 @@ public:
     void virtual_hook(int id, void* data) override;
 
 private:
+    std::shared_ptr<const Fm::IconInfo> info();
+
     std::weak_ptr<const Fm::IconInfo> info_;
+    // a copy of the QIcon may outlive the IconInfo once it is evicted from the cache;
+    // then the icon is looked up again
+    GIconPtr gicon_;
 };
 
-IconEngine::IconEngine(std::shared_ptr<const IconInfo> info): info_{info} {
+IconEngine::IconEngine(std::shared_ptr<const IconInfo> info):
+    info_{info},
+    gicon_{info ? info->gicon() : GIconPtr{}} {
+}
+
+std::shared_ptr<const IconInfo> IconEngine::info() {
+    auto info = info_.lock();
+    if(Q_UNLIKELY(!info && gicon_)) {
+        info = IconInfo::fromGIcon(gicon_);
+        info_ = info;
+    }
+    return info;
 }
 
 IconEngine::~IconEngine() {
 }
 
 QSize IconEngine::actualSize(const QSize& size, QIcon::Mode mode, QIcon::State state) {
-    auto info = info_.lock();
+    auto info = this->info();
     return info ? info->internalQicon().actualSize(size, mode, state) : QSize{};
 }
 
 QIconEngine* IconEngine::clone() const {
-    IconEngine* engine = new IconEngine(info_.lock());
+    IconEngine* engine = new IconEngine(*this);
     return engine;
 }
 
@@ -82,29 +98,29 @@ QString IconEngine::key() const {
 }
 
 void IconEngine::paint(QPainter* painter, const QRect& rect, QIcon::Mode mode, QIcon::State state) {
-    auto info = info_.lock();
+    auto info = this->info();
     if(info) {
         info->internalQicon().paint(painter, rect, Qt::AlignCenter, mode, state);
     }
 }
 
 QPixmap IconEngine::pixmap(const QSize& size, QIcon::Mode mode, QIcon::State state) {
-    auto info = info_.lock();
+    auto info = this->info();
     return info ? info->internalQicon().pixmap(size, mode, state) : QPixmap{};
 }
 
 QString IconEngine::iconName() {
-    auto info = info_.lock();
+    auto info = this->info();
     return info ? info->internalQicon().name() : QString{};
 }
 
 bool IconEngine::isNull() {
-    auto info = info_.lock();
+    auto info = this->info();
     return info ? info->internalQicon().isNull() : true;
 }
 
 QPixmap IconEngine::scaledPixmap(const QSize &size, QIcon::Mode mode, QIcon::State state, qreal scale) {
-    auto info = info_.lock();
+    auto info = this->info();
     return info ?
            // According to Qt doc, "size" is device-independent since Qt 6.8,
            // while it was device-dependent prior to Qt 6.8.
@@ -117,12 +133,12 @@ QPixmap IconEngine::scaledPixmap(const QSize &size, QIcon::Mode mode, QIcon::Sta
 }
 
 QList<QSize> IconEngine::availableSizes(QIcon::Mode mode, QIcon::State state) {
-    auto info = info_.lock();
+    auto info = this->info();
     return info ? info->internalQicon().availableSizes(mode, state) : QList<QSize>{};
 }
 
 void IconEngine::virtual_hook(int id, void* data) {
-    auto info = info_.lock();
+    auto info = this->info();
     switch(id) {
     case QIconEngine::IsNullHook: {
         bool* result = reinterpret_cast<bool*>(data);
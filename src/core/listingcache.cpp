@@ -0,0 +1,440 @@
+#include "listingcache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Fm {
+
+std::mutex ListingCache::mutex_;
+bool ListingCache::enabled_ = false;
+bool ListingCache::includeNative_ = false;
+quint64 ListingCache::maxSize_ = 64 * 1024 * 1024; // 64 MiB
+qint64 ListingCache::totalSize_ = -1;
+
+namespace {
+
+// NOTE: Increase the version whenever the layout below changes.
+const quint32 cacheVersion = 2;
+const char cacheMagic[8] = {'F', 'M', 'Q', 'T', 'L', 'I', 'S', 'T'};
+const quint32 cacheByteOrder = 0x01020304; // the files are not portable between architectures
+
+// All the sizes are multiples of 8, so that the records can be read in place.
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint64 count;
+    quint64 stringsSize;
+};
+
+struct Record {
+    quint64 size;
+    quint64 allocatedSize;
+    quint64 mtime;
+    quint64 atime;
+    quint64 ctime;
+    quint64 crtime;
+    quint64 dtime;
+    quint64 fileId[2];
+    quint64 filesystemId[2];
+    quint32 mode;
+    quint32 uid;
+    quint32 gid;
+    quint32 flags;
+    // offsets in the string table
+    quint32 name;
+    quint32 displayName;
+    quint32 mimeType;
+    quint32 icon;
+    quint32 target;
+    quint32 emblems; // separated by '\n'
+    quint8 fileIdKind;
+    quint8 filesystemIdKind;
+    quint8 padding[6];
+};
+
+static_assert(sizeof(Header) % 8 == 0 && sizeof(Record) % 8 == 0, "unaligned listing cache records");
+
+enum RecordFlag: quint32 {
+    IsShortcut = 1 << 0,
+    IsMountable = 1 << 1,
+    IsAccessible = 1 << 2,
+    IsWritable = 1 << 3,
+    IsDeletable = 1 << 4,
+    IsHidden = 1 << 5,
+    IsBackup = 1 << 6,
+    IsNameChangeable = 1 << 7,
+    IsIconChangeable = 1 << 8,
+    IsHiddenChangeable = 1 << 9,
+    IsReadOnly = 1 << 10,
+    IsRemote = 1 << 11,
+    CanMount = 1 << 12,
+    CanUnmount = 1 << 13,
+    CanEject = 1 << 14,
+    IsTrusted = 1 << 15,
+    IsMimeTypeGuessed = 1 << 16,
+    IsTrustUnknown = 1 << 17
+};
+
+// Each string is stored once, NUL-terminated, and the offset 0 is the empty string.
+class StringTable {
+public:
+    StringTable(): data_(1, '\0') {
+    }
+
+    quint32 add(const char* str) {
+        if(!str || !*str) {
+            return 0;
+        }
+        auto it = offsets_.find(str);
+        if(it != offsets_.end()) {
+            return it->second;
+        }
+        quint32 offset = data_.size();
+        data_.append(str, strlen(str) + 1);
+        offsets_.emplace(str, offset);
+        return offset;
+    }
+
+    const QByteArray& data() const {
+        return data_;
+    }
+
+private:
+    QByteArray data_;
+    std::unordered_map<std::string, quint32> offsets_;
+};
+
+CStrPtr iconToString(const std::shared_ptr<const IconInfo>& icon) {
+    if(icon && icon->gicon()) {
+        return CStrPtr{g_icon_to_string(icon->gicon().get())};
+    }
+    return CStrPtr{};
+}
+
+std::shared_ptr<const IconInfo> iconFromString(const char* str) {
+    GIconPtr gicon{g_icon_new_for_string(str, nullptr), false};
+    return gicon ? IconInfo::fromGIcon(gicon) : nullptr;
+}
+
+} // namespace
+
+bool ListingCache::isEnabled() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return enabled_;
+}
+
+void ListingCache::setEnabled(bool enabled) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    enabled_ = enabled;
+}
+
+bool ListingCache::includesNativeFolders() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return includeNative_;
+}
+
+void ListingCache::setIncludeNativeFolders(bool include) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    includeNative_ = include;
+}
+
+quint64 ListingCache::maxSize() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return maxSize_;
+}
+
+void ListingCache::setMaxSize(quint64 bytes) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    maxSize_ = bytes;
+    evict(maxSize_);
+}
+
+bool ListingCache::isCacheable(const FilePath& dirPath) {
+    if(!dirPath) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if(!enabled_ || (dirPath.isNative() && !includeNative_)) {
+            return false;
+        }
+    }
+    // these are generated on the fly
+    return !dirPath.hasUriScheme("search") && !dirPath.hasUriScheme("menu");
+}
+
+QString ListingCache::cacheDir() {
+    return QString::fromUtf8(g_get_user_cache_dir()) + QStringLiteral("/libfm-qt/listings");
+}
+
+QString ListingCache::cacheFile(const FilePath& dirPath) {
+    auto uri = dirPath.uri();
+    auto hash = QCryptographicHash::hash(QByteArray(uri.get()), QCryptographicHash::Md5).toHex();
+    return cacheDir() + QLatin1Char('/') + QString::fromLatin1(hash) + QStringLiteral(".list");
+}
+
+FileInfoList ListingCache::load(const FilePath& dirPath) {
+    FileInfoList files;
+    if(!isCacheable(dirPath)) {
+        return files;
+    }
+    QFile file{cacheFile(dirPath)};
+    if(!file.open(QIODevice::ReadOnly)) {
+        return files;
+    }
+    const qint64 fileSize = file.size();
+    const uchar* data = fileSize >= static_cast<qint64>(sizeof(Header)) ? file.map(0, fileSize) : nullptr;
+    if(!data) {
+        return files;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(data);
+    const char* strings = nullptr;
+    bool valid = memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) == 0
+                 && header->version == cacheVersion
+                 && header->byteOrder == cacheByteOrder
+                 && header->count <= static_cast<quint64>(fileSize) / sizeof(Record)
+                 && header->stringsSize > 0
+                 && sizeof(Header) + header->count * sizeof(Record) + header->stringsSize == static_cast<quint64>(fileSize);
+    if(valid) {
+        strings = reinterpret_cast<const char*>(data + sizeof(Header) + header->count * sizeof(Record));
+        valid = strings[header->stringsSize - 1] == '\0';
+    }
+    if(!valid) {
+        file.unmap(const_cast<uchar*>(data));
+        file.close();
+        file.remove();
+        return files;
+    }
+
+    auto str = [&](quint32 offset) {
+        return offset < header->stringsSize ? strings + offset : "";
+    };
+    auto fileId = [](quint8 kind, const quint64* value) {
+        return kind <= FileId::Hashed ? FileId{static_cast<FileId::Kind>(kind), value[0], value[1]} : FileId{};
+    };
+
+    const Record* records = reinterpret_cast<const Record*>(data + sizeof(Header));
+    files.reserve(header->count);
+    for(quint64 i = 0; i < header->count; ++i) {
+        const Record& r = records[i];
+        auto info = std::make_shared<FileInfo>();
+        info->name_ = str(r.name);
+        if(r.displayName != 0) {
+            info->dispName_ = QString::fromUtf8(str(r.displayName));
+        }
+        info->dirPath_ = dirPath;
+        info->mimeType_ = MimeType::fromName(r.mimeType != 0 ? str(r.mimeType) : "application/octet-stream");
+        if(r.icon != 0) {
+            info->icon_ = iconFromString(str(r.icon));
+        }
+        if(!info->icon_) {
+            info->icon_ = info->mimeType_->icon();
+        }
+        if(r.emblems != 0) {
+            auto names = QByteArray(str(r.emblems)).split('\n');
+            for(auto it = names.crbegin(); it != names.crend(); ++it) {
+                if(auto emblem = iconFromString(it->constData())) {
+                    info->emblems_.emplace_front(std::move(emblem));
+                }
+            }
+        }
+        info->target_ = str(r.target);
+        info->filesystemId_ = fileId(r.filesystemIdKind, r.filesystemId);
+        info->fileId_ = fileId(r.fileIdKind, r.fileId);
+        info->size_ = r.size;
+        info->allocatedSize_ = r.allocatedSize;
+        info->mtime_ = r.mtime;
+        info->atime_ = r.atime;
+        info->ctime_ = r.ctime;
+        info->crtime_ = r.crtime;
+        info->dtime_ = r.dtime;
+        info->mode_ = r.mode;
+        info->uid_ = r.uid;
+        info->gid_ = r.gid;
+        info->isShortcut_ = r.flags & IsShortcut;
+        info->isMountable_ = r.flags & IsMountable;
+        info->isAccessible_ = r.flags & IsAccessible;
+        info->isWritable_ = r.flags & IsWritable;
+        info->isDeletable_ = r.flags & IsDeletable;
+        info->isHidden_ = r.flags & IsHidden;
+        info->isBackup_ = r.flags & IsBackup;
+        info->isNameChangeable_ = r.flags & IsNameChangeable;
+        info->isIconChangeable_ = r.flags & IsIconChangeable;
+        info->isHiddenChangeable_ = r.flags & IsHiddenChangeable;
+        info->isReadOnly_ = r.flags & IsReadOnly;
+        info->isRemote_ = r.flags & IsRemote;
+        info->canMount_ = r.flags & CanMount;
+        info->canUnmount_ = r.flags & CanUnmount;
+        info->canEject_ = r.flags & CanEject;
+        info->isTrusted_ = r.flags & IsTrusted;
+        info->isMimeTypeGuessed_ = r.flags & IsMimeTypeGuessed;
+        info->isTrustUnknown_ = r.flags & IsTrustUnknown;
+        files.push_back(std::move(info));
+    }
+    file.unmap(const_cast<uchar*>(data));
+
+    // the modification time of a cache file is its last use; see evict()
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    return files;
+}
+
+bool ListingCache::save(const FilePath& dirPath, const FileInfoList& files) {
+    if(!isCacheable(dirPath)) {
+        return false;
+    }
+    StringTable strings;
+    std::vector<Record> records;
+    records.reserve(files.size());
+    for(const auto& info : files) {
+        Record r;
+        memset(&r, 0, sizeof(r));
+        r.name = strings.add(info->name_.c_str());
+        if(!info->dispName_.isNull()) {
+            r.displayName = strings.add(info->dispName_.toUtf8().constData());
+        }
+        r.mimeType = strings.add(info->mimeType_ ? info->mimeType_->name() : nullptr);
+        r.icon = strings.add(iconToString(info->icon_).get());
+        if(!info->emblems_.empty()) {
+            QByteArray emblems;
+            for(const auto& emblem : info->emblems_) {
+                if(auto name = iconToString(emblem)) {
+                    if(!emblems.isEmpty()) {
+                        emblems += '\n';
+                    }
+                    emblems += name.get();
+                }
+            }
+            r.emblems = strings.add(emblems.constData());
+        }
+        r.target = strings.add(info->target_.c_str());
+        r.fileIdKind = info->fileId_.kind_;
+        r.fileId[0] = info->fileId_.first_;
+        r.fileId[1] = info->fileId_.second_;
+        r.filesystemIdKind = info->filesystemId_.kind_;
+        r.filesystemId[0] = info->filesystemId_.first_;
+        r.filesystemId[1] = info->filesystemId_.second_;
+        r.size = info->size_;
+        r.allocatedSize = info->allocatedSize_;
+        r.mtime = info->mtime_;
+        r.atime = info->atime_;
+        r.ctime = info->ctime_;
+        r.crtime = info->crtime_;
+        r.dtime = info->dtime_;
+        r.mode = info->mode_;
+        r.uid = info->uid_;
+        r.gid = info->gid_;
+        r.flags = (info->isShortcut_ ? IsShortcut : 0)
+                  | (info->isMountable_ ? IsMountable : 0)
+                  | (info->isAccessible_ ? IsAccessible : 0)
+                  | (info->isWritable_ ? IsWritable : 0)
+                  | (info->isDeletable_ ? IsDeletable : 0)
+                  | (info->isHidden_ ? IsHidden : 0)
+                  | (info->isBackup_ ? IsBackup : 0)
+                  | (info->isNameChangeable_ ? IsNameChangeable : 0)
+                  | (info->isIconChangeable_ ? IsIconChangeable : 0)
+                  | (info->isHiddenChangeable_ ? IsHiddenChangeable : 0)
+                  | (info->isReadOnly_ ? IsReadOnly : 0)
+                  | (info->isRemote_ ? IsRemote : 0)
+                  | (info->canMount_ ? CanMount : 0)
+                  | (info->canUnmount_ ? CanUnmount : 0)
+                  | (info->canEject_ ? CanEject : 0)
+                  | (info->isTrusted_ ? IsTrusted : 0)
+                  | (info->isMimeTypeGuessed_ ? IsMimeTypeGuessed : 0)
+                  | (info->isTrustUnknown_ ? IsTrustUnknown : 0);
+        records.push_back(r);
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.byteOrder = cacheByteOrder;
+    header.count = records.size();
+    header.stringsSize = strings.data().size();
+
+    const quint64 fileSize = sizeof(Header) + records.size() * sizeof(Record) + strings.data().size();
+    const quint64 limit = maxSize();
+    if(fileSize > limit / 4) { // too big to be cached
+        remove(dirPath);
+        return false;
+    }
+
+    // the listings may reveal the names of private files to other users
+    const QString dirName = cacheDir();
+    if(!QDir().mkpath(dirName)
+       || !QFile::setPermissions(dirName, QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ExeOwner)) {
+        return false;
+    }
+    const QString fileName = cacheFile(dirPath);
+    QSaveFile file{fileName};
+    if(!file.open(QIODevice::WriteOnly) || !file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner)) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+    file.write(strings.data());
+    const qint64 oldFileSize = QFileInfo{fileName}.size(); // 0 if there is no such file
+    if(!file.commit()) {
+        return false;
+    }
+
+    // the cache directory is only scanned when its size may exceed the limit
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(totalSize_ >= 0) {
+        totalSize_ += static_cast<qint64>(fileSize) - oldFileSize;
+    }
+    if(totalSize_ < 0 || static_cast<quint64>(totalSize_) > maxSize_) {
+        evict(maxSize_);
+    }
+    return true;
+}
+
+void ListingCache::remove(const FilePath& dirPath) {
+    const QString fileName = cacheFile(dirPath);
+    const qint64 fileSize = QFileInfo{fileName}.size();
+    if(QFile::remove(fileName)) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if(totalSize_ >= 0) {
+            totalSize_ = std::max<qint64>(totalSize_ - fileSize, 0);
+        }
+    }
+}
+
+void ListingCache::clear() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    QDir{cacheDir()}.removeRecursively();
+    totalSize_ = 0;
+}
+
+// should be called with the lock held
+// The size of the cache is counted anew, since other processes may change it too.
+void ListingCache::evict(quint64 maxSize) {
+    QDir dir{cacheDir()};
+    // the least recently used first
+    const auto entries = dir.entryInfoList(QStringList{QStringLiteral("*.list")}, QDir::Files, QDir::Time | QDir::Reversed);
+    quint64 total = 0;
+    for(const auto& entry : entries) {
+        total += entry.size();
+    }
+    for(const auto& entry : entries) {
+        if(total <= maxSize) {
+            break;
+        }
+        if(QFile::remove(entry.filePath())) {
+            total -= entry.size();
+        }
+    }
+    totalSize_ = static_cast<qint64>(total);
+}
+
+} // namespace Fm
@@ -0,0 +1,65 @@
+#ifndef FM2_LISTINGCACHE_H
+#define FM2_LISTINGCACHE_H
+
+#include "../libfmqtglobals.h"
+#include "filepath.h"
+#include "fileinfo.h"
+#include <QString>
+#include <mutex>
+
+namespace Fm {
+
+// An opt-in persistent cache of folder listings, meant for remote and slow filesystems.
+// Each listing is kept in its own file under $XDG_CACHE_HOME/libfm-qt/listings, named
+// after a hash of the folder URI. The file has a small versioned header, an array of
+// fixed-size records and a string table, and is read by mapping it into memory.
+// When the total size of the cache exceeds its limit, the least recently used
+// listings are removed. All methods are thread-safe.
+class ListingCache {
+public:
+    static bool isEnabled();
+
+    // Disabled by default.
+    static void setEnabled(bool enabled);
+
+    // By default, only the folders that are not native (sftp://, smb://, ...) are cached.
+    // Native folders can be included for network filesystems mounted into the tree, like NFS.
+    static bool includesNativeFolders();
+
+    static void setIncludeNativeFolders(bool include);
+
+    // The maximum total size of the cache files in bytes.
+    // A single listing may use at most a quarter of it.
+    static quint64 maxSize();
+
+    static void setMaxSize(quint64 bytes);
+
+    // Whether the listing of the folder would be cached with the current settings.
+    static bool isCacheable(const FilePath& dirPath);
+
+    // Returns an empty list if the folder is not cached or its cache file is invalid.
+    static FileInfoList load(const FilePath& dirPath);
+
+    static bool save(const FilePath& dirPath, const FileInfoList& files);
+
+    static void remove(const FilePath& dirPath);
+
+    static void clear();
+
+    static QString cacheDir();
+
+private:
+    static QString cacheFile(const FilePath& dirPath);
+
+    static void evict(quint64 maxSize);
+
+    static std::mutex mutex_;
+    static bool enabled_;
+    static bool includeNative_;
+    static quint64 maxSize_;
+    static qint64 totalSize_; // the size of the cache files, or -1 until they are counted
+};
+
+} // namespace Fm
+
+#endif // FM2_LISTINGCACHE_H
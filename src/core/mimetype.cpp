@@ -1,5 +1,12 @@
 #include "mimetype.h"
+#include <chrono>
 #include <cstring>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <fnmatch.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 #include <gio/gio.h>
@@ -8,7 +15,13 @@ using namespace std;
 
 namespace Fm {
 
-std::unordered_map<const char*, std::shared_ptr<const MimeType>, CStrHash, CStrEqual> MimeType::cache_;
+struct MimeType::CacheNode {
+    std::size_t hash;
+    std::shared_ptr<const MimeType> type;
+    const CacheNode* next;
+};
+
+std::atomic<const MimeType::CacheNode*> MimeType::cacheBuckets_[MimeType::cacheBucketCount];
 std::mutex MimeType::mutex_;
 
 std::shared_ptr<const MimeType> MimeType::inodeDirectory_;  // inode/directory
@@ -19,12 +32,38 @@ std::shared_ptr<const MimeType> MimeType::desktopEntry_; // application/x-deskto
 
 MimeType::MimeType(const char* typeName):
     name_{g_strdup(typeName)},
-    desc_{nullptr} {
+    desc_{nullptr},
+    flags_{0} {
+
+    if(g_content_type_is_unknown(typeName)) {
+        flags_ |= UnknownType;
+    }
+    if(g_content_type_is_a(typeName, "text/plain")) {
+        flags_ |= Text;
+    }
+    if(std::strncmp("image/", typeName, 6) == 0) {
+        flags_ |= Image;
+    }
+    if(g_content_type_can_be_executable(typeName)) {
+        flags_ |= CanBeExecutable;
+    }
+    if(strcmp(typeName, "inode/directory") == 0) {
+        flags_ |= Directory;
+    }
+    else if(strcmp(typeName, "inode/x-shortcut") == 0) {
+        flags_ |= Shortcut;
+    }
+    else if(strcmp(typeName, "inode/mount-point") == 0) {
+        flags_ |= MountPoint;
+    }
+    else if(strcmp(typeName, "application/x-desktop") == 0) {
+        flags_ |= DesktopEntry;
+    }
 
     GObjectPtr<GIcon> gicon{g_content_type_get_icon(typeName), false};
-    if(strcmp(typeName, "inode/directory") == 0)
+    if(flags_ & Directory)
         g_themed_icon_prepend_name(G_THEMED_ICON(gicon.get()), "folder");
-    else if(g_content_type_can_be_executable(typeName))
+    else if(flags_ & CanBeExecutable)
         g_themed_icon_append_name(G_THEMED_ICON(gicon.get()), "application-x-executable");
 
     icon_ = IconInfo::fromGIcon(gicon);
@@ -35,29 +74,287 @@ MimeType::~MimeType () {
 
 //static
 std::shared_ptr<const MimeType> MimeType::fromName(const char* typeName) {
-    std::shared_ptr<const MimeType> ret;
+    const std::size_t hash = g_str_hash(typeName);
+    auto& bucket = cacheBuckets_[hash % cacheBucketCount];
+    auto ret = findCached(bucket.load(std::memory_order_acquire), hash, typeName);
+    if(ret) {
+        return ret;
+    }
     std::lock_guard<std::mutex> lock(mutex_);
-    auto it = cache_.find(typeName);
-    if(it == cache_.end()) {
+    // another thread may have added it in the meantime
+    auto head = bucket.load(std::memory_order_relaxed);
+    ret = findCached(head, hash, typeName);
+    if(!ret) {
         ret = std::make_shared<MimeType>(typeName);
-        cache_.insert(std::make_pair(ret->name_.get(), ret));
-    }
-    else {
-        ret = it->second;
+        bucket.store(new CacheNode{hash, ret, head}, std::memory_order_release);
     }
     return ret;
 }
 
+// static
+std::shared_ptr<const MimeType> MimeType::findCached(const CacheNode* node, std::size_t hash, const char* typeName) {
+    for(; node; node = node->next) {
+        if(node->hash == hash && strcmp(node->type->name(), typeName) == 0) {
+            return node->type;
+        }
+    }
+    return std::shared_ptr<const MimeType>{};
+}
+
+namespace {
+
+static std::string asciiLower(std::string str) {
+    for(auto& c : str) {
+        c = g_ascii_tolower(c);
+    }
+    return str;
+}
+
+static bool endsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// The globs of the shared-mime-info database, sorted the way xdgmime matches them, as far
+// as the extension cache needs them. See the "Recognising files" section of the spec.
+struct MimeGlobs {
+    struct FullGlob {
+        std::string pattern;
+        bool caseSensitive;
+    };
+
+    std::unordered_set<std::string> literals;  // lowercased names such as "makefile"
+    std::vector<std::string> suffixes;           // the lowercased S of the "*S" globs
+    std::vector<std::string> csSuffixes;         // the same, for the case-sensitive globs
+    std::vector<FullGlob> fullGlobs;             // the others, lowercased unless case-sensitive
+
+    void load(const std::string& path, bool hasWeights);
+
+    bool matchesLiteralOrFullGlob(const std::string& name, const std::string& lowerName) const;
+};
+
+void MimeGlobs::load(const std::string& path, bool hasWeights) {
+    gchar* contents = nullptr;
+    if(!g_file_get_contents(path.c_str(), &contents, nullptr, nullptr)) {
+        return;
+    }
+    CStrPtr contentsPtr{contents};
+    for(auto line = strtok(contents, "\n"); line; line = strtok(nullptr, "\n")) {
+        if(line[0] == '#') {
+            continue;
+        }
+        // globs2: weight:type:glob[:flags], globs: type:glob
+        CStrArrayPtr fields{g_strsplit(line, ":", 4)};
+        const int globField = hasWeights ? 2 : 1;
+        if(g_strv_length(fields.get()) <= static_cast<guint>(globField)) {
+            continue;
+        }
+        const char* glob = fields[globField];
+        const bool caseSensitive = hasWeights && fields[3] && strstr(fields[3], "cs") != nullptr;
+        const std::string lowerGlob = asciiLower(glob);
+        if(!strpbrk(glob, "*?[")) {
+            literals.emplace(lowerGlob);
+        }
+        else if(glob[0] == '*' && !strpbrk(glob + 1, "*?[")) {
+            (caseSensitive ? csSuffixes : suffixes).emplace_back(lowerGlob.substr(1));
+        }
+        else {
+            fullGlobs.push_back(FullGlob{caseSensitive ? glob : lowerGlob, caseSensitive});
+        }
+    }
+}
+
+bool MimeGlobs::matchesLiteralOrFullGlob(const std::string& name, const std::string& lowerName) const {
+    if(literals.count(lowerName) > 0) {
+        return true;
+    }
+    for(const auto& glob : fullGlobs) {
+        if(fnmatch(glob.pattern.c_str(), glob.caseSensitive ? name.c_str() : lowerName.c_str(), 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Maps file name extensions to the MimeType that g_content_type_guess() gives for them.
+// An extension is only cached if the globs cannot tell apart the names that end with it,
+// so the result is the same as guessing each name. The globs are reloaded when the mime
+// database changes, checked at most every few seconds like xdgmime does.
+class MimeGuessCache {
+public:
+    // Returns null if the name has to be guessed by GIO.
+    std::shared_ptr<const MimeType> lookup(const char* baseName, bool& uncertain);
+
+private:
+    enum class Kind {
+        Cached,
+        ByExactCase,  // a case-sensitive glob matches the extension, so the case matters
+        GuessEachName // a longer glob ends with the extension (like "*.tar.gz" for "gz")
+    };
+
+    struct Entry {
+        Kind kind;
+        std::shared_ptr<const MimeType> type;
+        bool uncertain;
+    };
+
+    Entry makeEntry(const std::string& ext, bool exactCase) const;
+
+    void checkDatabase();
+
+    std::shared_mutex mutex_;
+    MimeGlobs globs_;
+    std::unordered_map<std::string, Entry> byExtension_;       // keyed by the lowercased extension
+    std::unordered_map<std::string, Entry> byExactExtension_;
+    std::vector<std::pair<std::string, time_t>> globFiles_;      // checked for changes
+    std::atomic<std::int64_t> nextCheck_{0};
+};
+
+std::shared_ptr<const MimeType> MimeGuessCache::lookup(const char* baseName, bool& uncertain) {
+    const char* dot = strrchr(baseName, '.');
+    // hidden files without an extension and names ending with a dot are left to GIO
+    if(!dot || dot == baseName || dot[1] == '\0') {
+        return nullptr;
+    }
+    checkDatabase();
+
+    // xdgmime only folds the ASCII letters
+    const std::string name{baseName};
+    const std::string lower = asciiLower(name);
+    const std::size_t extPos = dot + 1 - baseName;
+    const std::string ext = name.substr(extPos);
+    const std::string lowerExt = lower.substr(extPos);
+
+    std::shared_ptr<const MimeType> type;
+    {
+        std::shared_lock<std::shared_mutex> lock{mutex_};
+        if(globs_.matchesLiteralOrFullGlob(name, lower)) {
+            return nullptr;
+        }
+        auto it = byExtension_.find(lowerExt);
+        if(it != byExtension_.end() && it->second.kind == Kind::ByExactCase) {
+            auto exact = byExactExtension_.find(ext);
+            if(exact != byExactExtension_.end()) {
+                uncertain = exact->second.uncertain;
+                return exact->second.type;
+            }
+        }
+        else if(it != byExtension_.end()) {
+            uncertain = it->second.uncertain;
+            return it->second.type;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock{mutex_};
+    auto it = byExtension_.find(lowerExt);
+    if(it == byExtension_.end()) {
+        it = byExtension_.emplace(lowerExt, makeEntry(lowerExt, false)).first;
+    }
+    if(it->second.kind == Kind::ByExactCase) {
+        auto exact = byExactExtension_.find(ext);
+        if(exact == byExactExtension_.end()) {
+            exact = byExactExtension_.emplace(ext, makeEntry(ext, true)).first;
+        }
+        uncertain = exact->second.uncertain;
+        return exact->second.type;
+    }
+    uncertain = it->second.uncertain;
+    return it->second.type;
+}
+
+// should be called with the lock held
+MimeGuessCache::Entry MimeGuessCache::makeEntry(const std::string& ext, bool exactCase) const {
+    const std::string dotExt = "." + asciiLower(ext);
+    for(const auto* suffixes : {&globs_.suffixes, &globs_.csSuffixes}) {
+        for(const auto& suffix : *suffixes) {
+            if(suffix.size() > dotExt.size() && endsWith(suffix, dotExt)) {
+                return Entry{Kind::GuessEachName, nullptr, false};
+            }
+        }
+    }
+    if(!exactCase) {
+        for(const auto& suffix : globs_.csSuffixes) {
+            if(endsWith(dotExt, suffix)) {
+                return Entry{Kind::ByExactCase, nullptr, false};
+            }
+        }
+    }
+    // any name with the extension gives the same result, provided that it matches no
+    // literal or full glob, which the caller checks
+    const std::string sample = "x." + ext;
+    const std::string lowerSample = "x" + dotExt;
+    if(globs_.matchesLiteralOrFullGlob(sample, lowerSample)) {
+        return Entry{Kind::GuessEachName, nullptr, false};
+    }
+    gboolean uncertain = FALSE;
+    CStrPtr type{g_content_type_guess(sample.c_str(), nullptr, 0, &uncertain)};
+    return Entry{Kind::Cached, MimeType::fromName(type.get()), uncertain != FALSE};
+}
+
+void MimeGuessCache::checkDatabase() {
+    const std::int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch()).count();
+    std::int64_t next = nextCheck_.load(std::memory_order_relaxed);
+    if(now < next || !nextCheck_.compare_exchange_strong(next, now + 5000)) {
+        return;
+    }
+
+    // the files in the order xdgmime reads them; globs is only read if there is no globs2
+    std::vector<std::pair<std::string, time_t>> files;
+    std::vector<std::string> dirs{g_get_user_data_dir()};
+    for(auto dataDir = g_get_system_data_dirs(); *dataDir; ++dataDir) {
+        dirs.emplace_back(*dataDir);
+    }
+    for(const auto& dir : dirs) {
+        for(const char* fileName : {"/mime/globs2", "/mime/globs"}) {
+            auto path = dir + fileName;
+            struct stat st;
+            files.emplace_back(path, stat(path.c_str(), &st) == 0 ? st.st_mtime : 0);
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock{mutex_};
+    if(files == globFiles_) {
+        return;
+    }
+    globFiles_ = std::move(files);
+    globs_ = MimeGlobs{};
+    for(std::size_t i = 0; i < globFiles_.size(); i += 2) {
+        if(globFiles_[i].second != 0) {
+            globs_.load(globFiles_[i].first, true);
+        }
+        else if(globFiles_[i + 1].second != 0) {
+            globs_.load(globFiles_[i + 1].first, false);
+        }
+    }
+    byExtension_.clear();
+    byExactExtension_.clear();
+}
+
+} // namespace
+
 // static
 std::shared_ptr<const MimeType> MimeType::guessFromFileName(const char* fileName) {
-    gboolean uncertain;
+    bool uncertain;
+    return guessFromFileName(fileName, uncertain);
+}
+
+// static
+std::shared_ptr<const MimeType> MimeType::guessFromFileName(const char* fileName, bool& uncertain) {
+    static MimeGuessCache guessCache;
     /* let skip scheme and host from non-native names */
     auto uri_scheme = g_strstr_len(fileName, -1, "://");
     if(uri_scheme)
         fileName = strchr(uri_scheme + 3, '/');
     if(fileName == nullptr)
         fileName = "unknown";
-    auto type = CStrPtr{g_content_type_guess(fileName, nullptr, 0, &uncertain)};
+    const char* baseName = strrchr(fileName, '/');
+    baseName = baseName ? baseName + 1 : fileName;
+    if(auto type = guessCache.lookup(baseName, uncertain)) {
+        return type;
+    }
+    gboolean guessUncertain = FALSE;
+    auto type = CStrPtr{g_content_type_guess(fileName, nullptr, 0, &guessUncertain)};
+    uncertain = guessUncertain != FALSE;
     return fromName(type.get());
 }
 
@@ -27,6 +27,7 @@
 #include <glib.h>
 #include <gio/gio.h>
 
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <string>
@@ -85,36 +86,41 @@ public:
 
     static std::shared_ptr<const MimeType> guessFromFileName(const char* fileName);
 
+    // Also tells whether the name is not enough to be sure of the type, like g_content_type_guess().
+    // Names that only match a simple extension glob of shared-mime-info ("*.jpg") are looked up
+    // in a per-process cache of extensions instead of going through the globs each time.
+    static std::shared_ptr<const MimeType> guessFromFileName(const char* fileName, bool& uncertain);
+
     bool isUnknownType() const {
-        return g_content_type_is_unknown(name_.get());
+        return flags_ & UnknownType;
     }
 
     bool isDesktopEntry() const {
-        return this == desktopEntry().get();
+        return flags_ & DesktopEntry;
     }
 
     bool isText() const {
-        return g_content_type_is_a(name_.get(), "text/plain");
+        return flags_ & Text;
     }
 
     bool isImage() const {
-        return !std::strncmp("image/", name_.get(), 6);
+        return flags_ & Image;
     }
 
     bool isMountable() const {
-        return this == inodeMountPoint().get();
+        return flags_ & MountPoint;
     }
 
     bool isShortcut() const {
-        return this == inodeShortcut().get();
+        return flags_ & Shortcut;
     }
 
     bool isDir() const {
-        return this == inodeDirectory().get();
+        return flags_ & Directory;
     }
 
     bool canBeExecutable() const {
-        return g_content_type_can_be_executable(name_.get());
+        return flags_ & CanBeExecutable;
     }
 
     static std::shared_ptr<const MimeType> inodeDirectory() {   // inode/directory
@@ -142,6 +148,29 @@ public:
     }
 
 private:
+    // the classifications computed once by the constructor, since g_content_type_is_a()
+    // and the like walk the parents of the type in the shared-mime-info database
+    enum Flag {
+        UnknownType = 1 << 0,
+        DesktopEntry = 1 << 1,
+        Text = 1 << 2,
+        Image = 1 << 3,
+        MountPoint = 1 << 4,
+        Shortcut = 1 << 5,
+        Directory = 1 << 6,
+        CanBeExecutable = 1 << 7
+    };
+
+    // a node of the lookup table of fromName()
+    struct CacheNode;
+
+    // The MimeType objects are never freed, so fromName() looks them up without a lock in
+    // a table whose buckets only get new nodes prepended, under mutex_. The table does
+    // not grow; shared-mime-info knows about a thousand types.
+    static constexpr std::size_t cacheBucketCount = 2048;
+
+    static std::shared_ptr<const MimeType> findCached(const CacheNode* node, std::size_t hash, const char* typeName);
+
     void removeThumbnailer(std::shared_ptr<const Thumbnailer>& thumbnailer) {
         std::lock_guard<std::mutex> lock{mutex_};
         thumbnailers_.remove(thumbnailer);
@@ -157,7 +186,8 @@ private:
     CStrPtr name_;
     mutable CStrPtr desc_;
     std::forward_list<std::shared_ptr<const Thumbnailer>> thumbnailers_;
-    static std::unordered_map<const char*, std::shared_ptr<const MimeType>, CStrHash, CStrEqual> cache_;
+    unsigned int flags_;
+    static std::atomic<const CacheNode*> cacheBuckets_[cacheBucketCount];
     static std::mutex mutex_;
 
     static std::shared_ptr<const MimeType> inodeDirectory_;  // inode/directory
@@ -0,0 +1,323 @@
+#include "statxstage.h"
+
+#ifdef FM_HAVE_STATX_STAGE
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define FM_HAVE_IO_URING
+#endif
+#endif
+
+namespace Fm {
+
+std::atomic<StatxStage::Backend> StatxStage::defaultBackend_{StatxStage::Synchronous};
+
+StatxStage::~StatxStage() {
+}
+
+// static
+void StatxStage::runSynchronously(int dirFd, int flags, unsigned int mask, Request* requests, std::size_t count) {
+    for(std::size_t i = 0; i < count; ++i) {
+        auto& request = requests[i];
+        request.error = statx(dirFd, request.name, flags, mask, &request.result) == 0 ? 0 : errno;
+    }
+}
+
+namespace {
+
+class SynchronousStatxStage : public StatxStage {
+public:
+    Backend backend() const override {
+        return Synchronous;
+    }
+
+    void run(int dirFd, int flags, unsigned int mask, Request* requests, std::size_t count) override {
+        runSynchronously(dirFd, flags, mask, requests, count);
+    }
+};
+
+class ThreadPoolStatxStage : public StatxStage {
+public:
+    ThreadPoolStatxStage():
+        threadCount_{std::max(std::min(std::thread::hardware_concurrency(), 8u), 2u)} {
+    }
+
+    Backend backend() const override {
+        return ThreadPool;
+    }
+
+    // NOTE: The threads are started for each batch, which costs much less than the
+    // statx() calls of a batch, and avoids waiting for a pool that may be busy.
+    void run(int dirFd, int flags, unsigned int mask, Request* requests, std::size_t count) override {
+        if(count < minBatchSize) {
+            runSynchronously(dirFd, flags, mask, requests, count);
+            return;
+        }
+        const std::size_t chunkSize = 16;
+        std::atomic<std::size_t> next{0};
+        auto worker = [&]() {
+            for(;;) {
+                std::size_t first = next.fetch_add(chunkSize, std::memory_order_relaxed);
+                if(first >= count) {
+                    break;
+                }
+                runSynchronously(dirFd, flags, mask, requests + first, std::min(chunkSize, count - first));
+            }
+        };
+        const unsigned int n_threads = std::min<std::size_t>(threadCount_, count / chunkSize);
+        std::vector<std::thread> threads;
+        threads.reserve(n_threads);
+        for(unsigned int i = 1; i < n_threads; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker(); // the calling thread is one of the workers
+        for(auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+private:
+    unsigned int threadCount_;
+};
+
+#ifdef FM_HAVE_IO_URING
+
+// A minimal io_uring of IORING_OP_STATX requests, set up with the raw system calls
+// so that liburing is not needed.
+class IoUringStatxStage : public StatxStage {
+public:
+    IoUringStatxStage():
+        ringFd_{-1},
+        sqRing_{MAP_FAILED},
+        cqRing_{MAP_FAILED},
+        sqes_{MAP_FAILED},
+        sqRingSize_{0},
+        cqRingSize_{0},
+        sqesSize_{0},
+        broken_{false} {
+    }
+
+    ~IoUringStatxStage() override {
+        if(sqes_ != MAP_FAILED) {
+            munmap(sqes_, sqesSize_);
+        }
+        if(cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+            munmap(cqRing_, cqRingSize_);
+        }
+        if(sqRing_ != MAP_FAILED) {
+            munmap(sqRing_, sqRingSize_);
+        }
+        if(ringFd_ >= 0) {
+            close(ringFd_);
+        }
+    }
+
+    // Sets up the ring and checks that the kernel supports IORING_OP_STATX (Linux 5.6).
+    bool init(unsigned int entries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if(ringFd_ < 0) {
+            return false;
+        }
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if(singleMmap) {
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        }
+        sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+        if(sqRing_ == MAP_FAILED) {
+            return false;
+        }
+        cqRing_ = singleMmap ? sqRing_
+                             : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        if(cqRing_ == MAP_FAILED) {
+            return false;
+        }
+        sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes_ = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+        if(sqes_ == MAP_FAILED) {
+            return false;
+        }
+        auto sq = static_cast<char*>(sqRing_);
+        sqHead_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+        sqEntries_ = params.sq_entries;
+        auto cq = static_cast<char*>(cqRing_);
+        cqHead_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // older kernels fail the unknown operation with EINVAL
+        Request probe{".", 0, {}};
+        return submitAndWait(AT_FDCWD, 0, STATX_TYPE, &probe, 1) && probe.error != EINVAL;
+    }
+
+    Backend backend() const override {
+        return IoUring;
+    }
+
+    void run(int dirFd, int flags, unsigned int mask, Request* requests, std::size_t count) override {
+        if(count < minBatchSize) {
+            runSynchronously(dirFd, flags, mask, requests, count);
+            return;
+        }
+        if(broken_) {
+            runSynchronously(dirFd, flags, mask, requests, count);
+        }
+        else if(!submitAndWait(dirFd, flags, mask, requests, count)) {
+            broken_ = true; // should not happen after a successful init()
+        }
+    }
+
+private:
+    // Keeps up to sqEntries_ requests in flight until all are completed. Returns false if
+    // the ring failed, after running the requests that the kernel did not take.
+    bool submitAndWait(int dirFd, int flags, unsigned int mask, Request* requests, std::size_t count) {
+        std::size_t submitted = 0; // put in the submission queue
+        std::size_t completed = 0;
+        unsigned int pending = 0;  // in the submission queue but not taken by the kernel yet
+        while(completed < count) {
+            unsigned int tail = *sqTail_;
+            while(submitted < count && submitted - completed < sqEntries_) {
+                const unsigned int index = tail & sqMask_;
+                auto sqe = static_cast<struct io_uring_sqe*>(sqes_) + index;
+                auto& request = requests[submitted];
+                memset(sqe, 0, sizeof(*sqe));
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = dirFd;
+                sqe->addr = reinterpret_cast<std::uintptr_t>(request.name);
+                sqe->len = mask;
+                sqe->off = reinterpret_cast<std::uintptr_t>(&request.result); // the statx buffer
+                sqe->statx_flags = flags;
+                sqe->user_data = submitted;
+                sqArray_[index] = index;
+                ++tail;
+                ++submitted;
+                ++pending;
+            }
+            __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+
+            int ret;
+            do {
+                ret = static_cast<int>(syscall(__NR_io_uring_enter, ringFd_, pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+            } while(ret < 0 && errno == EINTR);
+            if(ret >= 0) {
+                pending -= std::min<unsigned int>(ret, pending);
+            }
+            else if(errno != EAGAIN && errno != EBUSY) {
+                // take back the requests the kernel did not see and finish the others
+                __atomic_store_n(sqTail_, tail - pending, __ATOMIC_RELEASE);
+                const std::size_t taken = submitted - pending;
+                waitForCompletions(requests, completed, taken);
+                runSynchronously(dirFd, flags, mask, requests + taken, count - taken);
+                return false;
+            }
+            reapCompletions(requests, completed);
+        }
+        return true;
+    }
+
+    void reapCompletions(Request* requests, std::size_t& completed) {
+        unsigned int head = *cqHead_;
+        const unsigned int tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        while(head != tail) {
+            const auto& cqe = cqes_[head & cqMask_];
+            requests[cqe.user_data].error = cqe.res < 0 ? -cqe.res : 0;
+            ++head;
+            ++completed;
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    }
+
+    // the buffers of the requests in flight must not be released before they are completed
+    void waitForCompletions(Request* requests, std::size_t& completed, std::size_t submitted) {
+        while(completed < submitted) {
+            reapCompletions(requests, completed);
+            if(completed < submitted
+               && syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+               && errno != EINTR) {
+                break;
+            }
+        }
+    }
+
+    int ringFd_;
+    void* sqRing_;
+    void* cqRing_;
+    void* sqes_;
+    std::size_t sqRingSize_;
+    std::size_t cqRingSize_;
+    std::size_t sqesSize_;
+    unsigned int* sqHead_;
+    unsigned int* sqTail_;
+    unsigned int* sqArray_;
+    unsigned int sqMask_;
+    unsigned int sqEntries_;
+    unsigned int* cqHead_;
+    unsigned int* cqTail_;
+    unsigned int cqMask_;
+    struct io_uring_cqe* cqes_;
+    bool broken_;
+};
+
+#endif // FM_HAVE_IO_URING
+
+} // namespace
+
+// static
+StatxStage::Backend StatxStage::defaultBackend() {
+    return defaultBackend_;
+}
+
+// static
+void StatxStage::setDefaultBackend(Backend backend) {
+    defaultBackend_ = backend;
+}
+
+// static
+std::unique_ptr<StatxStage> StatxStage::create() {
+    return create(defaultBackend_);
+}
+
+// static
+std::unique_ptr<StatxStage> StatxStage::create(Backend backend) {
+    switch(backend) {
+    case Auto:
+    case IoUring: {
+#ifdef FM_HAVE_IO_URING
+        std::unique_ptr<IoUringStatxStage> stage{new IoUringStatxStage{}};
+        if(stage->init(256)) {
+            return stage;
+        }
+#endif
+    }
+    /* Falls through. */
+    case ThreadPool:
+        return std::unique_ptr<StatxStage>{new ThreadPoolStatxStage{}};
+    case Synchronous:
+        break;
+    }
+    return std::unique_ptr<StatxStage>{new SynchronousStatxStage{}};
+}
+
+} // namespace Fm
+
+#endif // FM_HAVE_STATX_STAGE
@@ -0,0 +1,71 @@
+#ifndef FM2_STATXSTAGE_H
+#define FM2_STATXSTAGE_H
+
+#include "../libfmqtglobals.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <sys/stat.h>
+
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+#define FM_HAVE_STATX_STAGE
+#endif
+
+#ifdef FM_HAVE_STATX_STAGE
+
+namespace Fm {
+
+// Queries the metadata of many files of a local directory at once. Hundreds of statx()
+// requests are kept in flight with io_uring, or spread over a few threads where io_uring
+// is not available (old kernels, seccomp filters of containers). The backend is picked at
+// runtime. A StatxStage should only be used by one thread at a time.
+// NOTE: With warm caches, statx() is so fast that a single thread wins; io_uring even runs
+// the requests in kernel worker threads. The parallel backends pay off with cold caches and
+// slow disks, so they are only used by the jobs when they are made the default.
+class StatxStage {
+public:
+    enum Backend {
+        Auto,        // io_uring if possible, otherwise ThreadPool
+        IoUring,
+        ThreadPool,
+        Synchronous  // one statx() after another in the calling thread
+    };
+
+    struct Request {
+        const char* name; // relative to the directory
+        int error;        // 0 or the errno value of the failed statx()
+        struct statx result;
+    };
+
+    // Smaller batches are queried synchronously since starting them in parallel costs more.
+    static constexpr std::size_t minBatchSize = 64;
+
+    // The backend of the stages used by DirListJob and TotalSizeJob; Synchronous by default.
+    static Backend defaultBackend();
+
+    static void setDefaultBackend(Backend backend);
+
+    static std::unique_ptr<StatxStage> create();
+
+    // Returns a stage with the given backend, or with the next one if it is not available.
+    static std::unique_ptr<StatxStage> create(Backend backend);
+
+    virtual ~StatxStage();
+
+    virtual Backend backend() const = 0;
+
+    // Runs statx() with the given flags and mask for all the requests, and returns when all are done.
+    virtual void run(int dirFd, int flags, unsigned int mask, Request* requests, std::size_t count) = 0;
+
+protected:
+    static void runSynchronously(int dirFd, int flags, unsigned int mask, Request* requests, std::size_t count);
+
+private:
+    static std::atomic<Backend> defaultBackend_;
+};
+
+} // namespace Fm
+
+#endif // FM_HAVE_STATX_STAGE
+
+#endif // FM2_STATXSTAGE_H
@@ -0,0 +1,96 @@
+#include "thumbnailcache.h"
+
+namespace Fm {
+
+std::mutex ThumbnailCache::mutex_;
+std::list<ThumbnailCache::Entry> ThumbnailCache::entries_;
+std::unordered_map<ThumbnailCache::Key, std::list<ThumbnailCache::Entry>::iterator, ThumbnailCache::KeyHash> ThumbnailCache::index_;
+size_t ThumbnailCache::budget_ = 64 * 1024 * 1024; // 64 MiB
+size_t ThumbnailCache::bytes_ = 0;
+quint64 ThumbnailCache::hits_ = 0;
+quint64 ThumbnailCache::misses_ = 0;
+quint64 ThumbnailCache::evictions_ = 0;
+
+QImage ThumbnailCache::lookup(const FilePath& path, quint64 mtime, int size) {
+    return find(path, mtime, size, true);
+}
+
+QImage ThumbnailCache::peek(const FilePath& path, quint64 mtime, int size) {
+    return find(path, mtime, size, false);
+}
+
+QImage ThumbnailCache::find(const FilePath& path, quint64 mtime, int size, bool countMiss) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = index_.find(Key{path, mtime, size});
+    if(it == index_.end()) {
+        if(countMiss) {
+            ++misses_;
+        }
+        return QImage();
+    }
+    ++hits_;
+    // move the entry to the front
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->image;
+}
+
+void ThumbnailCache::insert(const FilePath& path, quint64 mtime, int size, const QImage& image) {
+    if(image.isNull()) {
+        return;
+    }
+    size_t bytes = static_cast<size_t>(image.sizeInBytes());
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(bytes > budget_) {
+        return;
+    }
+    Key key{path, mtime, size};
+    auto it = index_.find(key);
+    if(it != index_.end()) {
+        bytes_ -= it->second->bytes;
+        it->second->image = image;
+        it->second->bytes = bytes;
+        entries_.splice(entries_.begin(), entries_, it->second);
+    }
+    else {
+        entries_.push_front(Entry{key, image, bytes});
+        index_.emplace(std::move(key), entries_.begin());
+    }
+    bytes_ += bytes;
+    evict(budget_);
+}
+
+void ThumbnailCache::clear() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    index_.clear();
+    entries_.clear();
+    bytes_ = 0;
+}
+
+size_t ThumbnailCache::memoryBudget() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return budget_;
+}
+
+void ThumbnailCache::setMemoryBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    budget_ = bytes;
+    evict(budget_);
+}
+
+ThumbnailCache::Stats ThumbnailCache::stats() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return Stats{hits_, misses_, evictions_, entries_.size(), bytes_};
+}
+
+// should be called with the lock held
+void ThumbnailCache::evict(size_t budget) {
+    while(bytes_ > budget && !entries_.empty()) {
+        auto& entry = entries_.back();
+        bytes_ -= entry.bytes;
+        index_.erase(entry.key);
+        entries_.pop_back();
+        ++evictions_;
+    }
+}
+
+} // namespace Fm
@@ -0,0 +1,84 @@
+#ifndef FM2_THUMBNAILCACHE_H
+#define FM2_THUMBNAILCACHE_H
+
+#include "../libfmqtglobals.h"
+#include "filepath.h"
+#include <QImage>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace Fm {
+
+// A process-wide LRU cache of decoded thumbnails, shared by all folder models and
+// thumbnail jobs. The entries are keyed by the file path, its modification time and
+// the thumbnail size, and the total size of the cached images is kept under a budget.
+// All methods are thread-safe.
+class LIBFM_QT_API ThumbnailCache {
+public:
+    struct Stats {
+        quint64 hits;
+        quint64 misses;
+        quint64 evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    // Returns a null image if the thumbnail is not cached.
+    static QImage lookup(const FilePath& path, quint64 mtime, int size);
+
+    // Like lookup(), but a miss is not counted in the stats, for callers that then start
+    // a ThumbnailJob, which looks the thumbnail up again.
+    static QImage peek(const FilePath& path, quint64 mtime, int size);
+
+    static void insert(const FilePath& path, quint64 mtime, int size, const QImage& image);
+
+    static void clear();
+
+    static size_t memoryBudget();
+
+    // The budget is in bytes. Zero disables the cache.
+    static void setMemoryBudget(size_t bytes);
+
+    static Stats stats();
+
+private:
+    static QImage find(const FilePath& path, quint64 mtime, int size, bool countMiss);
+
+    struct Key {
+        FilePath path;
+        quint64 mtime;
+        int size;
+
+        bool operator==(const Key& other) const {
+            return mtime == other.mtime && size == other.size && path == other.path;
+        }
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            return key.path.hash() ^ (std::hash<quint64>()(key.mtime) * 31 + key.size);
+        }
+    };
+
+    struct Entry {
+        Key key;
+        QImage image;
+        size_t bytes;
+    };
+
+    static void evict(size_t budget);
+
+    static std::mutex mutex_;
+    static std::list<Entry> entries_; // the most recently used first
+    static std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+    static size_t budget_;
+    static size_t bytes_;
+    static quint64 hits_;
+    static quint64 misses_;
+    static quint64 evictions_;
+};
+
+} // namespace Fm
+
+#endif // FM2_THUMBNAILCACHE_H
@@ -4,8 +4,11 @@
 #include <algorithm>
 #include <libexif/exif-loader.h>
 #include <QImageReader>
+#include <QBuffer>
 #include <QDir>
+#include <QSaveFile>
 #include "thumbnailer.h"
+#include "thumbnailcache.h"
 
 #include <algorithm>
 
@@ -14,10 +17,14 @@
 namespace Fm {
 
 QThreadPool* ThumbnailJob::threadPool_ = nullptr;
+QThreadPool* ThumbnailJob::remoteThreadPool_ = nullptr;
+int ThumbnailJob::maxThreadCount_ = 0; // the number of CPU cores
+int ThumbnailJob::maxRemoteThreadCount_ = 2;
 
 bool ThumbnailJob::localFilesOnly_ = true;
 int ThumbnailJob::maxThumbnailFileSize_ = 4096; // in KiB
 int ThumbnailJob::maxExternalThumbnailFileSize_ = -1;
+int ThumbnailJob::maxThumbnailImageSize_ = 32; // in megapixels
 
 ThumbnailJob::ThumbnailJob(FileInfoList files, int size, bool isRemote):
     files_{std::move(files)},
@@ -42,7 +49,39 @@ void ThumbnailJob::exec() {
     }
 }
 
-QImage ThumbnailJob::readImageFromStream(GInputStream* stream, size_t len) {
+QImage ThumbnailJob::readImage(QImageReader& reader, int targetSize, bool& tooLarge) {
+    // EXIF orientation is handled by readJpegExif()
+    reader.setAutoTransform(false);
+    QSize size = reader.size();
+    if(size.isValid() && (size.width() > targetSize || size.height() > targetSize)) {
+        if(reader.format() == "jpeg") {
+            // libjpeg can decode at 1/2, 1/4 or 1/8 of the size, so that the full-resolution
+            // image is never held in memory, but Qt only does it with a low quality. Ask for
+            // the smallest such size that is not smaller than the thumbnail, which is then
+            // scaled smoothly by the caller.
+            int denom = 1;
+            while(denom < 8 && std::max(size.width(), size.height()) / (denom * 2) >= targetSize) {
+                denom *= 2;
+            }
+            if(denom > 1) {
+                reader.setQuality(0);
+                reader.setScaledSize(QSize{std::max(size.width() / denom, 1), std::max(size.height() / denom, 1)});
+            }
+        }
+        else {
+            // other formats (even PNG, whose handler supports ScaledSize) are decoded at
+            // full size and scaled afterwards, so huge ones are not decoded at all
+            if(static_cast<qint64>(size.width()) * size.height() > static_cast<qint64>(maxThumbnailImageSize_) * 1000000) {
+                tooLarge = true;
+                return QImage();
+            }
+            reader.setScaledSize(size.scaled(targetSize, targetSize, Qt::KeepAspectRatio));
+        }
+    }
+    return reader.read();
+}
+
+QImage ThumbnailJob::readImageFromStream(GInputStream* stream, size_t len, int targetSize, bool& tooLarge) {
     // The size limit has been set in generateThumbnail().
     std::unique_ptr<unsigned char[]> buffer{new unsigned char[len]}; // allocate enough buffer
     unsigned char* pbuffer = buffer.get();
@@ -59,9 +98,10 @@ QImage ThumbnailJob::readImageFromStream(GInputStream* stream, size_t len) {
         totalReadSize += readSize;
         pbuffer += readSize;
     }
-    QImage image;
-    image.loadFromData(buffer.get(), totalReadSize);
-    return image;
+    QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(buffer.get()), totalReadSize);
+    QBuffer device{&data};
+    QImageReader reader{&device};
+    return readImage(reader, targetSize, tooLarge);
 }
 
 QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo> &file) {
@@ -73,6 +113,13 @@ QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo> &file) {
         return QImage();
     }
 
+    // the thumbnail may have been decoded for another folder model
+    auto origPath = file->path();
+    QImage cached = ThumbnailCache::lookup(origPath, file->mtime(), size_);
+    if(!cached.isNull()) {
+        return cached;
+    }
+
     // thumbnails are stored in $XDG_CACHE_HOME/thumbnails/large|normal|failed
     QString thumbnailDir{QString::fromUtf8(g_get_user_cache_dir())};
     thumbnailDir += QLatin1StringView("/thumbnails/");
@@ -88,7 +135,6 @@ QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo> &file) {
     thumbnailDir += subdir;
 
     // generate base name of the thumbnail  => {md5 of uri}.png
-    auto origPath = file->path();
     CStrPtr uri;
     if(file->isSymlink()) {
         // use the symlink target in the name to update the thumbnail
@@ -135,9 +181,20 @@ QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo> &file) {
     if(thumbnail.width() > size_ || thumbnail.height() > size_) {
         thumbnail = thumbnail.scaled(size_, size_, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     }
+    ThumbnailCache::insert(origPath, file->mtime(), size_, thumbnail);
     return thumbnail;
 }
 
+// Thumbnails of the same file may be generated by parallel jobs, so
+// write to a temporary file and rename it to avoid reading partial PNGs.
+static bool saveThumbnail(const QImage& image, const QString& filename) {
+    QSaveFile file{filename};
+    if(!file.open(QIODevice::WriteOnly) || !image.save(&file, "PNG")) {
+        return false;
+    }
+    return file.commit();
+}
+
 bool ThumbnailJob::isSupportedImageType(const std::shared_ptr<const MimeType>& mimeType) const {
     if(mimeType->isImage()) {
         auto supportedTypes = QImageReader::supportedMimeTypes();
@@ -233,17 +290,32 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
                 fromExif = true;
             }
         }
+        int target_size = size_ > 256 ? 512 : size_ > 128 ? 256 : 128;
+        bool tooLarge = false;
         if(!fromExif) {  // not able to generate a thumbnail from the EXIF data
             // load the original file and do the scaling ourselves
-            g_seekable_seek(G_SEEKABLE(ins.get()), 0, G_SEEK_SET, cancellable_.get(), nullptr);
-            result = readImageFromStream(G_INPUT_STREAM(ins.get()), file->size());
+            if(origPath.isNative()) {
+                // let the image reader read the file as it decodes it, instead of reading
+                // the whole file into memory, so that large images don't need large buffers
+                g_input_stream_close(G_INPUT_STREAM(ins.get()), nullptr, nullptr);
+                QImageReader reader{QString::fromLocal8Bit(origPath.localPath().get())};
+                result = readImage(reader, target_size, tooLarge);
+            }
+            else {
+                g_seekable_seek(G_SEEKABLE(ins.get()), 0, G_SEEK_SET, cancellable_.get(), nullptr);
+                result = readImageFromStream(G_INPUT_STREAM(ins.get()), file->size(), target_size, tooLarge);
+            }
+        }
+        if(!g_input_stream_is_closed(G_INPUT_STREAM(ins.get()))) {
+            g_input_stream_close(G_INPUT_STREAM(ins.get()), nullptr, nullptr);
+        }
+        if(tooLarge) {
+            // an external thumbnailer, if any, decodes the image in its own process
+            return generateExternalThumbnail(file, uri, thumbnailFilename);
         }
-        g_input_stream_close(G_INPUT_STREAM(ins.get()), nullptr, nullptr);
 
         if(!result.isNull()) { // the image is successfully loaded
             // scale the image as needed
-            int target_size = size_ > 256 ? 512 : size_ > 128 ? 256 : 128;
-
             // only scale the original image if it's too large
             if(result.width() > target_size || result.height() > target_size) {
                 result = result.scaled(target_size, target_size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
@@ -257,41 +329,47 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
             if(!fromExif) {
                 result.setText(QStringLiteral("Thumb::MTime"), QString::number(file->mtime()));
                 result.setText(QStringLiteral("Thumb::URI"), QString::fromUtf8(uri));
-                result.save(thumbnailFilename, "PNG");
+                saveThumbnail(result, thumbnailFilename);
             }
             // qDebug() << "save thumbnail:" << thumbnailFilename;
         }
     }
     else { // the image format is not supported, try to find an external thumbnailer
-        if (maxExternalThumbnailFileSize_ >= 0
-            && file->size() > static_cast<uint64_t>(maxExternalThumbnailFileSize_) * 1024) {
-            return result;
+        result = generateExternalThumbnail(file, uri, thumbnailFilename);
+    }
+    return result;
+}
+
+QImage ThumbnailJob::generateExternalThumbnail(const std::shared_ptr<const FileInfo>& file, const char* uri, const QString& thumbnailFilename) {
+    QImage result;
+    if (maxExternalThumbnailFileSize_ >= 0
+        && file->size() > static_cast<uint64_t>(maxExternalThumbnailFileSize_) * 1024) {
+        return result;
+    }
+    // try all available external thumbnailers for it until success
+    int target_size = size_ > 256 ? 512 : size_ > 128 ? 256 : 128;
+    file->mimeType()->forEachThumbnailer([&](const std::shared_ptr<const Thumbnailer>& thumbnailer) {
+        if(thumbnailer->run(uri, thumbnailFilename.toLocal8Bit().constData(), target_size)) {
+            result = QImage(thumbnailFilename);
         }
-        // try all available external thumbnailers for it until success
-        int target_size = size_ > 256 ? 512 : size_ > 128 ? 256 : 128;
-        file->mimeType()->forEachThumbnailer([&](const std::shared_ptr<const Thumbnailer>& thumbnailer) {
-            if(thumbnailer->run(uri, thumbnailFilename.toLocal8Bit().constData(), target_size)) {
-                result = QImage(thumbnailFilename);
-            }
-            return !result.isNull(); // return true on success, and forEachThumbnailer() will stop.
-        });
-
-        if(!result.isNull()) {
-            // Some thumbnailers did not write the proper metadata required by the xdg spec to the output (such as evince-thumbnailer)
-            // Here we waste some time to fix them so next time we don't need to re-generate these thumbnails. :-(
-            bool changed = false;
-            if(Q_UNLIKELY(result.text(QStringLiteral("Thumb::MTime")).isEmpty())) {
-                result.setText(QStringLiteral("Thumb::MTime"), QString::number(file->mtime()));
-                changed = true;
-            }
-            if(Q_UNLIKELY(result.text(QStringLiteral("Thumb::URI")).isEmpty())) {
-                result.setText(QStringLiteral("Thumb::URI"), QString::fromUtf8(uri));
-                changed = true;
-            }
-            if(Q_UNLIKELY(changed)) {
-                // save the modified PNG file containing metadata to a file.
-                result.save(thumbnailFilename, "PNG");
-            }
+        return !result.isNull(); // return true on success, and forEachThumbnailer() will stop.
+    });
+
+    if(!result.isNull()) {
+        // Some thumbnailers did not write the proper metadata required by the xdg spec to the output (such as evince-thumbnailer)
+        // Here we waste some time to fix them so next time we don't need to re-generate these thumbnails. :-(
+        bool changed = false;
+        if(Q_UNLIKELY(result.text(QStringLiteral("Thumb::MTime")).isEmpty())) {
+            result.setText(QStringLiteral("Thumb::MTime"), QString::number(file->mtime()));
+            changed = true;
+        }
+        if(Q_UNLIKELY(result.text(QStringLiteral("Thumb::URI")).isEmpty())) {
+            result.setText(QStringLiteral("Thumb::URI"), QString::fromUtf8(uri));
+            changed = true;
+        }
+        if(Q_UNLIKELY(changed)) {
+            // save the modified PNG file containing metadata to a file.
+            saveThumbnail(result, thumbnailFilename);
         }
     }
     return result;
@@ -300,11 +378,42 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
 QThreadPool* ThumbnailJob::threadPool() {
     if(Q_UNLIKELY(threadPool_ == nullptr)) {
         threadPool_ = new QThreadPool();
-        threadPool_->setMaxThreadCount(1);
+        threadPool_->setMaxThreadCount(maxThreadCount());
     }
     return threadPool_;
 }
 
+QThreadPool* ThumbnailJob::remoteThreadPool() {
+    if(Q_UNLIKELY(remoteThreadPool_ == nullptr)) {
+        remoteThreadPool_ = new QThreadPool();
+        remoteThreadPool_->setMaxThreadCount(maxRemoteThreadCount());
+    }
+    return remoteThreadPool_;
+}
+
+int ThumbnailJob::maxThreadCount() {
+    return maxThreadCount_ > 0 ? maxThreadCount_ : std::max(QThread::idealThreadCount(), 1);
+}
+
+void ThumbnailJob::setMaxThreadCount(int count) {
+    maxThreadCount_ = std::max(count, 0);
+    if(threadPool_) {
+        threadPool_->setMaxThreadCount(maxThreadCount());
+    }
+}
+
+int ThumbnailJob::maxRemoteThreadCount() {
+    // too many parallel reads are slow on remote file systems
+    return std::min(maxRemoteThreadCount_ > 0 ? maxRemoteThreadCount_ : 2, maxThreadCount());
+}
+
+void ThumbnailJob::setMaxRemoteThreadCount(int count) {
+    maxRemoteThreadCount_ = std::max(count, 0);
+    if(remoteThreadPool_) {
+        remoteThreadPool_->setMaxThreadCount(maxRemoteThreadCount());
+    }
+}
+
 void ThumbnailJob::setLocalFilesOnly(bool value) {
     localFilesOnly_ = value;
     if(fm_config) {
@@ -326,5 +435,9 @@ void ThumbnailJob::setMaxExternalThumbnailFileSize(int size) {
     }
 }
 
+void ThumbnailJob::setMaxThumbnailImageSize(int megapixels) {
+    maxThumbnailImageSize_ = std::max(megapixels, 1);
+}
+
 
 } // namespace Fm
@@ -6,6 +6,9 @@
 #include "gioptrs.h"
 #include "job.h"
 #include <QThreadPool>
+#include <QThread>
+
+class QImageReader;
 
 namespace Fm {
 
@@ -21,8 +24,33 @@ public:
         return size_;
     }
 
+    bool isRemote() const {
+        return isRemote_;
+    }
+
+    const FileInfoList& files() const {
+        return files_;
+    }
+
+    // the thread pool for thumbnails of local files
     static QThreadPool* threadPool();
 
+    // the thread pool for thumbnails of remote files, which has fewer threads
+    static QThreadPool* remoteThreadPool();
+
+    static QThreadPool* threadPool(bool isRemote) {
+        return isRemote ? remoteThreadPool() : threadPool();
+    }
+
+    static int maxThreadCount();
+
+    // A non-positive value means the number of CPU cores.
+    static void setMaxThreadCount(int count);
+
+    static int maxRemoteThreadCount();
+
+    static void setMaxRemoteThreadCount(int count);
+
     static void setLocalFilesOnly(bool value);
 
     static bool localFilesOnly() {
@@ -41,6 +69,20 @@ public:
 
     static void setMaxExternalThumbnailFileSize(int size);
 
+    // The largest image, in megapixels, that is decoded at full size to make its thumbnail;
+    // larger ones are left to the external thumbnailers. JPEG images are not limited since
+    // they are downscaled while being decoded.
+    static int maxThumbnailImageSize() {
+        return maxThumbnailImageSize_;
+    }
+
+    static void setMaxThumbnailImageSize(int megapixels);
+
+    // Reads the image for a thumbnail of targetSize; the result may still be larger than
+    // targetSize. Sets tooLarge, without decoding the image, if it is larger than
+    // maxThumbnailImageSize().
+    static QImage readImage(QImageReader& reader, int targetSize, bool& tooLarge);
+
     const std::vector<QImage>& results() const {
         return results_;
     }
@@ -60,7 +102,9 @@ private:
 
     QImage generateThumbnail(const std::shared_ptr<const FileInfo>& file, const FilePath& origPath, const char* uri, const QString& thumbnailFilename);
 
-    QImage readImageFromStream(GInputStream* stream, size_t len);
+    QImage generateExternalThumbnail(const std::shared_ptr<const FileInfo>& file, const char* uri, const QString& thumbnailFilename);
+
+    QImage readImageFromStream(GInputStream* stream, size_t len, int targetSize, bool& tooLarge);
 
     QImage loadForFile(const std::shared_ptr<const FileInfo>& file);
 
@@ -75,10 +119,14 @@ private:
     GChecksum* md5Calc_;
 
     static QThreadPool* threadPool_;
+    static QThreadPool* remoteThreadPool_;
+    static int maxThreadCount_;
+    static int maxRemoteThreadCount_;
 
     static bool localFilesOnly_;
     static int maxThumbnailFileSize_;
     static int maxExternalThumbnailFileSize_;
+    static int maxThumbnailImageSize_;
 };
 
 } // namespace Fm
@@ -1,145 +1,459 @@
 #include "totalsizejob.h"
+#include "fileinfo_p.h"
+#include "statxstage.h"
+#include <QThread>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace Fm {
 
-static const char query_str[] =
-    G_FILE_ATTRIBUTE_STANDARD_TYPE","
-    G_FILE_ATTRIBUTE_STANDARD_NAME","
-    G_FILE_ATTRIBUTE_STANDARD_IS_VIRTUAL","
-    G_FILE_ATTRIBUTE_STANDARD_SIZE","
-    G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE","
-    G_FILE_ATTRIBUTE_ID_FILESYSTEM;
+// the totals are accumulated per directory before being added to the job
+struct TotalSizeJob::Totals {
+    std::uint64_t size = 0;
+    std::uint64_t ondiskSize = 0;
+    unsigned int count = 0;
+};
+
+// a directory whose children are not counted yet
+struct TotalSizeJob::DirTask {
+    FilePath path;
+    std::string localPath; // only set for the native code path
+};
+
+// A work-stealing queue of directories. A worker takes the directories it has pushed
+// in LIFO order, and when it runs out of them, it steals the oldest directories of the
+// other workers, which are usually the roots of the largest remaining subtrees.
+class TotalSizeJob::DirQueue {
+public:
+    explicit DirQueue(int n_workers):
+        deques_(n_workers),
+        pending_{0},
+        queued_{0} {
+    }
+
+    bool empty() const {
+        return pending_ == 0;
+    }
+
+    void push(int worker, DirTask task) {
+        // the waiting workers check the counters under idleMutex_, so a notification is not lost
+        std::lock_guard<std::mutex> idleLock{idleMutex_};
+        ++pending_;
+        {
+            std::lock_guard<std::mutex> lock{deques_[worker].mutex};
+            deques_[worker].tasks.push_back(std::move(task));
+            ++queued_;
+        }
+        idleCond_.notify_one();
+    }
+
+    bool pop(int worker, DirTask& task) {
+        const size_t n_workers = deques_.size();
+        for(size_t i = 0; i < n_workers; ++i) {
+            auto& deque = deques_[(worker + i) % n_workers];
+            std::lock_guard<std::mutex> lock{deque.mutex};
+            if(!deque.tasks.empty()) {
+                if(i == 0) {
+                    task = std::move(deque.tasks.back());
+                    deque.tasks.pop_back();
+                }
+                else {
+                    task = std::move(deque.tasks.front());
+                    deque.tasks.pop_front();
+                }
+                --queued_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // should be called when a popped task is processed
+    void taskDone() {
+        std::lock_guard<std::mutex> lock{idleMutex_};
+        if(--pending_ == 0) {
+            idleCond_.notify_all();
+        }
+    }
+
+    // waits for other workers to push tasks; returns false if all tasks are done
+    bool waitForTasks() {
+        std::unique_lock<std::mutex> lock{idleMutex_};
+        idleCond_.wait(lock, [this]() {
+            return pending_ == 0 || queued_ != 0;
+        });
+        return pending_ != 0;
+    }
+
+private:
+    struct Deque {
+        std::mutex mutex;
+        std::deque<DirTask> tasks;
+    };
+
+    std::vector<Deque> deques_;
+    std::atomic<size_t> pending_; // the tasks that are queued or being processed
+    std::atomic<size_t> queued_; // the tasks that are queued
+    std::mutex idleMutex_;
+    std::condition_variable idleCond_;
+};
 
 
 TotalSizeJob::TotalSizeJob(FilePathList paths, Flags flags):
     paths_{std::move(paths)},
     flags_{flags},
+    threadCount_{0},
     totalSize_{0},
     totalOndiskSize_{0},
     fileCount_{0},
     dest_fs_id{nullptr} {
 }
 
+int TotalSizeJob::threadCount() const {
+    return threadCount_ > 0 ? threadCount_ : std::max(QThread::idealThreadCount(), 1);
+}
+
+void TotalSizeJob::addTotals(const Totals& totals) {
+    totalSize_ += totals.size;
+    totalOndiskSize_ += totals.ondiskSize;
+    fileCount_ += totals.count;
+}
+
+Job::ErrorAction TotalSizeJob::emitErrorLocked(const GErrorPtr& err) {
+    std::lock_guard<std::mutex> lock{errorMutex_};
+    if(isCancelled()) {
+        return ErrorAction::CONTINUE;
+    }
+    return emitError(err, ErrorSeverity::MILD);
+}
+
+TotalSizeJob::DirTask TotalSizeJob::makeDirTask(const FilePath& path) const {
+    // The native code path does not know GIO filesystem IDs.
+    if(dest_fs_id == nullptr && path.isNative()) {
+        return DirTask{FilePath{}, path.localPath().get()};
+    }
+    return DirTask{path, std::string{}};
+}
 
-void TotalSizeJob::exec(FilePath path, GFileInfoPtr inf) {
-    GFileType type;
+// Counts a file and returns true if its children should be counted too.
+bool TotalSizeJob::countFile(const FilePath& path, GFileInfo* inf, Totals& totals) {
+    GFileType type = g_file_info_get_file_type(inf);
     const char* fs_id;
-    bool descend;
+    bool descend = true;
+
+    ++totals.count;
+    /* SF bug #892: dir file size is not relevant in the summary */
+    if(type != G_FILE_TYPE_DIRECTORY) {
+        totals.size += g_file_info_get_attribute_uint64(inf, G_FILE_ATTRIBUTE_STANDARD_SIZE);
+    }
+    totals.ondiskSize += g_file_info_get_attribute_uint64(inf, G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE);
+
+    /* prepare for moving across different devices */
+    if(flags_ & PREPARE_MOVE) {
+        fs_id = g_file_info_get_attribute_string(inf, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+        if(fs_id && dest_fs_id && (strcmp(fs_id, dest_fs_id) == 0 || g_str_has_prefix(fs_id, "trash"))) {
+            // same filesystem or move from trash:///
+            descend = false;
+        }
+        else {
+            /* files on different device requires an additional 'delete' for the source file. */
+            ++totals.size; /* this is for the additional delete */
+            ++totals.ondiskSize;
+            ++totals.count;
+            descend = true;
+        }
+    }
+
+    if(type != G_FILE_TYPE_DIRECTORY) {
+        return false;
+    }
+    /* check if we need to decends into the dir. */
+    /* trash:/// doesn't support deleting files recursively (but we want to descend into trash root "trash:///" */
+    if(flags_ & PREPARE_DELETE && path.hasUriScheme("trash") && path.baseName()[0] != '/') {
+        descend = false;
+    }
+    else {
+        /* only descends into files on the same filesystem */
+        if(flags_ & SAME_FS) {
+            fs_id = g_file_info_get_attribute_string(inf, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+            descend = (g_strcmp0(fs_id, dest_fs_id) == 0);
+        }
+    }
+    return descend;
+}
+
+// The same as countFile() for the native code path, which is only used
+// when there is no destination filesystem ID to compare with.
+bool TotalSizeJob::countNativeFile(mode_t mode, std::uint64_t size, std::uint64_t blocks, Totals& totals) {
+    bool isDir = S_ISDIR(mode);
+    ++totals.count;
+    if(!isDir) {
+        totals.size += size;
+    }
+    totals.ondiskSize += blocks * 512;
+
+    if(flags_ & PREPARE_MOVE) {
+        /* files on different device requires an additional 'delete' for the source file. */
+        ++totals.size;
+        ++totals.ondiskSize;
+        ++totals.count;
+    }
+
+    if(!isDir) {
+        return false;
+    }
+    // a local file always has a filesystem ID, which differs from the null destination ID
+    return !(flags_ & SAME_FS);
+}
 
-_retry_query_info:
-    if(!inf) {
+void TotalSizeJob::countPath(const FilePath& path, DirQueue& queue) {
+    GFileInfoPtr inf;
+    while(!inf) {
         GErrorPtr err;
         inf = GFileInfoPtr {
-            g_file_query_info(path.gfile().get(), query_str,
+            g_file_query_info(path.gfile().get(), gFileInfoQueryAttribs(GFileInfoQuery::Count),
             (flags_ & FOLLOW_LINKS) ? G_FILE_QUERY_INFO_NONE : G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
             cancellable().get(), &err),
             false
         };
         if(!inf) {
-            ErrorAction act = emitError( err, ErrorSeverity::MILD);
-            err = nullptr;
-            if(act == ErrorAction::RETRY) {
-                goto _retry_query_info;
+            ErrorAction act = emitErrorLocked(err);
+            if(act != ErrorAction::RETRY) {
+                return;
             }
-            return;
         }
     }
     if(isCancelled()) {
         return;
     }
+    Totals totals;
+    bool descend = countFile(path, inf.get(), totals);
+    addTotals(totals);
+    if(descend) {
+        queue.push(0, makeDirTask(path));
+    }
+}
 
-    type = g_file_info_get_file_type(inf.get());
-    descend = true;
-
-    ++fileCount_;
-    /* SF bug #892: dir file size is not relevant in the summary */
-    if(type != G_FILE_TYPE_DIRECTORY) {
-        totalSize_ += g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_STANDARD_SIZE);
+void TotalSizeJob::countDirGio(const FilePath& path, DirQueue& queue, int worker) {
+    GFileEnumeratorPtr enu;
+    while(!enu) {
+        GErrorPtr err;
+        enu = GFileEnumeratorPtr {
+            g_file_enumerate_children(path.gfile().get(), gFileInfoQueryAttribs(GFileInfoQuery::Count),
+            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+            cancellable().get(), &err),
+            false
+        };
+        if(!enu) {
+            ErrorAction act = emitErrorLocked(err);
+            if(act != ErrorAction::RETRY) {
+                return;
+            }
+        }
     }
-    totalOndiskSize_ += g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE);
 
-    /* prepare for moving across different devices */
-    if(flags_ & PREPARE_MOVE) {
-        fs_id = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM);
-        if(fs_id && dest_fs_id && (strcmp(fs_id, dest_fs_id) == 0 || g_str_has_prefix(fs_id, "trash"))) {
-            // same filesystem or move from trash:///
-            descend = false;
+    Totals totals;
+    while(!isCancelled()) {
+        GErrorPtr err;
+        GFileInfoPtr inf{g_file_enumerator_next_file(enu.get(), cancellable().get(), &err), false};
+        if(inf) {
+            FilePath child = path.child(g_file_info_get_name(inf.get()));
+            if(!child) {
+                if(g_file_info_get_file_type(inf.get()) == G_FILE_TYPE_DIRECTORY) {
+                    // we won't be able to enumerate its children
+                    ++totals.count;
+                }
+            }
+            else if(countFile(child, inf.get(), totals)) {
+                queue.push(worker, makeDirTask(child));
+            }
         }
         else {
-            /* files on different device requires an additional 'delete' for the source file. */
-            ++totalSize_; /* this is for the additional delete */
-            ++totalOndiskSize_;
-            ++fileCount_;
-            descend = true;
+            if(err) { /* error! */
+                /* ErrorAction::RETRY is not supported */
+                emitErrorLocked(err);
+            }
+            else {
+                /* EOF is reached, do nothing. */
+                break;
+            }
         }
     }
+    g_file_enumerator_close(enu.get(), nullptr, nullptr);
+    addTotals(totals);
+}
 
-    if(type == G_FILE_TYPE_DIRECTORY) {
-        /* check if we need to decends into the dir. */
-        /* trash:/// doesn't support deleting files recursively (but we want to descend into trash root "trash:///" */
-        if(flags_ & PREPARE_DELETE && path.hasUriScheme("trash") && path.baseName()[0] != '/') {
-            descend = false;
+// counts the children of a local directory with openat(), readdir() and the statx stage
+// of the worker, or fstatat() where there is no such stage
+void TotalSizeJob::countDirNative(const std::string& localPath, DirQueue& queue, int worker, StatxStage* stage) {
+    auto makeError = [&localPath](int errsv, const char* name) {
+        std::string path = localPath;
+        if(name) {
+            path += '/';
+            path += name;
         }
-        else {
-            /* only descends into files on the same filesystem */
-            if(flags_ & SAME_FS) {
-                fs_id = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM);
-                descend = (g_strcmp0(fs_id, dest_fs_id) == 0);
+        QString msg = QObject::tr("Error reading '%1': %2").arg(QString::fromLocal8Bit(path.c_str()),
+                                                                QString::fromLocal8Bit(g_strerror(errsv)));
+        return GErrorPtr{G_IO_ERROR, static_cast<unsigned int>(g_io_error_from_errno(errsv)), msg};
+    };
+
+    DIR* dir = nullptr;
+    while(!dir) {
+        int fd = openat(AT_FDCWD, localPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(fd >= 0) {
+            dir = fdopendir(fd);
+            if(!dir) {
+                int errsv = errno;
+                close(fd);
+                errno = errsv;
+            }
+        }
+        if(!dir) {
+            ErrorAction act = emitErrorLocked(makeError(errno, nullptr));
+            if(act != ErrorAction::RETRY) {
+                return;
             }
         }
+    }
 
-        inf = nullptr;
-        if(descend) {
-_retry_enum_children:
-            GErrorPtr err;
-            auto enu = GFileEnumeratorPtr {
-                g_file_enumerate_children(path.gfile().get(), query_str,
-                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                cancellable().get(), &err),
-                false
-            };
-            if(enu) {
-                while(!isCancelled()) {
-                    inf = GFileInfoPtr{g_file_enumerator_next_file(enu.get(), cancellable().get(), &err), false};
-                    if(inf) {
-                        FilePath child = path.child(g_file_info_get_name(inf.get()));
-                        if(!child && g_file_info_get_file_type(inf.get()) == G_FILE_TYPE_DIRECTORY) {
-                            // we won't be able to enumerate its children
-                            ++fileCount_;
-                        }
-                        else {
-                            exec(std::move(child), std::move(inf));
-                        }
-                    }
-                    else {
-                        if(err) { /* error! */
-                            /* ErrorAction::RETRY is not supported */
-                            emitError( err, ErrorSeverity::MILD);
-                            err = nullptr;
-                        }
-                        else {
-                            /* EOF is reached, do nothing. */
-                            break;
-                        }
-                    }
-                }
-                g_file_enumerator_close(enu.get(), nullptr, nullptr);
+    int fd = dirfd(dir);
+    Totals totals;
+    auto countFile = [&](const char* name, mode_t mode, std::uint64_t size, std::uint64_t blocks) {
+        if(countNativeFile(mode, size, blocks, totals)) {
+            std::string childPath = localPath;
+            if(childPath.back() != '/') {
+                childPath += '/';
+            }
+            childPath += name;
+            queue.push(worker, DirTask{FilePath{}, std::move(childPath)});
+        }
+        // let the progress be seen in large directories
+        if(totals.count >= 4096) {
+            addTotals(totals);
+            totals = Totals{};
+        }
+    };
+#ifdef FM_HAVE_STATX_STAGE
+    // the files are queried in batches, in parallel if the stage allows
+    const std::size_t batchSize = 512;
+    std::string names; // the names of the batch, separated by nulls
+    std::vector<StatxStage::Request> requests;
+    bool atEnd = false;
+    while(!isCancelled() && !atEnd) {
+        names.clear();
+        requests.clear();
+        struct dirent* ent;
+        while(requests.size() < batchSize) {
+            if((ent = readdir(dir)) == nullptr) {
+                atEnd = true;
+                break;
+            }
+            const char* name = ent->d_name;
+            if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            requests.push_back(StatxStage::Request{nullptr, 0, {}});
+            names.append(name, strlen(name) + 1);
+        }
+        // the names are only pointed to once the buffer does not grow anymore
+        const char* name = names.c_str();
+        for(auto& request : requests) {
+            request.name = name;
+            name += strlen(name) + 1;
+        }
+        stage->run(fd, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_BLOCKS,
+                   requests.data(), requests.size());
+        for(const auto& request : requests) {
+            if(request.error != 0) {
+                emitErrorLocked(makeError(request.error, request.name));
+                continue;
+            }
+            countFile(request.name, request.result.stx_mode, request.result.stx_size, request.result.stx_blocks);
+        }
+    }
+#else
+    Q_UNUSED(stage);
+    struct dirent* ent;
+    while(!isCancelled() && (ent = readdir(dir)) != nullptr) {
+        const char* name = ent->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        struct stat st;
+        if(fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            emitErrorLocked(makeError(errno, name));
+            continue;
+        }
+        countFile(name, st.st_mode, st.st_size, st.st_blocks);
+    }
+#endif
+    closedir(dir);
+    addTotals(totals);
+}
+
+void TotalSizeJob::runWorker(DirQueue& queue, int worker) {
+    // NOTE: The stage is set up once for all the directories of the worker since an
+    // io_uring costs system calls and mappings. The workers already run in parallel,
+    // so they don't start more threads for their batches.
+#ifdef FM_HAVE_STATX_STAGE
+    auto stage = StatxStage::create();
+    if(stage->backend() == StatxStage::ThreadPool && threadCount() > 1) {
+        stage = StatxStage::create(StatxStage::Synchronous);
+    }
+    StatxStage* workerStage = stage.get();
+#else
+    StatxStage* workerStage = nullptr;
+#endif
+    DirTask task;
+    while(!isCancelled()) {
+        if(queue.pop(worker, task)) {
+            if(!task.localPath.empty()) {
+                countDirNative(task.localPath, queue, worker, workerStage);
             }
             else {
-                ErrorAction act = emitError( err, ErrorSeverity::MILD);
-                err = nullptr;
-                if(act == ErrorAction::RETRY) {
-                    goto _retry_enum_children;
-                }
+                countDirGio(task.path, queue, worker);
             }
+            queue.taskDone();
+        }
+        else if(!queue.waitForTasks()) {
+            break;
         }
     }
 }
 
 
 void TotalSizeJob::exec() {
+    const int n_workers = threadCount();
+    DirQueue queue{n_workers};
     for(auto& path : paths_) {
-        exec(path, GFileInfoPtr{});
+        if(isCancelled()) {
+            return;
+        }
+        countPath(path, queue);
+    }
+    if(queue.empty()) { // no directory to descend into
+        return;
+    }
+    // this thread is the first worker
+    std::vector<std::thread> threads;
+    threads.reserve(n_workers - 1);
+    for(int i = 1; i < n_workers; ++i) {
+        threads.emplace_back(&TotalSizeJob::runWorker, this, std::ref(queue), i);
+    }
+    runWorker(queue, 0);
+    for(auto& thread : threads) {
+        thread.join();
     }
 }
 
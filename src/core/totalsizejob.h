@@ -5,10 +5,16 @@
 #include "fileoperationjob.h"
 #include "filepath.h"
 #include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <string>
 #include "gioptrs.h"
+#include <sys/stat.h>
 
 namespace Fm {
 
+class StatxStage;
+
 class LIBFM_QT_API TotalSizeJob : public Fm::FileOperationJob {
     Q_OBJECT
 public:
@@ -22,6 +28,14 @@ public:
 
     explicit TotalSizeJob(FilePathList paths = FilePathList{}, Flags flags = DEFAULT);
 
+    // The number of threads that traverse the directories.
+    // A non-positive value means the number of CPU cores.
+    void setThreadCount(int count) {
+        threadCount_ = count;
+    }
+
+    int threadCount() const;
+
     std::uint64_t totalSize() const {
         return totalSize_;
     }
@@ -39,16 +53,38 @@ protected:
     void exec() override;
 
 private:
-    void exec(FilePath path, GFileInfoPtr inf);
+    class DirQueue;
+    struct DirTask;
+    struct Totals;
+
+    DirTask makeDirTask(const FilePath& path) const;
+
+    void countPath(const FilePath& path, DirQueue& queue);
+
+    void countDirGio(const FilePath& path, DirQueue& queue, int worker);
+
+    void countDirNative(const std::string& localPath, DirQueue& queue, int worker, StatxStage* stage);
+
+    void runWorker(DirQueue& queue, int worker);
+
+    bool countFile(const FilePath& path, GFileInfo* inf, Totals& totals);
+
+    bool countNativeFile(mode_t mode, std::uint64_t size, std::uint64_t blocks, Totals& totals);
+
+    void addTotals(const Totals& totals);
+
+    ErrorAction emitErrorLocked(const GErrorPtr& err);
 
 private:
     FilePathList paths_;
 
     int flags_;
-    std::uint64_t totalSize_;
-    std::uint64_t totalOndiskSize_;
-    unsigned int fileCount_;
+    int threadCount_;
+    std::atomic<std::uint64_t> totalSize_;
+    std::atomic<std::uint64_t> totalOndiskSize_;
+    std::atomic<unsigned int> fileCount_;
     const char* dest_fs_id;
+    std::mutex errorMutex_; // errors of the workers are reported one at a time
 };
 
 } // namespace Fm
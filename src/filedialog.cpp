@@ -1433,7 +1433,7 @@ bool FileDialog::FileDialogFilter::filterAcceptsRow(const ProxyFolderModel* /*mo
     }
 
     bool nameMatched = false;
-    auto& name = (!info->name().empty() ? QString::fromStdString(info->name()) : info->displayName());
+    const QString name = (!info->name().empty() ? QString::fromStdString(info->name()) : info->displayName());
     for(const auto& pattern: patterns_) {
         if(name.indexOf(pattern) == 0) {
             nameMatched = true;
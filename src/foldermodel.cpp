@@ -21,6 +21,8 @@
 #include "foldermodel.h"
 #include <iostream>
 #include <algorithm>
+#include <functional>
+#include <iterator>
 #include <QtAlgorithms>
 #include <qmimedata.h>
 #include <QMimeData>
@@ -38,7 +40,9 @@
 namespace Fm {
 
 FolderModel::FolderModel():
+    staleRowsFrom_{-1},
     hasPendingThumbnailHandler_{false},
+    thumbnailPriority_{0},
     showFullNames_{false},
     isLoaded_{false},
     hasCutfile_{false} {
@@ -48,7 +52,13 @@ FolderModel::FolderModel():
 FolderModel::~FolderModel() {
     // if the thumbnail requests list is not empty, cancel them
     for(auto job: pendingThumbnailJobs_) {
-        job->cancel();
+        // the jobs that are not started yet can be deleted
+        if(Fm::ThumbnailJob::threadPool(job->isRemote())->tryTake(job)) {
+            delete job;
+        }
+        else {
+            job->cancel();
+        }
     }
 }
 
@@ -92,12 +102,13 @@ void FolderModel::onFilesAdded(const Fm::FileInfoList& files) {
         FolderModelItem item(info);
 
         // cut files may be removed and added again
-        if(isLoaded_ && cutFilesHashSet_.count(info->path().hash()) != 0) {
+        if(isLoaded_ && !cutFilesHashSet_.empty() && cutFilesHashSet_.count(info->path().hash()) != 0) {
             item.isCut = true;
             hasCutfile_ = true;
         }
 
         items.append(item);
+        indexItem(items.size() - 1);
     }
     endInsertRows();
 
@@ -115,8 +126,11 @@ void FolderModel::onFilesChanged(std::vector<Fm::FileInfoPair>& files) {
         if(it != items.end()) {
             FolderModelItem& item = *it;
             // try to update the item
+            unindexItem(row);
             item.info = newInfo;
+            indexItem(row);
             item.thumbnails.clear();
+            item.sortKey_.reset();
             QModelIndex index = createIndex(row, 0, &item);
             Q_EMIT dataChanged(index, index);
             if(oldInfo->size() != newInfo->size()) {
@@ -127,28 +141,203 @@ void FolderModel::onFilesChanged(std::vector<Fm::FileInfoPair>& files) {
 }
 
 void FolderModel::onFilesRemoved(const Fm::FileInfoList& files) {
+    std::vector<int> rows;
+    rows.reserve(files.size());
     for(auto& info : files) {
-        int row;
-        QList<FolderModelItem>::iterator it = findItemByName(info->name().c_str(), &row);
-        if(it != items.end()) {
-            beginRemoveRows(QModelIndex(), row, row);
-            items.erase(it);
-            endRemoveRows();
+        int row = rowFromFileInfo(info.get());
+        if(row < 0) {
+            row = rowFromPath(info->name(), info->path());
+        }
+        if(row >= 0) {
+            rows.push_back(row);
+        }
+    }
+    removeItemRows(rows);
+}
+
+// Removes the items in the given rows, with one beginRemoveRows() per contiguous range.
+void FolderModel::removeItemRows(std::vector<int>& rows) {
+    if(rows.empty()) {
+        return;
+    }
+    // remove the rows from the last one, so that the rows before them do not change
+    std::sort(rows.begin(), rows.end(), std::greater<int>());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    auto it = rows.cbegin();
+    while(it != rows.cend()) {
+        int last = *it;
+        int first = last;
+        for(++it; it != rows.cend() && *it == first - 1; ++it) {
+            first = *it;
+        }
+        beginRemoveRows(QModelIndex(), first, last);
+        for(int row = first; row <= last; ++row) {
+            unindexItem(row);
         }
+        items.erase(items.begin() + first, items.begin() + last + 1);
+        if(first < items.size() && (staleRowsFrom_ < 0 || first < staleRowsFrom_)) {
+            staleRowsFrom_ = first;
+        }
+        endRemoveRows();
     }
 }
 
+void FolderModel::indexItem(int row) {
+    const auto& info = items.at(row).info;
+    nameRows_.emplace(info->name(), info.get());
+    infoRows_[info.get()] = row;
+}
+
+void FolderModel::unindexItem(int row) {
+    const auto& info = items.at(row).info;
+    infoRows_.erase(info.get());
+    // the name may be used by other items too (e.g., in search results)
+    auto range = nameRows_.equal_range(info->name());
+    for(auto it = range.first; it != range.second; ++it) {
+        if(it->second == info.get()) {
+            nameRows_.erase(it);
+            break;
+        }
+    }
+}
+
+// updates the rows that are shifted by removing items
+void FolderModel::updateStaleRows() const {
+    if(staleRowsFrom_ < 0) {
+        return;
+    }
+    for(int row = staleRowsFrom_; row < items.size(); ++row) {
+        infoRows_[items.at(row).info.get()] = row;
+    }
+    staleRowsFrom_ = -1;
+}
+
+int FolderModel::rowFromPath(std::string_view name, const Fm::FilePath& path) const {
+    auto range = nameRows_.equal_range(name);
+    if(range.first == range.second) {
+        return -1;
+    }
+    // the paths of most items are not stored, so compare their parts instead of building them
+    Fm::FilePath parent = path.parent();
+    Fm::CStrPtr baseName = path.baseName();
+    for(auto it = range.first; it != range.second; ++it) {
+        const Fm::FileInfo* info = it->second;
+        if(info->isPathDerived()
+           ? baseName && info->name() == baseName.get() && info->dirPath() == parent
+           : info->path() == path) {
+            return rowFromFileInfo(info);
+        }
+    }
+    return -1;
+}
+
+int FolderModel::rowFromFileInfo(const Fm::FileInfo* info) const {
+    updateStaleRows();
+    auto it = infoRows_.find(info);
+    return it != infoRows_.end() ? it->second : -1;
+}
+
 void FolderModel::loadPendingThumbnails() {
     hasPendingThumbnailHandler_ = false;
+    bool isRemote = folder_ != nullptr && folder_->isValid() && folder_->info()->isRemoteDirectory();
+    auto pool = Fm::ThumbnailJob::threadPool(isRemote);
+    // The newest requests are for the items that are painted now, so they get the highest
+    // priority. The requests of a batch have the same priority and are started in order.
+    if(pendingThumbnailJobs_.empty()) {
+        thumbnailPriority_ = 0;
+    }
+    ++thumbnailPriority_;
     for(auto& item: thumbnailData_) {
-        if(!item.pendingThumbnails_.empty()) {
-            auto job = new Fm::ThumbnailJob(std::move(item.pendingThumbnails_), item.size_, folder_ != nullptr && folder_->isValid() && folder_->info()->isRemoteDirectory());
-            pendingThumbnailJobs_.push_back(job);
+        for(auto& file: item.pendingThumbnails_) {
+            // a job per file lets the pool load thumbnails in parallel and reorder them
+            auto job = new Fm::ThumbnailJob(Fm::FileInfoList{file}, item.size_, isRemote);
+            pendingThumbnailJobs_.insert(job);
             job->setAutoDelete(true);
             connect(job, &Fm::ThumbnailJob::thumbnailLoaded, this, &FolderModel::onThumbnailLoaded, Qt::BlockingQueuedConnection);
             connect(job, &Fm::ThumbnailJob::finished, this, &FolderModel::onThumbnailJobFinished, Qt::BlockingQueuedConnection);
-            Fm::ThumbnailJob::threadPool()->start(job);
+            pool->start(job, thumbnailPriority_);
         }
+        item.pendingThumbnails_.clear();
+    }
+}
+
+void FolderModel::setVisibleItems(const QObject* viewer, const QModelIndexList& indexes, bool showsThumbnails) {
+    Fm::FileInfoList visibleFiles;
+    if(!showsThumbnails || indexes.isEmpty()) {
+        visibleItems_.erase(viewer);
+        for(const auto& index : indexes) {
+            if(FolderModelItem* item = itemFromIndex(index)) {
+                visibleFiles.push_back(item->info);
+            }
+        }
+    }
+    else {
+        auto res = visibleItems_.emplace(viewer, std::unordered_set<const Fm::FileInfo*>{});
+        if(res.second) {
+            connect(viewer, &QObject::destroyed, this, [this, viewer]() {
+                visibleItems_.erase(viewer);
+            });
+        }
+        auto& visible = res.first->second;
+        visible.clear();
+        for(const auto& index : indexes) {
+            if(FolderModelItem* item = itemFromIndex(index)) {
+                if(visible.insert(item->info.get()).second) {
+                    visibleFiles.push_back(item->info);
+                }
+            }
+        }
+    }
+    // let the folder query the content types of the visible files first
+    // (an empty list clears the files of the last view)
+    if(folder_) {
+        folder_->setPriorityFiles(visibleFiles);
+    }
+    // a view that shows nothing (or no thumbnails) cancels nothing
+    updateThumbnailPriorities(showsThumbnails && !indexes.isEmpty());
+}
+
+void FolderModel::updateThumbnailPriorities(bool cancelInvisible) {
+    if(pendingThumbnailJobs_.empty()) {
+        return;
+    }
+    auto isVisible = [this](const Fm::FileInfo* info) {
+        for(const auto& viewer : visibleItems_) {
+            if(viewer.second.count(info) > 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+    ++thumbnailPriority_;
+    auto it = pendingThumbnailJobs_.begin();
+    while(it != pendingThumbnailJobs_.end()) {
+        auto job = *it;
+        // the jobs that are already running cannot be taken from the pool
+        auto pool = Fm::ThumbnailJob::threadPool(job->isRemote());
+        const auto& file = job->files().front();
+        if(isVisible(file.get())) {
+            if(pool->tryTake(job)) {
+                pool->start(job, thumbnailPriority_);
+            }
+        }
+        else if(cancelInvisible && !visibleItems_.empty() && pool->tryTake(job)) {
+            // the item is scrolled away in every view; forget its request
+            int row = rowFromFileInfo(file.get());
+            if(row >= 0) {
+                FolderModelItem::Thumbnail* thumbnail = items[row].findThumbnail(job->size());
+                if(thumbnail->status == FolderModelItem::ThumbnailLoading) {
+                    thumbnail->status = FolderModelItem::ThumbnailNotChecked;
+                    // let the views ask for the thumbnail again
+                    QModelIndex index = createIndex(row, 0, &items[row]);
+                    Q_EMIT dataChanged(index, index, {Qt::DecorationRole});
+                }
+            }
+            delete job;
+            it = pendingThumbnailJobs_.erase(it);
+            continue;
+        }
+        ++it;
     }
 }
 
@@ -169,6 +358,7 @@ void FolderModel::insertFiles(int row, const Fm::FileInfoList& files) {
     for(auto& info : files) {
         FolderModelItem item(info);
         items.append(item);
+        indexItem(items.size() - 1);
     }
     endInsertRows();
 }
@@ -267,6 +457,9 @@ void FolderModel::removeAll() {
         return;
     }
     beginRemoveRows(QModelIndex(), 0, items.size() - 1);
+    nameRows_.clear();
+    infoRows_.clear();
+    staleRowsFrom_ = -1;
     items.clear();
     endRemoveRows();
 }
@@ -452,6 +645,18 @@ Qt::ItemFlags FolderModel::flags(const QModelIndex& index) const {
 }
 
 std::shared_ptr<const Fm::FileInfo> FolderModel::fileInfoFromPath(const Fm::FilePath& path) const {
+    auto name = path.baseName();
+    if(name) {
+        int row = rowFromPath(name.get(), path);
+        if(row >= 0) {
+            return items.at(row).info;
+        }
+    }
+    // The names of local files are always their base names. For other files,
+    // e.g., in search results or with some GVFS backends, do a full search.
+    if(folder_ && folder_->path().isNative()) {
+        return nullptr;
+    }
     QList<FolderModelItem>::const_iterator it = items.begin();
     while(it != items.end()) {
         const FolderModelItem& item = *it;
@@ -463,34 +668,11 @@ std::shared_ptr<const Fm::FileInfo> FolderModel::fileInfoFromPath(const Fm::File
     return nullptr;
 }
 
-// FIXME: this is very inefficient and should be replaced with a
-// more reasonable implementation later.
-QList<FolderModelItem>::iterator FolderModel::findItemByName(const char* name, int* row) {
-    QList<FolderModelItem>::iterator it = items.begin();
-    int i = 0;
-    while(it != items.end()) {
-        FolderModelItem& item = *it;
-        if(item.info->name() == name) {
-            *row = i;
-            return it;
-        }
-        ++it;
-        ++i;
-    }
-    return items.end();
-}
-
 QList< FolderModelItem >::iterator FolderModel::findItemByFileInfo(const Fm::FileInfo* info, int* row) {
-    QList<FolderModelItem>::iterator it = items.begin();
-    int i = 0;
-    while(it != items.end()) {
-        FolderModelItem& item = *it;
-        if(item.info.get() == info) {
-            *row = i;
-            return it;
-        }
-        ++it;
-        ++i;
+    int i = rowFromFileInfo(info);
+    if(i >= 0) {
+        *row = i;
+        return items.begin() + i;
     }
     return items.end();
 }
@@ -655,10 +837,7 @@ void FolderModel::releaseThumbnails(int size) {
 
 void FolderModel::onThumbnailJobFinished() {
     Fm::ThumbnailJob* job = static_cast<Fm::ThumbnailJob*>(sender());
-    auto it = std::find(pendingThumbnailJobs_.cbegin(), pendingThumbnailJobs_.cend(), job);
-    if(it != pendingThumbnailJobs_.end()) {
-        pendingThumbnailJobs_.erase(it);
-    }
+    pendingThumbnailJobs_.erase(job);
 }
 
 void FolderModel::onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& file, int size, const QImage& image) {
@@ -695,6 +874,13 @@ QImage FolderModel::thumbnailFromIndex(const QModelIndex& index, int size) {
         // qDebug("FolderModel::thumbnailFromIndex: %d, %s", thumbnail->status, item->displayName.toUtf8().data());
         switch(thumbnail->status) {
         case FolderModelItem::ThumbnailNotChecked: {
+            // use the decoded thumbnail if it is cached; a miss is counted by the ThumbnailJob
+            QImage image = Fm::ThumbnailCache::peek(item->info->path(), item->info->mtime(), size);
+            if(!image.isNull()) {
+                thumbnail->status = FolderModelItem::ThumbnailLoaded;
+                thumbnail->image = image;
+                return image;
+            }
             // load the thumbnail
             queueLoadThumbnail(item->info, size);
             thumbnail->status = FolderModelItem::ThumbnailLoading;
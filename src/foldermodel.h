@@ -30,10 +30,14 @@
 #include <vector>
 #include <utility>
 #include <forward_list>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include "foldermodelitem.h"
 
 #include "core/folder.h"
 #include "core/thumbnailjob.h"
+#include "core/thumbnailcache.h"
 
 namespace Fm {
 
@@ -96,10 +100,22 @@ public:
     void cacheThumbnails(int size);
     void releaseThumbnails(int size);
 
+    // Tells the model which items are visible in a view (usually a proxy model of a
+    // folder view). Queued thumbnails of visible items are loaded before the others, and
+    // queued thumbnails of items that are not visible in any view are cancelled (they are
+    // queued again when they are requested by thumbnailFromIndex()).
+    // An empty list, or a view that shows no thumbnails, unregisters the view and cancels
+    // nothing. The folder queries the content types of the visible files first either way.
+    void setVisibleItems(const QObject* viewer, const QModelIndexList& indexes, bool showsThumbnails = true);
+
     void setShowFullName(bool fullName) {
         showFullNames_ = fullName;
     }
 
+    bool showFullName() const {
+        return showFullNames_;
+    }
+
 Q_SIGNALS:
     void thumbnailLoaded(const QModelIndex& index, int size);
     void fileSizeChanged(const QModelIndex& index);
@@ -123,13 +139,22 @@ protected:
     void queueLoadThumbnail(const std::shared_ptr<const Fm::FileInfo>& file, int size);
     void insertFiles(int row, const Fm::FileInfoList& files);
     void removeAll();
-    QList<FolderModelItem>::iterator findItemByName(const char* name, int* row);
     QList<FolderModelItem>::iterator findItemByFileInfo(const Fm::FileInfo* info, int* row);
 
 private:
     QString makeTooltip(FolderModelItem* item) const;
     void updateCutFilesSet();
 
+    // row index
+    void indexItem(int row);
+    void unindexItem(int row);
+    int rowFromPath(std::string_view name, const Fm::FilePath& path) const;
+    int rowFromFileInfo(const Fm::FileInfo* info) const;
+    void updateStaleRows() const;
+    void removeItemRows(std::vector<int>& rows);
+
+    void updateThumbnailPriorities(bool cancelInvisible);
+
 private:
 
     struct ThumbnailData {
@@ -146,8 +171,20 @@ private:
     std::shared_ptr<Fm::Folder> folder_;
     QList<FolderModelItem> items;
 
+    // The FileInfo objects of the items by their names, which may be shared by several items
+    // (e.g., in search results), and the rows of the items by their FileInfo objects. The
+    // name keys point to the strings of the FileInfo objects held by the items. After rows
+    // are removed, the rows from staleRowsFrom_ on are outdated and are updated on the next
+    // lookup.
+    std::unordered_multimap<std::string_view, const Fm::FileInfo*> nameRows_;
+    mutable std::unordered_map<const Fm::FileInfo*, int> infoRows_;
+    mutable int staleRowsFrom_;
+
     bool hasPendingThumbnailHandler_;
-    std::vector<Fm::ThumbnailJob*> pendingThumbnailJobs_;
+    // one job per file; the jobs of later requests have higher priorities
+    std::unordered_set<Fm::ThumbnailJob*> pendingThumbnailJobs_;
+    int thumbnailPriority_;
+    std::unordered_map<const QObject*, std::unordered_set<const Fm::FileInfo*>> visibleItems_;
     std::forward_list<ThumbnailData> thumbnailData_;
 
     bool showFullNames_;
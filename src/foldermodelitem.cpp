@@ -21,11 +21,54 @@
 #include "foldermodelitem.h"
 #include <QDateTime>
 #include <QPainter>
+#include <algorithm>
 #include "utilities.h"
 #include "core/userinfocache.h"
 
 namespace Fm {
 
+NaturalSortKey::NaturalSortKey(const QString& text, const QCollator& collator) {
+    // QString::split() is not used because some dots may not be needed.
+    qsizetype start = 0;
+    for(;;) {
+        qsizetype end = text.indexOf(QLatin1Char('.'), start);
+        QStringView part = end == -1 ? QStringView{text}.sliced(start)
+                                     : QStringView{text}.sliced(start, end - start);
+        parts_.emplace_back(collator.sortKey(part.toString()));
+        partSizes_.push_back(part.size());
+        if(end == -1) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+int NaturalSortKey::compare(const NaturalSortKey& other) const {
+    size_t n = std::min(parts_.size(), other.parts_.size());
+    for(size_t i = 0; i < n; ++i) {
+        int comp = parts_[i].compare(other.parts_[i]);
+        if(comp == 0) {
+            // This is a workaround for QCollator's behavior that, for example,
+            // considers "A0" and "A00" equal when the numeric mode is enabled.
+            comp = partSizes_[i] < other.partSizes_[i] ? -1 : partSizes_[i] > other.partSizes_[i] ? 1 : 0;
+        }
+        if(comp != 0) {
+            return comp;
+        }
+    }
+    // the text with fewer dots comes first if all of the compared parts are equal
+    return parts_.size() < other.parts_.size() ? -1 : parts_.size() > other.parts_.size() ? 1 : 0;
+}
+
+FolderModelItem::SortKey::SortKey(const FolderModelItem& item, bool _fullName, const QCollator& collator, unsigned int _collatorId):
+    collatorId{_collatorId},
+    fullName{_fullName},
+    isDir{item.info->isDir()},
+    isHidden{item.info->isHidden()},
+    name{_fullName && !item.name().empty() ? QString::fromStdString(item.name()) : item.displayName(), collator},
+    displayName{collator.sortKey(item.displayName())} {
+}
+
 FolderModelItem::FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _info):
     info{_info},
     isCut{false} {
@@ -35,6 +78,7 @@ FolderModelItem::FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _inf
 FolderModelItem::FolderModelItem(const FolderModelItem& other):
     info{other.info},
     thumbnails{other.thumbnails},
+    sortKey_{other.sortKey_},
     isCut{other.isCut} {
 }
 
@@ -116,6 +160,13 @@ FolderModelItem::Thumbnail* FolderModelItem::findThumbnail(int size) {
     return &thumbnails.back();
 }
 
+const FolderModelItem::SortKey& FolderModelItem::sortKey(bool fullName, const QCollator& collator, unsigned int collatorId) const {
+    if(!sortKey_ || sortKey_->collatorId != collatorId || sortKey_->fullName != fullName) {
+        sortKey_ = std::make_shared<const SortKey>(*this, fullName, collator, collatorId);
+    }
+    return *sortKey_;
+}
+
 // remove cached thumbnail of the specified size
 void FolderModelItem::removeThumbnail(int size) {
     QList<Thumbnail>::iterator it;
@@ -26,11 +26,28 @@
 #include <QString>
 #include <QIcon>
 #include <QList>
+#include <QCollator>
+#include <vector>
+#include <memory>
 
 #include "core/folder.h"
 
 namespace Fm {
 
+// A precomputed collation key for the natural sorting of file names.
+// Like GTK, dots are considered as separators and the sub-strings are
+// compared from left to right.
+class LIBFM_QT_API NaturalSortKey {
+public:
+    explicit NaturalSortKey(const QString& text, const QCollator& collator);
+
+    int compare(const NaturalSortKey& other) const;
+
+private:
+    std::vector<QCollatorSortKey> parts_;
+    std::vector<qsizetype> partSizes_;
+};
+
 class LIBFM_QT_API FolderModelItem {
 public:
 
@@ -47,12 +64,25 @@ public:
         QImage image;
     };
 
+    // The data used by ProxyFolderModel for sorting, which is computed once
+    // per file and collator (see ProxyFolderModel::lessThan()).
+    struct SortKey {
+        explicit SortKey(const FolderModelItem& item, bool fullName, const QCollator& collator, unsigned int collatorId);
+
+        unsigned int collatorId; // the collator with which the key is made
+        bool fullName; // whether the real name is shown instead of the display name
+        bool isDir;
+        bool isHidden;
+        NaturalSortKey name;
+        QCollatorSortKey displayName;
+    };
+
 public:
     explicit FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _info);
     FolderModelItem(const FolderModelItem& other);
     virtual ~FolderModelItem();
 
-    const QString& displayName() const {
+    QString displayName() const {
         return info->displayName();
     }
 
@@ -81,12 +111,17 @@ public:
 
     void removeThumbnail(int size);
 
+    // returns the sort key of the item, which is made if it does not exist
+    // or was made with another collator or name mode
+    const SortKey& sortKey(bool fullName, const QCollator& collator, unsigned int collatorId) const;
+
     std::shared_ptr<const Fm::FileInfo> info;
     mutable QString dispMtime_;
     mutable QString dispCrtime_;
     mutable QString dispDtime_;
     mutable QString dispSize_;
     QList<Thumbnail> thumbnails;
+    mutable std::shared_ptr<const SortKey> sortKey_; // should be reset if info is changed
     bool isCut;
 };
 
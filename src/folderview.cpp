@@ -881,7 +881,8 @@ FolderView::FolderView(FolderView::ViewMode _mode, QWidget *parent):
     shadowHidden_(false),
     scrollPerPixel_(true),
     ctrlRightClick_(false),
-    smoothScrollTimer_(nullptr) {
+    smoothScrollTimer_(nullptr),
+    visibleRowsTimer_(nullptr) {
 
     iconSize_[IconMode - FirstViewMode] = QSize(48, 48);
     iconSize_[CompactMode - FirstViewMode] = QSize(24, 24);
@@ -1033,7 +1034,10 @@ void FolderView::onClosingEditor(QWidget* editor, QAbstractItemDelegate::EndEdit
         auto info = data.value<std::shared_ptr<const Fm::FileInfo>>();
         if (info) {
             // NOTE: "Edit name" is used to handle invalid filename encoding.
-            auto oldName = QString::fromUtf8(g_file_info_get_edit_name(info->gFileInfo().get()));
+            QString oldName;
+            if(auto inf = info->gFileInfo()) {
+                oldName = QString::fromUtf8(g_file_info_get_edit_name(inf.get()));
+            }
             if(oldName.isEmpty()) {
                 oldName = QString::fromStdString(info->name());
             }
@@ -1177,6 +1181,10 @@ void FolderView::setViewMode(ViewMode _mode) {
         view->setSelectionMode(QAbstractItemView::ExtendedSelection);
         layout()->addWidget(view);
 
+        // the list view is reused when possible
+        connect(view->verticalScrollBar(), &QScrollBar::valueChanged, this, &FolderView::queueVisibleRowsUpdate, Qt::UniqueConnection);
+        connect(view->horizontalScrollBar(), &QScrollBar::valueChanged, this, &FolderView::queueVisibleRowsUpdate, Qt::UniqueConnection);
+
         // enable dnd (the drop indicator is set at "FolderView::childDragMoveEvent()")
         view->setDragEnabled(true);
         view->setAcceptDrops(true);
@@ -1713,6 +1721,9 @@ bool FolderView::eventFilter(QObject* watched, QEvent* event) {
     // That's why we override respective virtual methods for different events.
     if(view && watched == view->viewport()) {
         switch(event->type()) {
+        case QEvent::Resize:
+            queueVisibleRowsUpdate();
+            break;
         case QEvent::HoverMove:
         case QEvent::HoverEnter:
             // activate items on single click
@@ -1929,6 +1940,70 @@ void FolderView::scrollSmoothly() {
     }
 }
 
+void FolderView::queueVisibleRowsUpdate() {
+    if(!model_ || !model_->showThumbnails()) {
+        return;
+    }
+    if(!visibleRowsTimer_) {
+        visibleRowsTimer_ = new QTimer(this);
+        visibleRowsTimer_->setSingleShot(true);
+        connect(visibleRowsTimer_, &QTimer::timeout, this, &FolderView::onVisibleRowsTimeout);
+    }
+    // wait until scrolling stops
+    visibleRowsTimer_->start(150);
+}
+
+void FolderView::onVisibleRowsTimeout() {
+    if(!view || !model_) {
+        return;
+    }
+    int n_rows = model_->rowCount();
+    if(n_rows == 0) {
+        return;
+    }
+    // The rows are laid out in order, from top to bottom, except in the compact mode,
+    // where they are laid out from left to right. So, the first and last visible rows
+    // can be found with binary searches.
+    bool horizontal = mode != DetailedListMode
+                      && static_cast<FolderViewListView*>(view)->flow() == QListView::TopToBottom;
+    const QRect viewRect = view->viewport()->rect();
+    auto isBefore = [&](int row) { // the row is before the visible area
+        QRect rect = view->visualRect(model_->index(row, 0));
+        return horizontal ? rect.right() < viewRect.left() : rect.bottom() < viewRect.top();
+    };
+    auto isAfter = [&](int row) { // the row is after the visible area
+        QRect rect = view->visualRect(model_->index(row, 0));
+        return horizontal ? rect.left() > viewRect.right() : rect.top() > viewRect.bottom();
+    };
+    int first = 0, last = n_rows;
+    while(first < last) {
+        int mid = first + (last - first) / 2;
+        if(isBefore(mid)) {
+            first = mid + 1;
+        }
+        else {
+            last = mid;
+        }
+    }
+    last = n_rows;
+    int start = first;
+    while(start < last) {
+        int mid = start + (last - start) / 2;
+        if(isAfter(mid)) {
+            last = mid;
+        }
+        else {
+            start = mid + 1;
+        }
+    }
+    if(first < last) {
+        model_->setVisibleRows(first, last - 1);
+    }
+    else {
+        model_->setVisibleRows(-1, -1);
+    }
+}
+
 // this slot handles auto-selection of items.
 void FolderView::onAutoSelectionTimeout() {
     if(QApplication::mouseButtons() != Qt::NoButton) {
@@ -179,6 +179,8 @@ private Q_SLOTS:
     void onSelChangedTimeout();
     void onClosingEditor(QWidget* editor, QAbstractItemDelegate::EndEditHint hint);
     void scrollSmoothly();
+    void queueVisibleRowsUpdate();
+    void onVisibleRowsTimeout();
 
 Q_SIGNALS:
     void clicked(int type, const std::shared_ptr<const Fm::FileInfo>& file);
@@ -219,6 +221,9 @@ private:
     QList<scrollData> queuedScrollSteps_;
     QTimer *smoothScrollTimer_;
 
+    // tells the model which rows are visible after scrolling or resizing
+    QTimer* visibleRowsTimer_;
+
     QList<int> customColumnWidths_;
     QSet<int> hiddenColumns_;
 };
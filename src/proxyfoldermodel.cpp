@@ -22,13 +22,17 @@
 #include "foldermodel.h"
 #include <QCollator>
 #include <QApplication>
+#include <QHash>
 
 #include <cmath>
+#include <mutex>
+#include <algorithm>
 
 namespace Fm {
 
 ProxyFolderModel::ProxyFolderModel(QObject* parent):
     QSortFilterProxyModel(parent),
+    collatorId_(0),
     showHidden_(false),
     backupAsHidden_(true),
     folderFirst_(true),
@@ -37,9 +41,8 @@ ProxyFolderModel::ProxyFolderModel(QObject* parent):
     thumbnailSize_(0) {
 
     setDynamicSortFilter(true);
-    setSortCaseSensitivity(Qt::CaseInsensitive);
-
     collator_.setNumericMode(true);
+    setSortCaseSensitivity(Qt::CaseInsensitive);
 }
 
 ProxyFolderModel::~ProxyFolderModel() {
@@ -57,6 +60,9 @@ void ProxyFolderModel::setSourceModel(QAbstractItemModel* model) {
     if(model == sourceModel()) // avoid setting the same model twice
         return;
     FolderModel* oldSrcModel = static_cast<FolderModel*>(sourceModel());
+    if(oldSrcModel) { // nothing is visible in the old source model anymore
+        oldSrcModel->setVisibleItems(this, QModelIndexList());
+    }
     if(model) {
         // we only support Fm::FolderModel
         Q_ASSERT(model->inherits("Fm::FolderModel"));
@@ -73,10 +79,54 @@ void ProxyFolderModel::setSourceModel(QAbstractItemModel* model) {
             }
         }
     }
+    if(oldSrcModel) {
+        disconnect(oldSrcModel, &QAbstractItemModel::rowsAboutToBeInserted, this, &ProxyFolderModel::onSourceDataChanging);
+        disconnect(oldSrcModel, &QAbstractItemModel::dataChanged, this, &ProxyFolderModel::onSourceDataChanging);
+    }
+    if(model) {
+        // connected before QSortFilterProxyModel so that dynamic sorting uses the current locale
+        connect(model, &QAbstractItemModel::rowsAboutToBeInserted, this, &ProxyFolderModel::onSourceDataChanging);
+        connect(model, &QAbstractItemModel::dataChanged, this, &ProxyFolderModel::onSourceDataChanging);
+    }
     QSortFilterProxyModel::setSourceModel(model);
 }
 
+// should be called whenever the collator is changed. The id identifies the settings of the
+// collator, so that proxy models with the same settings share the sort keys cached by the
+// source model and the keys are remade only when the settings differ.
+void ProxyFolderModel::updateCollatorId() {
+    static std::mutex mutex;
+    static QHash<QString, unsigned int> ids;
+    QString settings = collator_.locale().bcp47Name()
+                       + (collator_.caseSensitivity() == Qt::CaseSensitive ? QLatin1String{"|cs"} : QLatin1String{"|ci"})
+                       + (collator_.numericMode() ? QLatin1String{"|num"} : QLatin1String{""})
+                       + (collator_.ignorePunctuation() ? QLatin1String{"|nopunct"} : QLatin1String{""});
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = ids.constFind(settings);
+    if(it == ids.constEnd()) {
+        it = ids.insert(settings, static_cast<unsigned int>(ids.size() + 1));
+    }
+    collatorId_ = it.value();
+}
+
+bool ProxyFolderModel::updateCollatorLocale() {
+    if(collator_.locale() != QLocale()) { // the default locale is changed
+        collator_.setLocale(QLocale());
+        updateCollatorId();
+        return true;
+    }
+    return false;
+}
+
+void ProxyFolderModel::onSourceDataChanging() {
+    // the items that are sorted dynamically should not be placed by another locale
+    if(updateCollatorLocale() && dynamicSortFilter()) {
+        invalidate();
+    }
+}
+
 void ProxyFolderModel::sort(int column, Qt::SortOrder order) {
+    updateCollatorLocale();
     int oldColumn = sortColumn();
     Qt::SortOrder oldOrder = sortOrder();
     QSortFilterProxyModel::sort(column, order);
@@ -120,6 +170,7 @@ void ProxyFolderModel::setHiddenLast(bool hiddenLast) {
 
 void ProxyFolderModel::setSortCaseSensitivity(Qt::CaseSensitivity cs) {
     collator_.setCaseSensitivity(cs);
+    updateCollatorId();
     QSortFilterProxyModel::setSortCaseSensitivity(cs);
     invalidate();
     Q_EMIT sortFilterChanged();
@@ -150,20 +201,25 @@ bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& righ
     FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
     // left and right are indexes of source model, not the proxy model.
     if(srcModel) {
-        auto leftInfo = srcModel->fileInfoFromIndex(left);
-        auto rightInfo = srcModel->fileInfoFromIndex(right);
+        FolderModelItem* leftItem = srcModel->itemFromIndex(left);
+        FolderModelItem* rightItem = srcModel->itemFromIndex(right);
+        const auto& leftInfo = leftItem->info;
+        const auto& rightInfo = rightItem->info;
+        // the collation keys and flags are computed once per file, not on each comparison
+        const auto& leftKey = leftItem->sortKey(srcModel->showFullName(), collator_, collatorId_);
+        const auto& rightKey = rightItem->sortKey(srcModel->showFullName(), collator_, collatorId_);
 
         if(folderFirst_) {
-            bool leftIsFolder = leftInfo->isDir();
-            bool rightIsFolder = rightInfo->isDir();
+            bool leftIsFolder = leftKey.isDir;
+            bool rightIsFolder = rightKey.isDir;
             if(leftIsFolder != rightIsFolder) {
                 return sortOrder() == Qt::AscendingOrder ? leftIsFolder : rightIsFolder;
             }
         }
 
         if(hiddenLast_) {
-            bool leftIsHidden = leftInfo->isHidden();
-            bool rightIsHidden = rightInfo->isHidden();
+            bool leftIsHidden = leftKey.isHidden;
+            bool rightIsHidden = rightKey.isHidden;
             if(leftIsHidden != rightIsHidden) {
                 return sortOrder() == Qt::AscendingOrder ? rightIsHidden : leftIsHidden;
             }
@@ -191,7 +247,11 @@ bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& righ
                 return leftInfo->size() < rightInfo->size();
             }
             break;
+        case FolderModel::ColumnFileName:
+            comp = leftKey.name.compare(rightKey.name);
+            break;
         default: {
+            // The other text columns (type, owner and group) have no cached keys.
             // To have a more natural sorting like that of GTK, we consider dot
             // as a separator and compare sub-strings from left to right.
             // QString::split() is not used because some dots may not be needed.
@@ -227,7 +287,7 @@ bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& righ
         }
         // always sort files by their display names when they have the same property
         if(comp == 0) {
-            return collator_.compare(leftInfo->displayName(), rightInfo->displayName()) < 0;
+            return leftKey.displayName.compare(rightKey.displayName) < 0;
         }
         return comp < 0;
     }
@@ -276,6 +336,7 @@ void ProxyFolderModel::setShowThumbnails(bool show) {
             }
             else { // turn off thumbnails
                 // free cached old thumbnails in source model
+                srcModel->setVisibleItems(this, QModelIndexList());
                 srcModel->releaseThumbnails(thumbnailSize_);
                 disconnect(srcModel, &FolderModel::thumbnailLoaded, this, &ProxyFolderModel::onThumbnailLoaded);
             }
@@ -311,6 +372,22 @@ void ProxyFolderModel::setThumbnailSize(int size) {
     }
 }
 
+void ProxyFolderModel::setVisibleRows(int first, int last) {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(!srcModel) {
+        return;
+    }
+    QModelIndexList srcIndexes;
+    if(first >= 0) {
+        last = std::min(last, rowCount() - 1);
+        srcIndexes.reserve(std::max(last - first + 1, 0));
+        for(int row = first; row <= last; ++row) {
+            srcIndexes << mapToSource(index(row, 0));
+        }
+    }
+    srcModel->setVisibleItems(this, srcIndexes, showThumbnails_ && thumbnailSize_ != 0);
+}
+
 QVariant ProxyFolderModel::data(const QModelIndex& index, int role) const {
     if(index.column() == 0) { // only show the decoration role for the first column
         if(role == Qt::DecorationRole && showThumbnails_ && thumbnailSize_) {
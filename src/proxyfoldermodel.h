@@ -83,6 +83,10 @@ public:
     }
     void setThumbnailSize(int size);
 
+    // Called by views with the range of visible rows, so that the content types and
+    // thumbnails of visible items are loaded first. A negative first row means no visible row.
+    void setVisibleRows(int first, int last);
+
     std::shared_ptr<const Fm::FileInfo> fileInfoFromIndex(const QModelIndex& index) const;
 
     std::shared_ptr<const Fm::FileInfo> fileInfoFromPath(const FilePath& path) const;
@@ -102,13 +106,22 @@ Q_SIGNALS:
 protected Q_SLOTS:
     void onThumbnailLoaded(const QModelIndex& srcIndex, int size);
 
+private Q_SLOTS:
+    void onSourceDataChanging();
+
 protected:
     bool filterAcceptsRow(int source_row, const QModelIndex& source_parent) const override;
     bool lessThan(const QModelIndex& left, const QModelIndex& right) const override;
     // void reloadAllThumbnails();
 
+private:
+    void updateCollatorId();
+    // returns true if the default locale is changed, so that the sort keys are remade
+    bool updateCollatorLocale();
+
 private:
     QCollator collator_;
+    unsigned int collatorId_; // identifies the settings of collator_ in the sort keys of items
     bool showHidden_;
     bool backupAsHidden_;
     bool folderFirst_;
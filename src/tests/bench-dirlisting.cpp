@@ -0,0 +1,171 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Lists a local folder with DirListJob, once through GIO and once with the native
+// getdents64()/statx() backend, and checks that both give the same files. Unless a
+// folder is given, one with the given number of files is made first (1000000 files
+// take a few GiB of inodes and some minutes to create), with some hidden files,
+// backups, subfolders and symlinks among them, also with names that only make backups
+// of regular files, and a "lost+found" folder, which is only hidden in the root of a
+// filesystem. The root folder "/" is compared too.
+// Usage: bench-dirlisting [files] [fast|detailed] [folder]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QDebug>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../core/dirlistjob.h"
+
+static void makeFolder(const std::string& dir, int n) {
+    for(int i = 0; i < n; ++i) {
+        std::string path = dir + '/';
+        switch(i % 12) {
+        case 0:
+            path += ".hidden-" + std::to_string(i);
+            break;
+        case 1:
+            path += "backup-" + std::to_string(i) + ".txt~";
+            break;
+        case 2:
+            path += "dir-" + std::to_string(i);
+            mkdir(path.c_str(), 0755);
+            continue;
+        case 3:
+            path += "link-" + std::to_string(i);
+            symlink(i % 20 == 3 ? "missing-target" : "file-4.png", path.c_str());
+            continue;
+        case 4:
+            path += "file-" + std::to_string(i) + ".png";
+            break;
+        case 10: // not a backup
+            path += "dir-" + std::to_string(i) + "~";
+            mkdir(path.c_str(), 0755);
+            continue;
+        case 11: // a backup if the target is a regular file
+            path += "link-" + std::to_string(i) + "~";
+            symlink(i % 24 == 11 ? "dir-2" : "file-4.png", path.c_str());
+            continue;
+        default:
+            path += "file-" + std::to_string(i) + ".txt";
+            break;
+        }
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd >= 0) {
+            if(i % 7 != 0) {
+                ssize_t written = write(fd, "some text\n", 10);
+                Q_UNUSED(written);
+            }
+            close(fd);
+        }
+    }
+    mkdir((dir + "/lost+found").c_str(), 0700);
+}
+
+static Fm::FileInfoList listFolder(const Fm::FilePath& path, Fm::DirListJob::Flags flags, bool native, qint64& elapsed) {
+    Fm::DirListJob::setNativeListingEnabled(native);
+    Fm::DirListJob job{path, flags};
+    job.setAutoDelete(false);
+    QElapsedTimer timer;
+    timer.start();
+    job.run();
+    elapsed = timer.elapsed();
+    return job.files();
+}
+
+static bool isSame(const Fm::FileInfo& a, const Fm::FileInfo& b) {
+    return a.displayName() == b.displayName()
+           && a.mimeType() == b.mimeType()
+           && a.icon() == b.icon()
+           && a.size() == b.size()
+           && a.mode() == b.mode()
+           && a.mtime() == b.mtime()
+           && a.ctime() == b.ctime()
+           && a.fileId() == b.fileId()
+           && a.target() == b.target()
+           && a.isHidden() == b.isHidden()
+           && a.isBackup() == b.isBackup()
+           && a.isAccessible() == b.isAccessible()
+           && a.isWritable() == b.isWritable()
+           && a.isDeletable() == b.isDeletable()
+           && a.isMimeTypeGuessed() == b.isMimeTypeGuessed();
+}
+
+// lists the folder with both backends and returns the number of files that differ
+static int compare(const Fm::FilePath& path, Fm::DirListJob::Flags flags) {
+    // list once before measuring so that both listings find the inodes in the page cache
+    qint64 gioTime, nativeTime;
+    listFolder(path, flags, false, gioTime);
+    auto gioFiles = listFolder(path, flags, false, gioTime);
+    auto nativeFiles = listFolder(path, flags, true, nativeTime);
+    qDebug() << path.toString().get() << "GIO:" << gioFiles.size() << "files in" << gioTime << "ms,"
+             << "native:" << nativeFiles.size() << "files in" << nativeTime << "ms,"
+             << "speedup:" << double(gioTime) / std::max<qint64>(nativeTime, 1);
+
+    std::unordered_map<std::string, std::shared_ptr<const Fm::FileInfo>> byName;
+    for(const auto& file : gioFiles) {
+        byName.emplace(file->name(), file);
+    }
+    int mismatches = 0;
+    for(const auto& file : nativeFiles) {
+        auto it = byName.find(file->name());
+        if(it == byName.end() || !isSame(*it->second, *file)) {
+            if(++mismatches <= 10) {
+                qWarning("different results for %s", file->name().c_str());
+            }
+        }
+    }
+    if(mismatches > 0 || gioFiles.size() != nativeFiles.size()) {
+        qWarning("%s: %d of the files differ", path.toString().get(), mismatches);
+        return std::max(mismatches, 1);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    int n = argc > 1 ? std::atoi(argv[1]) : 100000;
+    if(n <= 0) {
+        qWarning("Usage: bench-dirlisting [files] [fast|detailed] [folder]");
+        return 1;
+    }
+    auto flags = argc > 2 && strcmp(argv[2], "fast") == 0 ? Fm::DirListJob::FAST : Fm::DirListJob::DETAILED;
+
+    QTemporaryDir tmpDir;
+    std::string dir;
+    if(argc > 3) {
+        dir = argv[3];
+    }
+    else {
+        dir = tmpDir.path().toStdString();
+        QElapsedTimer timer;
+        timer.start();
+        makeFolder(dir, n);
+        qDebug() << "made" << n << "files in" << timer.elapsed() << "ms";
+    }
+    // the root folder may have a "lost+found" folder in the root of a filesystem
+    int mismatches = compare(Fm::FilePath::fromLocalPath(dir.c_str()), flags)
+                     + compare(Fm::FilePath::fromLocalPath("/"), flags);
+    return mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Replays a synthetic storm of file monitor events (like the ones caused by
+// "git checkout" or "rsync" in a watched directory) against the pending change
+// queue of Fm::Folder and against the old vector-based queues.
+// Usage: bench-filechangequeue [number of events]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include "../core/filechangequeue.h"
+
+enum class Event {
+    Created,
+    Changed,
+    Deleted
+};
+
+typedef std::vector<std::pair<Event, Fm::FilePath>> EventList;
+
+// 40% creations, 40% changes and 20% deletions, which are followed by creations
+static EventList makeEvents(size_t n_events) {
+    EventList events;
+    events.reserve(n_events);
+    size_t n_files = n_events * 2 / 5;
+    Fm::FilePathList paths;
+    paths.reserve(n_files);
+    auto dir = Fm::FilePath::fromLocalPath("/tmp/bench-filechangequeue");
+    for(size_t i = 0; i < n_files; ++i) {
+        paths.emplace_back(dir.child(("file-" + std::to_string(i)).c_str()));
+        events.emplace_back(Event::Created, paths.back());
+    }
+    for(size_t i = 0; i < n_files; ++i) {
+        events.emplace_back(Event::Changed, paths[(i * 7919) % n_files]);
+    }
+    for(size_t i = 0; events.size() + 1 < n_events; i += 2) {
+        const auto& path = paths[(i * 104729) % n_files];
+        events.emplace_back(Event::Deleted, path);
+        events.emplace_back(Event::Created, path);
+    }
+    return events;
+}
+
+static size_t replayQueue(const EventList& events) {
+    Fm::FileChangeQueue queue;
+    for(const auto& event: events) {
+        switch(event.first) {
+        case Event::Created:
+            queue.fileAdded(event.second);
+            break;
+        case Event::Changed:
+            queue.fileChanged(event.second);
+            break;
+        case Event::Deleted:
+            queue.fileDeleted(event.second);
+            break;
+        }
+    }
+    return queue.takeInfoPaths().size();
+}
+
+// the implementation used by Fm::Folder before FileChangeQueue
+static size_t replayVectors(const EventList& events) {
+    Fm::FilePathList paths_to_add, paths_to_update, paths_to_del;
+    for(const auto& event: events) {
+        const auto& path = event.second;
+        switch(event.first) {
+        case Event::Created:
+            if(std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) != paths_to_del.cend()) {
+                paths_to_del.erase(std::remove(paths_to_del.begin(), paths_to_del.end(), path), paths_to_del.cend());
+                if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()) {
+                    paths_to_update.push_back(path);
+                }
+            }
+            else if(std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
+                paths_to_add.push_back(path);
+            }
+            break;
+        case Event::Changed:
+            if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()
+               && std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
+                paths_to_update.push_back(path);
+            }
+            break;
+        case Event::Deleted:
+            if(std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) == paths_to_del.cend()) {
+                paths_to_del.push_back(path);
+                paths_to_update.erase(std::remove(paths_to_update.begin(), paths_to_update.end(), path), paths_to_update.cend());
+            }
+            break;
+        }
+    }
+    return paths_to_add.size() + paths_to_update.size();
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+
+    size_t n_events = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    auto events = makeEvents(n_events);
+    qDebug() << "replaying" << events.size() << "events";
+
+    QElapsedTimer timer;
+    timer.start();
+    auto n_queue = replayQueue(events);
+    qDebug() << "FileChangeQueue:" << timer.elapsed() << "ms," << n_queue << "paths to query";
+
+    timer.restart();
+    auto n_vectors = replayVectors(events);
+    qDebug() << "vectors:" << timer.elapsed() << "ms," << n_vectors << "paths to query";
+
+    return n_queue == n_vectors ? 0 : 1;
+}
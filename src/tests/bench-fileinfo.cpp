@@ -0,0 +1,99 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Measures the heap memory used per FileInfo for a synthetic folder listing, either
+// with FileInfo alone or with the GFileInfo of every entry kept alive too (as FileInfo
+// did before it stopped retaining it). The GFileInfo objects are filled with the
+// attributes that DirListJob queries for local files.
+// Usage: bench-fileinfo [number of files]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <cstdlib>
+#include <vector>
+#include <gio/gio.h>
+#include "../core/fileinfo.h"
+#include "benchutils.h"
+
+static Fm::GFileInfoPtr makeGFileInfo(int i) {
+    Fm::GFileInfoPtr inf{g_file_info_new(), false};
+    auto name = QByteArray("document-") + QByteArray::number(i) + ".txt";
+    g_file_info_set_name(inf.get(), name.constData());
+    g_file_info_set_display_name(inf.get(), name.constData());
+    g_file_info_set_edit_name(inf.get(), name.constData());
+    g_file_info_set_file_type(inf.get(), G_FILE_TYPE_REGULAR);
+    g_file_info_set_content_type(inf.get(), "text/plain");
+    g_file_info_set_size(inf.get(), 1000 + i);
+    g_file_info_set_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE, 4096);
+    g_file_info_set_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_MODE, S_IFREG | 0644);
+    g_file_info_set_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_UID, 1000);
+    g_file_info_set_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_GID, 1000);
+    g_file_info_set_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_NLINK, 1);
+    g_file_info_set_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_UNIX_INODE, 100000 + i);
+    g_file_info_set_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED, 1700000000 + i);
+    g_file_info_set_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_ACCESS, 1700000000 + i);
+    g_file_info_set_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_CHANGED, 1700000000 + i);
+    g_file_info_set_attribute_boolean(inf.get(), G_FILE_ATTRIBUTE_ACCESS_CAN_READ, TRUE);
+    g_file_info_set_attribute_boolean(inf.get(), G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE, TRUE);
+    g_file_info_set_attribute_boolean(inf.get(), G_FILE_ATTRIBUTE_ACCESS_CAN_DELETE, TRUE);
+    g_file_info_set_attribute_boolean(inf.get(), G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME, TRUE);
+    g_file_info_set_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM, "lnx:64769");
+    auto id = QByteArray("l64769:") + QByteArray::number(100000 + i);
+    g_file_info_set_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILE, id.constData());
+    Fm::GIconPtr icon{g_content_type_get_icon("text/plain"), false};
+    g_file_info_set_icon(inf.get(), icon.get());
+    return inf;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    int n = argc > 1 ? std::atoi(argv[1]) : 100000;
+    if(n <= 0) {
+        qWarning("Usage: bench-fileinfo [number of files]");
+        return 1;
+    }
+    auto dirPath = Fm::FilePath::fromLocalPath("/tmp/bench-fileinfo");
+
+    // warm up the caches of mime types and icons so that they are not counted
+    Fm::FileInfo{makeGFileInfo(-1), Fm::FilePath(), dirPath};
+
+    for(bool retain: {false, true}) {
+        std::vector<std::shared_ptr<const Fm::FileInfo>> files;
+        std::vector<Fm::GFileInfoPtr> gfileInfos;
+        files.reserve(n);
+        if(retain) {
+            gfileInfos.reserve(n);
+        }
+        size_t base = heapBytes();
+        QElapsedTimer timer;
+        timer.start();
+        for(int i = 0; i < n; ++i) {
+            auto inf = makeGFileInfo(i);
+            files.emplace_back(std::make_shared<const Fm::FileInfo>(inf, Fm::FilePath(), dirPath));
+            if(retain) {
+                gfileInfos.emplace_back(std::move(inf));
+            }
+        }
+        qint64 elapsed = timer.elapsed();
+        size_t used = heapBytes() - base;
+        qDebug() << (retain ? "FileInfo + retained GFileInfo:" : "FileInfo only:")
+                 << used / n << "bytes per entry," << elapsed << "ms for" << n << "files";
+    }
+    qDebug() << "sizeof(FileInfo):" << sizeof(Fm::FileInfo);
+    return 0;
+}
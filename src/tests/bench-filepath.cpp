@@ -0,0 +1,119 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Measures the hash map operations that Folder and the models do with FilePath keys on
+// many local paths: inserting, looking up with the same paths and with equal paths made
+// anew, moving the keys into a vector and erasing them. It also compares the hash and
+// base name accessors with the GIO calls they save.
+// Usage: bench-filepath [paths]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <gio/gio.h>
+#include "../core/filepath.h"
+
+static void report(const char* label, QElapsedTimer& timer, size_t n) {
+    qDebug() << label << ":" << timer.nsecsElapsed() / qint64(n) << "ns per path";
+    timer.restart();
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    int n = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    if(n <= 0) {
+        qWarning("Usage: bench-filepath [paths]");
+        return 1;
+    }
+
+    std::vector<Fm::FilePath> paths;
+    paths.reserve(n);
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < n; ++i) {
+        auto name = "/home/user/projects/libfm-qt/build/objects/dir-" + std::to_string(i % 100)
+                    + "/file-" + std::to_string(i) + ".o";
+        paths.emplace_back(Fm::FilePath::fromLocalPath(name.c_str()));
+    }
+    report("create", timer, n);
+
+    std::unordered_set<Fm::FilePath, Fm::FilePathHash> set;
+    set.reserve(n);
+    for(const auto& path : paths) {
+        set.insert(path);
+    }
+    report("insert", timer, n);
+
+    size_t found = 0;
+    for(int round = 0; round < 3; ++round) {
+        for(const auto& path : paths) {
+            found += set.count(path);
+        }
+    }
+    report("look up the same paths (x3)", timer, n * 3);
+
+    std::vector<Fm::FilePath> equalPaths;
+    equalPaths.reserve(n);
+    for(const auto& path : paths) {
+        equalPaths.emplace_back(Fm::FilePath{g_file_dup(path.gfile().get()), false});
+    }
+    timer.restart();
+    for(const auto& path : equalPaths) {
+        found += set.count(path);
+    }
+    report("look up equal paths", timer, n);
+
+    unsigned int hashes = 0;
+    for(const auto& path : paths) {
+        hashes += g_file_hash(path.gfile().get());
+    }
+    report("g_file_hash()", timer, n);
+    for(const auto& path : paths) {
+        hashes += path.hash();
+    }
+    report("FilePath::hash()", timer, n);
+
+    size_t length = 0;
+    for(const auto& path : paths) {
+        length += strlen(path.baseName().get());
+    }
+    report("FilePath::baseName()", timer, n);
+    for(const auto& path : paths) {
+        length += path.baseNameView().size();
+    }
+    report("FilePath::baseNameView()", timer, n);
+
+    std::vector<Fm::FilePath> moved;
+    moved.reserve(n);
+    for(auto& path : paths) {
+        moved.emplace_back(std::move(path));
+    }
+    report("move into a vector", timer, n);
+
+    for(const auto& path : moved) {
+        set.erase(path);
+    }
+    report("erase", timer, n);
+
+    qDebug() << found << "found," << set.size() << "left" << hashes % 2 << length % 2;
+    return found == size_t(n) * 4 && set.empty() ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Opens hundreds of monitored folders in a temporary directory and measures:
+// 1. how long it takes until all of them have seen the files that several threads
+//    create in all of them at the same time, and
+// 2. the throughput of threads that look up folders and read their files while
+//    the file monitors keep delivering events.
+// Usage: bench-foldercontention [folders] [files per folder] [threads]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "../core/folder.h"
+
+static void waitFor(const std::function<bool ()>& done) {
+    QEventLoop loop;
+    QTimer timer;
+    QObject::connect(&timer, &QTimer::timeout, &loop, [&]() {
+        if(done()) {
+            loop.quit();
+        }
+    });
+    timer.start(1);
+    loop.exec();
+}
+
+static void touchFiles(const std::vector<QString>& dirs, int files, int thread, int threads) {
+    for(int i = thread; i < files; i += threads) {
+        for(const auto& dir : dirs) {
+            QFile file{dir + QStringLiteral("/file-%1").arg(i)};
+            if(file.open(QIODevice::WriteOnly)) {
+                file.write("x");
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    int folderCount = argc > 1 ? std::atoi(argv[1]) : 300;
+    int fileCount = argc > 2 ? std::atoi(argv[2]) : 20;
+    int threadCount = argc > 3 ? std::atoi(argv[3]) : 8;
+    if(folderCount <= 0 || fileCount <= 0 || threadCount <= 0) {
+        qWarning("Usage: bench-foldercontention [folders] [files per folder] [threads]");
+        return 1;
+    }
+
+    QTemporaryDir tmpDir;
+    std::vector<QString> dirs;
+    std::vector<Fm::FilePath> paths;
+    for(int i = 0; i < folderCount; ++i) {
+        auto dir = tmpDir.path() + QStringLiteral("/folder-%1").arg(i);
+        QDir().mkpath(dir);
+        dirs.push_back(dir);
+        paths.push_back(Fm::FilePath::fromLocalPath(dir.toLocal8Bit().constData()));
+    }
+
+    std::vector<std::shared_ptr<Fm::Folder>> folders;
+    for(const auto& path : paths) {
+        folders.push_back(Fm::Folder::fromPath(path));
+    }
+    waitFor([&]() {
+        for(const auto& folder : folders) {
+            if(!folder->isLoaded()) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    // 1. all folders receive events at the same time
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<std::thread> writers;
+    for(int t = 0; t < threadCount; ++t) {
+        writers.emplace_back(touchFiles, std::cref(dirs), fileCount, t, threadCount);
+    }
+    for(auto& writer : writers) {
+        writer.join();
+    }
+    qint64 written = timer.elapsed();
+    waitFor([&]() {
+        for(const auto& folder : folders) {
+            if(folder->files().size() < static_cast<size_t>(fileCount)) {
+                return false;
+            }
+        }
+        return true;
+    });
+    qDebug() << folderCount * fileCount << "files created in" << folderCount << "folders by"
+             << threadCount << "threads in" << written << "ms, all seen after" << timer.elapsed() << "ms";
+
+    // 2. lookups from other threads while the folders keep receiving events
+    std::atomic<bool> stop{false};
+    std::atomic<quint64> lookups{0};
+    std::vector<std::thread> readers;
+    for(int t = 0; t < threadCount; ++t) {
+        readers.emplace_back([&, t]() {
+            quint64 n = 0;
+            size_t i = t;
+            while(!stop.load(std::memory_order_relaxed)) {
+                if(auto folder = Fm::Folder::findByPath(paths[i % paths.size()])) {
+                    folder->forEachFile([](const std::shared_ptr<const Fm::FileInfo>&) {});
+                }
+                i += 7;
+                ++n;
+            }
+            lookups += n;
+        });
+    }
+    writers.clear();
+    for(int t = 0; t < threadCount; ++t) {
+        writers.emplace_back(touchFiles, std::cref(dirs), fileCount, t, threadCount);
+    }
+    timer.restart();
+    QTimer::singleShot(2000, &app, [&]() {
+        stop = true;
+    });
+    waitFor([&]() {
+        return stop.load();
+    });
+    for(auto& writer : writers) {
+        writer.join();
+    }
+    for(auto& reader : readers) {
+        reader.join();
+    }
+    qDebug() << threadCount << "threads did" << lookups.load() * 1000 / std::max<qint64>(timer.elapsed(), 1)
+             << "folder lookups per second while receiving events";
+    return 0;
+}
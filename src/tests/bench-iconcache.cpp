@@ -0,0 +1,118 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Resolves the icons of many FileInfos the way a folder listing does, with the content
+// types spread over the types known to the system, and then with a file-specific icon
+// for every file (like desktop entries or custom folder icons), folder after folder. It
+// reports the time, the hit rate and the size of the icon cache, and the heap growth
+// once the files are freed, which should stay bounded by IconInfo::maxCacheSize().
+// Usage: bench-iconcache [files] [max cache size]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <gio/gio.h>
+#include "../core/fileinfo.h"
+#include "../core/iconinfo.h"
+#include "benchutils.h"
+
+static Fm::GFileInfoPtr makeGFileInfo(int i, const char* contentType, bool ownIcon) {
+    Fm::GFileInfoPtr inf{g_file_info_new(), false};
+    auto name = "file-" + std::to_string(i);
+    g_file_info_set_name(inf.get(), name.c_str());
+    g_file_info_set_display_name(inf.get(), name.c_str());
+    g_file_info_set_file_type(inf.get(), G_FILE_TYPE_REGULAR);
+    g_file_info_set_content_type(inf.get(), contentType);
+    g_file_info_set_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_MODE, S_IFREG | 0644);
+    Fm::GIconPtr icon;
+    if(ownIcon) {
+        auto iconPath = "/tmp/bench-iconcache/icon-" + std::to_string(i) + ".png";
+        Fm::GFilePtr iconFile{g_file_new_for_path(iconPath.c_str()), false};
+        icon = Fm::GIconPtr{g_file_icon_new(iconFile.get()), false};
+    }
+    else {
+        // a new GIcon for each file, like GIO returns them
+        icon = Fm::GIconPtr{g_content_type_get_icon(contentType), false};
+    }
+    g_file_info_set_icon(inf.get(), icon.get());
+    return inf;
+}
+
+static void resolve(const char* label, int n, bool ownIcon, const std::vector<std::string>& types) {
+    auto dirPath = Fm::FilePath::fromLocalPath("/tmp/bench-iconcache");
+    auto before = Fm::IconInfo::cacheStats();
+    size_t base = heapBytes();
+    QElapsedTimer timer;
+    timer.start();
+    // one folder of 1000 files after another, each freed when the next one is listed
+    const int folderSize = 1000;
+    for(int first = 0; first < n; first += folderSize) {
+        std::vector<std::shared_ptr<const Fm::FileInfo>> files;
+        files.reserve(folderSize);
+        for(int i = first; i < first + folderSize && i < n; ++i) {
+            auto inf = makeGFileInfo(i, types[i % types.size()].c_str(), ownIcon);
+            files.emplace_back(std::make_shared<const Fm::FileInfo>(inf, Fm::FilePath(), dirPath));
+        }
+    }
+    qint64 elapsed = timer.elapsed();
+    auto after = Fm::IconInfo::cacheStats();
+    auto lookups = (after.hits - before.hits) + (after.misses - before.misses);
+    qDebug() << label << ":" << n << "files in" << elapsed << "ms,"
+             << lookups << "cache lookups,"
+             << "hit rate" << (lookups ? double(after.hits - before.hits) / lookups : 1.0) << ","
+             << after.evictions - before.evictions << "evictions,"
+             << after.entries << "cached icons,"
+             << static_cast<qint64>(heapBytes() - base) / 1024 << "KiB heap growth";
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    int n = argc > 1 ? std::atoi(argv[1]) : 100000;
+    if(n <= 0) {
+        qWarning("Usage: bench-iconcache [files] [max cache size]");
+        return 1;
+    }
+    if(argc > 2) {
+        Fm::IconInfo::setMaxCacheSize(std::strtoul(argv[2], nullptr, 10));
+    }
+
+    std::vector<std::string> types;
+    GList* registered = g_content_types_get_registered();
+    for(GList* l = registered; l && types.size() < 200; l = l->next) {
+        types.emplace_back(static_cast<const char*>(l->data));
+    }
+    g_list_free_full(registered, g_free);
+    if(types.empty()) {
+        types.emplace_back("text/plain");
+    }
+
+    resolve("mime type icons", n, false, types);
+    resolve("mime type icons again", n, false, types);
+    resolve("file-specific icons", n, true, types);
+
+    QElapsedTimer timer;
+    timer.start();
+    const char* names[] = {"folder", "user-home", "user-desktop", "emblem-symbolic-link", "emblem-unreadable"};
+    for(int i = 0; i < n; ++i) {
+        Fm::IconInfo::fromName(names[i % 5]);
+    }
+    qDebug() << "IconInfo::fromName():" << n << "lookups in" << timer.elapsed() << "ms";
+    return 0;
+}
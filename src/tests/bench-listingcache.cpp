@@ -0,0 +1,101 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Compares the time until the content of a folder can be shown with and without the
+// persistent listing cache. A slow GVfs mount is simulated with a local folder whose
+// listing job sleeps for a round trip after each batch of files, like a remote
+// enumeration that fetches the entries in chunks. A real remote folder can be given
+// instead, in which case no delay is added.
+// Usage: bench-listingcache [files] [round trip ms] [folder URI]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include "../core/dirlistjob.h"
+#include "../core/listingcache.h"
+
+static Fm::FileInfoList listFolder(const Fm::FilePath& path, int roundTripMs) {
+    Fm::FileInfoList files;
+    Fm::DirListJob job{path, Fm::DirListJob::DETAILED};
+    job.setAutoDelete(false);
+    job.setIncremental(true);
+    job.setIncrementalBatch(100, 1000000);
+    QObject::connect(&job, &Fm::DirListJob::filesFound, [&](Fm::FileInfoList& found) {
+        files.insert(files.end(), found.cbegin(), found.cend());
+        if(roundTripMs > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(roundTripMs));
+        }
+    });
+    job.run();
+    files.insert(files.end(), job.files().cbegin(), job.files().cend());
+    return files;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    int n = argc > 1 ? std::atoi(argv[1]) : 5000;
+    int roundTripMs = argc > 2 ? std::atoi(argv[2]) : 20;
+    if(n <= 0 || roundTripMs < 0) {
+        qWarning("Usage: bench-listingcache [files] [round trip ms] [folder URI]");
+        return 1;
+    }
+
+    QTemporaryDir tmpDir;
+    Fm::FilePath path;
+    if(argc > 3) {
+        path = Fm::FilePath::fromPathStr(argv[3]);
+        roundTripMs = 0;
+    }
+    else {
+        for(int i = 0; i < n; ++i) {
+            QFile file{tmpDir.path() + QStringLiteral("/file-%1.txt").arg(i)};
+            if(file.open(QIODevice::WriteOnly)) {
+                file.write("x");
+            }
+        }
+        path = Fm::FilePath::fromLocalPath(tmpDir.path().toLocal8Bit().constData());
+    }
+
+    Fm::ListingCache::setEnabled(true);
+    Fm::ListingCache::setIncludeNativeFolders(true);
+
+    QElapsedTimer timer;
+    timer.start();
+    auto files = listFolder(path, roundTripMs);
+    qint64 listing = timer.elapsed();
+    qDebug() << "listing" << files.size() << "files:" << listing << "ms";
+
+    timer.restart();
+    Fm::ListingCache::save(path, files);
+    qint64 saving = timer.elapsed();
+
+    timer.restart();
+    auto cached = Fm::ListingCache::load(path);
+    qint64 loading = timer.elapsed();
+    qDebug() << "saving the listing:" << saving << "ms, loading" << cached.size()
+             << "cached files:" << loading << "ms,"
+             << "speedup until the content is shown:" << double(listing) / std::max<qint64>(loading, 1);
+
+    Fm::ListingCache::remove(path);
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Guesses the types of many file names with g_content_type_guess() and with
+// MimeType::guessFromFileName(), which caches the types of simple extensions, and checks
+// that both agree. The names follow the distributions of a build tree, a photo folder
+// and a log folder, with some names that only the globs of GIO can tell apart (like
+// "x.tar.gz", "libx.so.1", "Makefile.am" or "x.C" and "x.c"). The names of a folder can
+// be used instead, one per line on the standard input.
+// Usage: bench-mimeguess [names] | bench-mimeguess - < names.txt
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <gio/gio.h>
+#include "../core/mimetype.h"
+
+static std::vector<std::string> makeNames(int n) {
+    struct Kind {
+        const char* prefix;
+        const char* suffix;
+        int weight;
+    };
+    static const Kind kinds[] = {
+        {"object-", ".o", 30},
+        {"source-", ".c", 10},
+        {"header-", ".h", 8},
+        {"class-", ".C", 1},
+        {"IMG_", ".jpg", 15},
+        {"IMG_", ".JPG", 5},
+        {"photo-", ".png", 5},
+        {"server-", ".log", 10},
+        {"archive-", ".tar.gz", 3},
+        {"rotated-", ".log.1", 3},
+        {"libmodule-", ".so.1", 2},
+        {"notes-", ".txt~", 2},
+        {"README-", "", 1},
+        {"Makefile", ".am", 1},
+        {"data-", "", 2},
+        {".hidden-", "", 2}
+    };
+    int total = 0;
+    for(const auto& kind : kinds) {
+        total += kind.weight;
+    }
+    std::mt19937 random{42};
+    std::vector<std::string> names;
+    names.reserve(n);
+    for(int i = 0; i < n; ++i) {
+        int pick = random() % total;
+        for(const auto& kind : kinds) {
+            if((pick -= kind.weight) < 0) {
+                names.push_back(kind.prefix + std::to_string(i) + kind.suffix);
+                break;
+            }
+        }
+    }
+    return names;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    std::vector<std::string> names;
+    if(argc > 1 && strcmp(argv[1], "-") == 0) {
+        std::string line;
+        while(std::getline(std::cin, line)) {
+            names.push_back(line);
+        }
+    }
+    else {
+        int n = argc > 1 ? std::atoi(argv[1]) : 200000;
+        if(n <= 0) {
+            qWarning("Usage: bench-mimeguess [names] | bench-mimeguess - < names.txt");
+            return 1;
+        }
+        names = makeNames(n);
+    }
+
+    std::vector<std::string> gioTypes;
+    gioTypes.reserve(names.size());
+    std::vector<bool> gioUncertain;
+    QElapsedTimer timer;
+    timer.start();
+    for(const auto& name : names) {
+        gboolean uncertain = FALSE;
+        Fm::CStrPtr type{g_content_type_guess(name.c_str(), nullptr, 0, &uncertain)};
+        gioTypes.emplace_back(type.get());
+        gioUncertain.push_back(uncertain);
+    }
+    qint64 gioTime = timer.nsecsElapsed();
+
+    std::vector<std::shared_ptr<const Fm::MimeType>> types;
+    types.reserve(names.size());
+    std::vector<bool> typesUncertain;
+    timer.restart();
+    for(const auto& name : names) {
+        bool uncertain = false;
+        types.push_back(Fm::MimeType::guessFromFileName(name.c_str(), uncertain));
+        typesUncertain.push_back(uncertain);
+    }
+    qint64 cachedTime = timer.nsecsElapsed();
+
+    int mismatches = 0;
+    for(size_t i = 0; i < names.size(); ++i) {
+        if(gioTypes[i] != types[i]->name() || gioUncertain[i] != typesUncertain[i]) {
+            if(++mismatches <= 10) {
+                qWarning("%s: %s from GIO, %s cached", names[i].c_str(), gioTypes[i].c_str(), types[i]->name());
+            }
+        }
+    }
+    qDebug() << names.size() << "names,"
+             << "g_content_type_guess():" << gioTime / qint64(names.size()) << "ns per name,"
+             << "MimeType::guessFromFileName():" << cachedTime / qint64(names.size()) << "ns per name,"
+             << mismatches << "mismatches";
+    return mismatches > 0 ? 1 : 0;
+}
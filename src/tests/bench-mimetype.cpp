@@ -0,0 +1,94 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Looks up MimeType objects by name and classifies them (isText(), isImage() and so on),
+// the way the listing threads and the views do, with 1 and with the given number of
+// threads, over the types registered on the system. With lock-free lookups the time
+// per lookup should hardly grow with the threads.
+// Usage: bench-mimetype [threads] [lookups per thread]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gio/gio.h>
+#include "../core/mimetype.h"
+
+static qint64 run(int n_threads, int lookups, const std::vector<std::string>& types) {
+    std::atomic<int> classified{0};
+    auto worker = [&](int seed) {
+        int count = 0;
+        for(int i = 0; i < lookups; ++i) {
+            auto type = Fm::MimeType::fromName(types[(seed * 7919 + i) % types.size()].c_str());
+            if(type->isText() || type->isImage() || type->isDesktopEntry() || type->isUnknownType()) {
+                ++count;
+            }
+        }
+        classified += count;
+    };
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<std::thread> threads;
+    for(int i = 0; i < n_threads; ++i) {
+        threads.emplace_back(worker, i);
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+    qDebug() << n_threads << "threads:" << elapsed / (qint64(n_threads) * lookups) << "ns per lookup and classification,"
+             << classified.load() << "classified";
+    return elapsed;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    int n_threads = argc > 1 ? std::atoi(argv[1]) : 16;
+    int lookups = argc > 2 ? std::atoi(argv[2]) : 1000000;
+    if(n_threads <= 0 || lookups <= 0) {
+        qWarning("Usage: bench-mimetype [threads] [lookups per thread]");
+        return 1;
+    }
+
+    std::vector<std::string> types;
+    GList* registered = g_content_types_get_registered();
+    for(GList* l = registered; l; l = l->next) {
+        types.emplace_back(static_cast<const char*>(l->data));
+    }
+    g_list_free_full(registered, g_free);
+    if(types.empty()) {
+        types.emplace_back("text/plain");
+    }
+
+    // create all the MimeType objects first so that only the lookups are measured
+    QElapsedTimer timer;
+    timer.start();
+    for(const auto& type : types) {
+        Fm::MimeType::fromName(type.c_str());
+    }
+    qDebug() << "created" << types.size() << "mime types in" << timer.elapsed() << "ms";
+
+    qint64 single = run(1, lookups, types);
+    qint64 multi = run(n_threads, lookups, types);
+    qDebug() << "scaling:" << double(single) * n_threads / std::max<qint64>(multi, 1) << "of" << n_threads;
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Sorts file names like ProxyFolderModel does, with precomputed NaturalSortKey
+// objects and with a QCollator comparison of dot-separated parts on each compare.
+// Usage: bench-naturalsort [number of names]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <cstdlib>
+#include "../foldermodelitem.h"
+
+// the comparison done by ProxyFolderModel::lessThan() before the keys were cached
+static int compareText(const QCollator& collator, const QString& leftText, const QString& rightText) {
+    int comp = 0;
+    int leftStart = 0, rightStart = 0;
+    int leftEnd = 0, rightEnd = 0;
+    for(;;) {
+        leftEnd = leftText.indexOf(QLatin1Char('.'), leftStart);
+        rightEnd = rightText.indexOf(QLatin1Char('.'), rightStart);
+        QString lefPart = leftEnd == -1 ? leftText.sliced(leftStart) : leftText.sliced(leftStart, leftEnd - leftStart);
+        QString rightPart = rightEnd == -1 ? rightText.sliced(rightStart) : rightText.sliced(rightStart, rightEnd - rightStart);
+        comp = collator.compare(lefPart, rightPart);
+        if(comp == 0) {
+            comp = lefPart.size() - rightPart.size();
+        }
+        if(comp != 0 || leftEnd == -1 || rightEnd == -1) {
+            break;
+        }
+        leftStart = leftEnd + 1;
+        rightStart = rightEnd + 1;
+    }
+    if(comp == 0) {
+        comp = leftEnd - rightEnd;
+    }
+    return comp;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+
+    int n_names = argc > 1 ? std::atoi(argv[1]) : 100000;
+    const QString patterns[] = {
+        QStringLiteral("IMG_%1.JPG"),
+        QStringLiteral("report-%1.tar.gz"),
+        QStringLiteral("Track %1 - Unknown Artist.flac"),
+        QStringLiteral("build.%1.log"),
+        QStringLiteral("libfoo.so.%1")
+    };
+    QStringList names;
+    names.reserve(n_names);
+    auto rand = QRandomGenerator::global();
+    for(int i = 0; i < n_names; ++i) {
+        names << patterns[rand->bounded(5)].arg(rand->bounded(n_names));
+    }
+
+    QCollator collator;
+    collator.setNumericMode(true);
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+
+    QStringList sorted = names;
+    QElapsedTimer timer;
+    timer.start();
+    std::sort(sorted.begin(), sorted.end(), [&](const QString& a, const QString& b) {
+        return compareText(collator, a, b) < 0;
+    });
+    qDebug() << "QCollator::compare() on each comparison:" << timer.elapsed() << "ms";
+
+    timer.restart();
+    std::vector<std::pair<Fm::NaturalSortKey, int>> keys;
+    keys.reserve(n_names);
+    for(int i = 0; i < n_names; ++i) {
+        keys.emplace_back(Fm::NaturalSortKey{names.at(i), collator}, i);
+    }
+    qint64 keyTime = timer.elapsed();
+    std::sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) {
+        return a.first.compare(b.first) < 0;
+    });
+    qDebug() << "precomputed NaturalSortKey:" << timer.elapsed() << "ms, of which" << keyTime << "ms for making keys";
+
+    // both methods should give the same order, except for the names that are equal
+    int mismatches = 0;
+    for(int i = 0; i < n_names; ++i) {
+        if(names.at(keys[i].second) != sorted.at(i)) {
+            ++mismatches;
+        }
+    }
+    qDebug() << "mismatches:" << mismatches;
+    return mismatches == 0 ? 0 : 1;
+}
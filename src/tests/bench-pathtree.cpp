@@ -0,0 +1,126 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Compares the GFile-backed and the interned FilePath for many files of a deep tree:
+// the heap used to keep their paths, made with child() of their folder the way
+// FileInfo::path() does, also once localPath() has been called for each of them, and
+// the time of hash set lookups with paths made anew, of comparisons and of parent().
+// Both kinds must hash alike, which is checked too.
+// Usage: bench-pathtree [files] [depth]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "../core/filepath.h"
+#include "benchutils.h"
+
+static void run(bool interned, int n, int depth, std::vector<Fm::FilePath>& gfilePaths) {
+    std::string dirName = "/home/user/projects/libfm-qt/build";
+    for(int i = 0; i < depth; ++i) {
+        dirName += "/level-" + std::to_string(i);
+    }
+    const int filesPerDir = 1000;
+    auto makeDir = [&](int i) {
+        auto dirPath = dirName + "/dir-" + std::to_string(i / filesPerDir);
+        return interned ? Fm::FilePath::fromLocalPathInterned(dirPath.c_str()) : Fm::FilePath::fromLocalPath(dirPath.c_str());
+    };
+    auto fileName = [](int i) {
+        return "file-" + std::to_string(i) + ".o";
+    };
+    const char* label = interned ? "interned:" : "GFile-backed:";
+
+    size_t base = heapBytes();
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<Fm::FilePath> paths;
+    paths.reserve(n);
+    Fm::FilePath dir;
+    for(int i = 0; i < n; ++i) {
+        if(i % filesPerDir == 0) {
+            dir = makeDir(i);
+        }
+        paths.emplace_back(dir.child(fileName(i).c_str()));
+    }
+    qDebug() << label << (heapBytes() - base) / size_t(n) << "bytes per path,"
+             << timer.nsecsElapsed() / qint64(n) << "ns per child()";
+
+    // GFile-backed paths keep their local paths once asked for them, interned ones don't
+    timer.restart();
+    size_t length = 0;
+    for(const auto& path : paths) {
+        length += strlen(path.localPath().get());
+    }
+    qDebug() << label << (heapBytes() - base) / size_t(n) << "bytes per path after localPath(),"
+             << timer.nsecsElapsed() / qint64(n) << "ns per localPath()," << length / size_t(n) << "chars per path";
+
+    std::unordered_set<Fm::FilePath, Fm::FilePathHash> set{paths.begin(), paths.end()};
+    timer.restart();
+    size_t found = 0;
+    for(int i = 0; i < n; ++i) {
+        if(i % filesPerDir == 0) {
+            dir = makeDir(i);
+        }
+        found += set.count(dir.child(fileName(i).c_str()));
+    }
+    qDebug() << label << timer.nsecsElapsed() / qint64(n) << "ns per lookup of a new path," << found << "found";
+
+    timer.restart();
+    size_t equal = 0;
+    for(int i = 1; i < n; ++i) {
+        equal += paths[i] == paths[i - 1];
+    }
+    qDebug() << label << timer.nsecsElapsed() / qint64(n) << "ns per comparison," << equal << "equal";
+
+    timer.restart();
+    size_t parents = 0;
+    for(const auto& path : paths) {
+        parents += path.parent() == dir;
+    }
+    qDebug() << label << timer.nsecsElapsed() / qint64(n) << "ns per parent()," << parents << "in the last folder";
+
+    if(interned) {
+        size_t mismatches = 0;
+        for(int i = 0; i < n; ++i) {
+            if(paths[i].hash() != gfilePaths[i].hash() || !(paths[i] == gfilePaths[i])) {
+                ++mismatches;
+            }
+        }
+        qDebug() << mismatches << "paths differ from the GFile-backed ones";
+    }
+    else {
+        gfilePaths = std::move(paths);
+    }
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    int n = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int depth = argc > 2 ? std::atoi(argv[2]) : 8;
+    if(n <= 0 || depth < 0) {
+        qWarning("Usage: bench-pathtree [files] [depth]");
+        return 1;
+    }
+    std::vector<Fm::FilePath> gfilePaths;
+    run(false, n, depth, gfilePaths);
+    run(true, n, depth, gfilePaths);
+    return 0;
+}
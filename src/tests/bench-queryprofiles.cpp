@@ -0,0 +1,118 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Walks a tree recursively with g_file_enumerate_children(), the way the file operation
+// jobs do, querying the GIO attributes of one profile, and reports the wall time and the
+// read syscalls of the process. The tree may be local or GVfs-backed (a URI such as
+// sftp://host/dir or a path under /run/user/<uid>/gvfs). Each profile is run in its own
+// process so that the caches of GIO do not carry over; to count all the syscalls, run it
+// with "strace -c -f".
+// Usage: bench-queryprofiles <dir or URI> listing|fast|delete|copy|count|chattr [repeats]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <gio/gio.h>
+#include "../core/gioptrs.h"
+#include "../core/fileinfo_p.h"
+
+struct ProfileName {
+    const char* name;
+    Fm::GFileInfoQuery query;
+};
+
+static const ProfileName profileNames[] = {
+    {"listing", Fm::GFileInfoQuery::Listing},
+    {"fast", Fm::GFileInfoQuery::FastListing},
+    {"delete", Fm::GFileInfoQuery::Delete},
+    {"copy", Fm::GFileInfoQuery::Copy},
+    {"count", Fm::GFileInfoQuery::Count},
+    {"chattr", Fm::GFileInfoQuery::ChangeAttr}
+};
+
+// the number of read syscalls made by the process so far
+static qint64 readSyscalls() {
+    QFile file{QStringLiteral("/proc/self/io")};
+    if(!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const auto lines = file.readAll().split('\n');
+    for(const auto& line : lines) {
+        if(line.startsWith("syscr:")) {
+            return line.mid(6).trimmed().toLongLong();
+        }
+    }
+    return -1;
+}
+
+static size_t walk(GFile* dir, const char* attribs) {
+    size_t n_files = 0;
+    Fm::GFileEnumeratorPtr enu{
+        g_file_enumerate_children(dir, attribs, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, nullptr, nullptr),
+        false
+    };
+    if(!enu) {
+        return 0;
+    }
+    while(Fm::GFileInfoPtr inf{g_file_enumerator_next_file(enu.get(), nullptr, nullptr), false}) {
+        ++n_files;
+        if(g_file_info_get_file_type(inf.get()) == G_FILE_TYPE_DIRECTORY) {
+            Fm::GFilePtr child{g_file_get_child(dir, g_file_info_get_name(inf.get())), false};
+            n_files += walk(child.get(), attribs);
+        }
+    }
+    g_file_enumerator_close(enu.get(), nullptr, nullptr);
+    return n_files;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    if(argc < 3) {
+        qWarning("Usage: bench-queryprofiles <dir or URI> listing|fast|delete|copy|count|chattr [repeats]");
+        return 1;
+    }
+    const ProfileName* profile = nullptr;
+    for(const auto& p : profileNames) {
+        if(strcmp(argv[2], p.name) == 0) {
+            profile = &p;
+        }
+    }
+    if(!profile) {
+        qWarning("unknown profile %s", argv[2]);
+        return 1;
+    }
+    int repeats = argc > 3 ? std::max(std::atoi(argv[3]), 1) : 3;
+    Fm::GFilePtr dir{g_file_new_for_commandline_arg(argv[1]), false};
+    const char* attribs = Fm::gFileInfoQueryAttribs(profile->query);
+
+    qint64 baseSyscalls = readSyscalls();
+    size_t n_files = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < repeats; ++i) {
+        n_files = walk(dir.get(), attribs);
+    }
+    qint64 elapsed = timer.elapsed();
+    qDebug() << profile->name << "profile:" << n_files << "files,"
+             << elapsed / repeats << "ms per walk,"
+             << (readSyscalls() - baseSyscalls) / repeats << "read syscalls per walk";
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Queries all the files of a folder with each StatxStage backend and checks that they
+// give the same results. Unless a folder is given, one with the given number of files
+// is made in the temporary folder (a tmpfs on most systems). To measure cold caches,
+// pass a folder on a mounted ext4 image and run it as root with "cold", which drops
+// the page, dentry and inode caches before each backend.
+// Usage: bench-statxstage [files] [folder] [cold]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QDebug>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../core/statxstage.h"
+
+#ifdef FM_HAVE_STATX_STAGE
+
+static const char* backendName(Fm::StatxStage::Backend backend) {
+    switch(backend) {
+    case Fm::StatxStage::IoUring:
+        return "io_uring";
+    case Fm::StatxStage::ThreadPool:
+        return "thread pool";
+    case Fm::StatxStage::Synchronous:
+        return "synchronous";
+    default:
+        return "auto";
+    }
+}
+
+static bool dropCaches() {
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, "3", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+static std::vector<std::string> readNames(const std::string& dir) {
+    std::vector<std::string> names;
+    if(DIR* d = opendir(dir.c_str())) {
+        while(struct dirent* ent = readdir(d)) {
+            if(strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+                names.emplace_back(ent->d_name);
+            }
+        }
+        closedir(d);
+    }
+    return names;
+}
+
+#endif // FM_HAVE_STATX_STAGE
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+#ifdef FM_HAVE_STATX_STAGE
+    int n = argc > 1 ? std::atoi(argv[1]) : 100000;
+    if(n <= 0) {
+        qWarning("Usage: bench-statxstage [files] [folder] [cold]");
+        return 1;
+    }
+    const bool cold = argc > 3 && strcmp(argv[3], "cold") == 0;
+
+    QTemporaryDir tmpDir;
+    std::string dir;
+    if(argc > 2) {
+        dir = argv[2];
+    }
+    else {
+        dir = tmpDir.path().toStdString();
+        for(int i = 0; i < n; ++i) {
+            std::string path = dir + "/file-" + std::to_string(i);
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if(fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    const auto names = readNames(dir);
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirFd < 0) {
+        qWarning("cannot open %s", dir.c_str());
+        return 1;
+    }
+
+    std::vector<struct statx> expected;
+    const Fm::StatxStage::Backend backends[] = {
+        Fm::StatxStage::Synchronous, Fm::StatxStage::ThreadPool, Fm::StatxStage::IoUring
+    };
+    int failures = 0;
+    for(auto backend : backends) {
+        auto stage = Fm::StatxStage::create(backend);
+        if(stage->backend() != backend) {
+            qDebug() << backendName(backend) << "is not available";
+            continue;
+        }
+        std::vector<Fm::StatxStage::Request> requests;
+        requests.reserve(names.size());
+        for(const auto& name : names) {
+            requests.push_back(Fm::StatxStage::Request{name.c_str(), 0, {}});
+        }
+        if(cold && !dropCaches()) {
+            qWarning("cannot drop the caches; run it as root");
+            return 1;
+        }
+        else if(!cold) {
+            // warm up the caches so that every backend finds the same state
+            auto warmUp = requests;
+            stage->run(dirFd, AT_SYMLINK_NOFOLLOW, STATX_BASIC_STATS, warmUp.data(), warmUp.size());
+        }
+        QElapsedTimer timer;
+        timer.start();
+        // query in the batches TotalSizeJob uses
+        for(std::size_t first = 0; first < requests.size(); first += 512) {
+            stage->run(dirFd, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_BASIC_STATS,
+                       requests.data() + first, std::min<std::size_t>(512, requests.size() - first));
+        }
+        qDebug() << backendName(backend) << ":" << requests.size() << "files in" << timer.nsecsElapsed() / 1000 << "us";
+
+        if(expected.empty()) {
+            for(const auto& request : requests) {
+                expected.push_back(request.result);
+            }
+            continue;
+        }
+        for(std::size_t i = 0; i < requests.size(); ++i) {
+            const auto& a = requests[i].result;
+            const auto& b = expected[i];
+            if(requests[i].error != 0 || a.stx_ino != b.stx_ino || a.stx_mode != b.stx_mode || a.stx_size != b.stx_size) {
+                if(++failures <= 10) {
+                    qWarning("different results for %s", names[i].c_str());
+                }
+            }
+        }
+    }
+    close(dirFd);
+    return failures > 0 ? 1 : 0;
+#else
+    qWarning("statx() is not available");
+    return 0;
+#endif
+}
@@ -0,0 +1,101 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Makes a 256px thumbnail of an image like ThumbnailJob does, either by reading the
+// whole file into memory and decoding it at full resolution (as ThumbnailJob did
+// before) or with ThumbnailJob::readImage(), which lets QImageReader read the file and
+// downscale JPEG images while decoding them.
+// Since the peak RSS of a process only grows, each method is run in its own process.
+// Usage: bench-thumbnaildecode <image file> full|stream [repeats]
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QFile>
+#include <QImage>
+#include <QImageReader>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+
+#include "../core/thumbnailjob.h"
+
+static const int targetSize = 256;
+
+static long peakRssKiB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static QImage decodeFull(const QString& fileName) {
+    QFile file{fileName};
+    if(!file.open(QIODevice::ReadOnly)) {
+        return QImage();
+    }
+    QByteArray data = file.readAll();
+    QImage image;
+    image.loadFromData(data);
+    if(image.width() > targetSize || image.height() > targetSize) {
+        image = image.scaled(targetSize, targetSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+}
+
+static QImage decodeStreaming(const QString& fileName) {
+    QImageReader reader{fileName};
+    bool tooLarge = false;
+    QImage image = Fm::ThumbnailJob::readImage(reader, targetSize, tooLarge);
+    if(tooLarge) {
+        qWarning("the image is larger than the limit of %d megapixels", Fm::ThumbnailJob::maxThumbnailImageSize());
+    }
+    // ThumbnailJob scales the result in the same way
+    if(image.width() > targetSize || image.height() > targetSize) {
+        image = image.scaled(targetSize, targetSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    if(argc < 3) {
+        qWarning("Usage: bench-thumbnaildecode <image file> full|stream [repeats]");
+        return 1;
+    }
+    QString fileName = QString::fromLocal8Bit(argv[1]);
+    bool streaming = strcmp(argv[2], "stream") == 0;
+    int repeats = argc > 3 ? std::atoi(argv[3]) : 10;
+
+    long baseRss = peakRssKiB();
+    QElapsedTimer timer;
+    timer.start();
+    QImage image;
+    for(int i = 0; i < repeats; ++i) {
+        image = streaming ? decodeStreaming(fileName) : decodeFull(fileName);
+    }
+    qint64 elapsed = timer.elapsed();
+    if(image.isNull()) {
+        qWarning("cannot decode %s", argv[1]);
+        return 1;
+    }
+    qDebug() << (streaming ? "streaming decode:" : "full decode:")
+             << elapsed / std::max(repeats, 1) << "ms per thumbnail,"
+             << "peak RSS grew by" << (peakRssKiB() - baseRss) << "KiB,"
+             << "thumbnail size" << image.size();
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Paints the QIcon of a live IconInfo and a copy of the QIcon of an IconInfo that was
+// evicted from the icon cache. Both must paint through Fm::IconEngine without crashing,
+// and the evicted one must look its icon up again and paint like a new IconInfo of it.
+#include <QApplication>
+#include <QDebug>
+#include <QImage>
+#include <QPainter>
+#include "../core/iconinfo.h"
+
+static QImage paint(const QIcon& icon) {
+    QImage image{32, 32, QImage::Format_ARGB32_Premultiplied};
+    image.fill(Qt::transparent);
+    QPainter painter{&image};
+    icon.paint(&painter, image.rect());
+    painter.end();
+    return image;
+}
+
+int main(int argc, char** argv) {
+    QApplication app(argc, argv);
+
+    auto live = Fm::IconInfo::fromName("folder");
+    QImage liveImage = paint(live->qicon());
+
+    QIcon evictedIcon;
+    {
+        auto info = Fm::IconInfo::fromName("text-x-generic");
+        evictedIcon = info->qicon();
+    }
+    // nothing else references "text-x-generic", so it is dropped from the cache
+    auto before = Fm::IconInfo::cacheStats();
+    Fm::IconInfo::setMaxCacheSize(0);
+    auto after = Fm::IconInfo::cacheStats();
+    if(after.evictions == before.evictions) {
+        qWarning("the icon was not evicted");
+        return 1;
+    }
+
+    QImage evictedImage = paint(evictedIcon);
+    if(Fm::IconInfo::cacheStats().misses == after.misses) {
+        qWarning("the evicted icon was not looked up again");
+        return 1;
+    }
+    // the icon theme may have no such icon, so compare with a new IconInfo of it
+    auto fresh = Fm::IconInfo::fromName("text-x-generic");
+    if(evictedIcon.isNull() != fresh->qicon().isNull()
+       || evictedIcon.availableSizes() != fresh->qicon().availableSizes()
+       || evictedImage != paint(fresh->qicon())) {
+        qWarning() << "the evicted icon differs from its new IconInfo: sizes"
+                   << evictedIcon.availableSizes() << "and" << fresh->qicon().availableSizes();
+        return 1;
+    }
+
+    if(paint(live->qicon()) != liveImage) {
+        qWarning("the live icon changed after the eviction");
+        return 1;
+    }
+    qDebug() << "evicted icon: null =" << evictedIcon.isNull() << "sizes =" << evictedIcon.availableSizes();
+    return 0;
+}